@@ -12,32 +12,44 @@ TARGET = OpenGL_transformations
 TEMPLATE = app
 CONFIG += c++14
 
+include(generation.pri)
+
 SOURCES += main.cpp\
     mainwindow.cpp \
     mainview.cpp \
     user_input.cpp \
     model.cpp \
+    objparser.cpp \
     modeldata.cpp \
     shaderprogram.cpp \
     material.cpp \
     object.cpp \
-    noisegrid.cpp \
     framebuffer.cpp \
     texture.cpp \
-    renderbuffer.cpp
+    renderbuffer.cpp \
+    gridtopology.cpp \
+    lodquadtree.cpp \
+    lodterrain.cpp \
+    terraingenerator.cpp \
+    chunkmanager.cpp
 
 HEADERS  += mainwindow.h \
     mainview.h \
     model.h \
-    vertex.h \
+    objparser.h \
     modeldata.h \
     shaderprogram.h \
     material.h \
     object.h \
-    noisegrid.h \
     framebuffer.h \
     texture.h \
-    renderbuffer.h
+    renderbuffer.h \
+    gridtopology.h \
+    lodquadtree.h \
+    lodterrain.h \
+    terraingenerator.h \
+    chunkmanager.h \
+    lrucache.h
 
 FORMS    += mainwindow.ui
 
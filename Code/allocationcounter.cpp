@@ -0,0 +1,47 @@
+#include "allocationcounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// relaxed, counting costs next to nothing compared to the allocation itself
+std::atomic<uint64_t> allocationCount(0);
+std::atomic<uint64_t> allocatedBytes(0);
+
+} // namespace
+
+AllocationCount getAllocationCount() {
+    return { allocationCount.load(std::memory_order_relaxed), allocatedBytes.load(std::memory_order_relaxed) };
+}
+
+// The replaceable global operators. The array and nothrow forms call these
+// by default, so every allocation with new is counted exactly once.
+
+void *operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+    void *memory = std::malloc(size == 0 ? 1 : size);
+
+    while (memory == nullptr) {
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            throw std::bad_alloc();
+        }
+
+        handler();
+        memory = std::malloc(size == 0 ? 1 : size);
+    }
+
+    return memory;
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
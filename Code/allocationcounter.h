@@ -0,0 +1,24 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <cstdint>
+
+/**
+ * The heap allocations made with operator new, which includes those of
+ * the standard containers, by all threads since the program started
+ */
+struct AllocationCount {
+    uint64_t allocations;
+    uint64_t bytes;
+};
+
+/**
+ * @brief getAllocationCount
+ *
+ * The allocations so far. The difference between the counts before and
+ * after some code is what it allocated, as long as no other thread
+ * allocated in the meantime.
+ */
+AllocationCount getAllocationCount();
+
+#endif // ALLOCATIONCOUNTER_H
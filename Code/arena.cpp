@@ -0,0 +1,50 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+Arena::Arena(size_t blockSize) : blockSize(blockSize), current(0), offset(0) {
+}
+
+void *Arena::allocate(size_t bytes, size_t alignment) {
+    // the current block, or the blocks after it that are kept from before a rewind
+    for (; current < blocks.size(); current++, offset = 0) {
+        const Block& block = blocks[current];
+
+        uintptr_t start = reinterpret_cast<uintptr_t>(block.data.get()) + offset;
+        uintptr_t aligned = (start + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+        size_t end = offset + (aligned - start) + bytes;
+
+        if (end <= block.size) {
+            offset = end;
+            return reinterpret_cast<void *>(aligned);
+        }
+    }
+
+    // a new block, large enough for this allocation at any alignment
+    size_t size = std::max(blockSize, bytes + alignment);
+    blocks.push_back({ std::unique_ptr<char[]>(new char[size]), size });
+    current = blocks.size() - 1;
+    offset = 0;
+
+    return allocate(bytes, alignment);
+}
+
+void Arena::rewind(const Mark& mark) {
+    current = mark.block;
+    offset = mark.offset;
+}
+
+size_t Arena::getCapacity() const {
+    size_t capacity = 0;
+    for (const Block& block : blocks) {
+        capacity += block.size;
+    }
+
+    return capacity;
+}
+
+Arena& Arena::scratch() {
+    static thread_local Arena arena;
+    return arena;
+}
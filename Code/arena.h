@@ -0,0 +1,97 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief The Arena class
+ *
+ * Hands out memory from blocks it keeps, so memory that is needed again
+ * and again, like the rows every generation pass works on, only comes
+ * from the heap the first time. Allocating moves an offset forward, and
+ * rewinding to an earlier mark makes everything allocated since then
+ * available again, without freeing the blocks.
+ *
+ * The arena doesn't destroy what is allocated in it, so it is meant for
+ * trivially destructible data, or objects that are destroyed by hand.
+ */
+class Arena {
+
+public:
+    // where the next allocation starts, to rewind to later
+    struct Mark {
+        size_t block;
+        size_t offset;
+    };
+
+    /**
+     * @param blockSize the size of new blocks, larger allocations get a block of their own
+     */
+    explicit Arena(size_t blockSize = 64 * 1024);
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    // uninitialized memory for count objects of type T
+    template<typename T>
+    T *allocateArray(size_t count) {
+        return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    inline Mark getMark() const { return { current, offset }; }
+    void rewind(const Mark& mark);
+
+    // makes all memory available again, the blocks are kept
+    inline void reset() { rewind({ 0, 0 }); }
+
+    // the bytes of all blocks
+    size_t getCapacity() const;
+
+    /**
+     * @brief scratch
+     *
+     * The arena of the calling thread, for memory that is only needed
+     * until the end of an ArenaScope on that thread
+     */
+    static Arena& scratch();
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    size_t blockSize;
+    std::vector<Block> blocks;
+
+    // the block allocations come from, and the first free byte in it
+    size_t current;
+    size_t offset;
+
+};
+
+/**
+ * @brief The ArenaScope class
+ *
+ * Rewinds an arena to where it was when the scope started
+ */
+class ArenaScope {
+
+public:
+    explicit ArenaScope(Arena& arena) : arena(arena), mark(arena.getMark()) {}
+    ~ArenaScope() { arena.rewind(mark); }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    Arena& arena;
+    Arena::Mark mark;
+
+};
+
+#endif // ARENA_H
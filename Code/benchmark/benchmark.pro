@@ -0,0 +1,26 @@
+#-------------------------------------------------
+#
+# Benchmarks of the terrain generation pipeline,
+# printed as JSON
+#
+#-------------------------------------------------
+
+QT       += core gui
+QT       -= widgets
+
+TARGET = benchmark
+TEMPLATE = app
+CONFIG += c++14 console
+CONFIG -= app_bundle
+
+include(../generation.pri)
+
+# the allocation counter replaces the global operator new, so only the benchmark links it
+SOURCES += main.cpp \
+    ../model.cpp \
+    ../objparser.cpp \
+    ../allocationcounter.cpp
+
+HEADERS += ../model.h \
+    ../objparser.h \
+    ../allocationcounter.h
@@ -0,0 +1,457 @@
+#include "noisegrid.h"
+#include "generationcontext.h"
+#include "allocationcounter.h"
+#include "model.h"
+#include "objparser.h"
+#include "meshfile.h"
+#include "triangleorder.h"
+#include "simd.h"
+#include "threadpool.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/**
+ * How long to time a stage: at least minRepeats runs, and more until
+ * minTime seconds have passed, up to maxRepeats
+ */
+struct Timing {
+    unsigned minRepeats = 3;
+    unsigned maxRepeats = 1000;
+    double minTime = 0.2;
+};
+
+/**
+ * The result of timing one stage
+ */
+struct Measurement {
+    unsigned repeats;
+    double medianNs;
+    double minNs;
+
+    // the heap allocations of the run that allocated the least, which is
+    // what the stage allocates once everything it reuses has grown
+    uint64_t allocations;
+    uint64_t allocatedBytes;
+};
+
+// runs setup (untimed) and body (timed) until the timing is satisfied
+Measurement measure(const Timing& timing, const std::function<void()>& setup, const std::function<void()>& body) {
+    std::vector<double> times;
+    times.reserve(timing.maxRepeats);
+
+    double total = 0;
+    AllocationCount fewest = { std::numeric_limits<uint64_t>::max(), 0 };
+
+    while (times.size() < timing.maxRepeats && (times.size() < timing.minRepeats || total < timing.minTime * 1e9)) {
+        setup();
+
+        AllocationCount before = getAllocationCount();
+        auto start = std::chrono::high_resolution_clock::now();
+        body();
+        auto end = std::chrono::high_resolution_clock::now();
+        AllocationCount after = getAllocationCount();
+
+        if (after.allocations - before.allocations < fewest.allocations) {
+            fewest = { after.allocations - before.allocations, after.bytes - before.bytes };
+        }
+
+        times.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+        total += times.back();
+    }
+
+    std::sort(times.begin(), times.end());
+    return { static_cast<unsigned>(times.size()), times[times.size() / 2], times.front(),
+             fewest.allocations, fewest.bytes };
+}
+
+/**
+ * @brief resultKey
+ *
+ * Identifies a result, to find it back in a baseline
+ */
+QString resultKey(const QJsonObject& result) {
+    return QString("%1 N=%2 threads=%3 simd=%4").arg(result["stage"].toString())
+            .arg(result["detail"].toInt()).arg(result["threads"].toInt()).arg(result["simd"].toString());
+}
+
+/**
+ * @brief writeGridObj
+ *
+ * Writes a generated grid as a triangulated OBJ file with normals and uvs,
+ * the kind of file Model loads
+ */
+bool writeGridObj(const QString& path, const MeshData& mesh) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    QTextStream out(&file);
+    for (const vertex& v : mesh.vertices) {
+        out << "v " << v.x << " " << v.y << " " << v.z << "\n";
+    }
+
+    for (const vertex& v : mesh.vertices) {
+        out << "vt " << v.u << " " << v.v << "\n";
+    }
+
+    for (const vertex& v : mesh.vertices) {
+        out << "vn " << v.nx << " " << v.ny << " " << v.nz << "\n";
+    }
+
+    // two triangles per quad, 1-based
+    for (unsigned x = 0; x + 1 < mesh.gridSize; x++) {
+        for (unsigned z = 0; z + 1 < mesh.gridSize; z++) {
+            unsigned a = x * mesh.gridSize + z + 1;
+            unsigned b = a + 1;
+            unsigned c = a + mesh.gridSize;
+            unsigned d = c + 1;
+
+            out << "f " << a << "/" << a << "/" << a << " " << b << "/" << b << "/" << b << " "
+                << c << "/" << c << "/" << c << "\n";
+            out << "f " << b << "/" << b << "/" << b << " " << d << "/" << d << "/" << d << " "
+                << c << "/" << c << "/" << c << "\n";
+        }
+    }
+
+    return true;
+}
+
+// reads every word of a buffer, so its pages are actually loaded
+uint64_t sumWords(const void *data, size_t bytes) {
+    const char *words = static_cast<const char *>(data);
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, words + i, sizeof(word));
+        sum += word;
+    }
+
+    return sum;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times the stages of the terrain generation pipeline and prints the results as JSON.");
+    parser.addHelpOption();
+
+    QCommandLineOption minDetailOption("min-detail", "Smallest grid, 2^detail + 1 vertices wide.", "detail", "6");
+    parser.addOption(minDetailOption);
+
+    QCommandLineOption maxDetailOption("max-detail", "Largest grid, 2^detail + 1 vertices wide.", "detail", "13");
+    parser.addOption(maxDetailOption);
+
+    QCommandLineOption maxObjDetailOption("max-obj-detail", "Largest grid to load as an OBJ file.", "detail", "10");
+    parser.addOption(maxObjDetailOption);
+
+    QCommandLineOption threadsOption("threads",
+            "Comma separated thread counts to sweep, 0 = one per hardware thread.", "counts", "1,0");
+    parser.addOption(threadsOption);
+
+    QCommandLineOption simdOption("simd", "Comma separated SIMD levels to sweep (scalar, sse2, avx2), "
+                                  "levels the CPU lacks are skipped. Defaults to all supported levels.", "levels");
+    parser.addOption(simdOption);
+
+    QCommandLineOption minTimeOption("min-time", "Seconds to repeat every stage for, at least.", "seconds", "0.2");
+    parser.addOption(minTimeOption);
+
+    QCommandLineOption objOption("obj", "Also time loading this OBJ file.", "file");
+    parser.addOption(objOption);
+
+    QCommandLineOption outputOption("output", "Write the JSON to this file instead of stdout.", "file");
+    parser.addOption(outputOption);
+
+    QCommandLineOption baselineOption("baseline", "Compare against the JSON of an earlier run.", "file");
+    parser.addOption(baselineOption);
+
+    QCommandLineOption toleranceOption("tolerance",
+            "Fraction a stage may be slower than the baseline before it counts as a regression.", "fraction", "0.1");
+    parser.addOption(toleranceOption);
+
+    parser.process(a);
+
+    Timing timing;
+    timing.minTime = parser.value(minTimeOption).toDouble();
+
+    unsigned minDetail = parser.value(minDetailOption).toUInt();
+    unsigned maxDetail = parser.value(maxDetailOption).toUInt();
+    unsigned maxObjDetail = parser.value(maxObjDetailOption).toUInt();
+    uint64_t seed = 1234;
+
+    std::vector<unsigned> threadCounts;
+    for (const QString& count : parser.value(threadsOption).split(',')) {
+        bool threadsValid = false;
+        unsigned threads = count.toUInt(&threadsValid);
+        if (!threadsValid) {
+            std::fprintf(stderr, "The thread counts must be numbers, 0 for one per hardware thread, not %s\n",
+                         qPrintable(count));
+            return 1;
+        }
+
+        threads = threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : threads;
+
+        if (std::find(threadCounts.begin(), threadCounts.end(), threads) == threadCounts.end()) {
+            threadCounts.push_back(threads);
+        }
+    }
+
+    SimdLevel detected = detectSimdLevel();
+    std::vector<SimdLevel> simdLevels;
+    for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 }) {
+        bool requested = !parser.isSet(simdOption) ||
+                parser.value(simdOption).split(',').contains(getSimdLevelName(level));
+
+        if (requested && level <= detected) {
+            simdLevels.push_back(level);
+        }
+    }
+
+    QJsonArray results;
+
+    // stage name, samples and the bytes it produces per sample
+    auto record = [&](const char *stage, unsigned detail, unsigned threads, SimdLevel level,
+                      double samples, double bytes, const Measurement& measurement) {
+        QJsonObject result;
+        result["stage"] = stage;
+        result["detail"] = static_cast<int>(detail);
+        result["threads"] = static_cast<int>(threads);
+        result["simd"] = getSimdLevelName(level);
+        result["samples"] = samples;
+        result["repeats"] = static_cast<int>(measurement.repeats);
+        result["medianNs"] = measurement.medianNs;
+        result["minNs"] = measurement.minNs;
+        result["nsPerSample"] = measurement.medianNs / samples;
+        result["bytesPerSample"] = bytes / samples;
+        result["allocations"] = static_cast<double>(measurement.allocations);
+        result["allocatedBytes"] = static_cast<double>(measurement.allocatedBytes);
+        results.append(result);
+
+        std::fprintf(stderr, "%-20s N=%-2u threads=%-2u %-6s %10.3f ms %8.2f ns/sample %8llu allocations\n", stage,
+                     detail, threads, getSimdLevelName(level), measurement.medianNs / 1e6, measurement.medianNs / samples,
+                     static_cast<unsigned long long>(measurement.allocations));
+    };
+
+    // the grid stages, for every size, thread count and instruction set
+    for (unsigned detail = minDetail; detail <= maxDetail; detail++) {
+        unsigned size = (1u << detail) + 1;
+        double samples = double(size) * size;
+        unsigned octaves = detail > 4 ? detail - 4 : 1;
+        std::vector<GLuint> triangles = createGridTriangles(size);
+
+        for (unsigned threads : threadCounts) {
+            ThreadPool::setGlobalThreadCount(threads);
+
+            for (SimdLevel level : simdLevels) {
+                setSimdLevel(level);
+
+                std::unique_ptr<NoiseGrid> grid;
+                double heightBytes = double(NoiseGrid(detail).getHeights().getStride()) * size * sizeof(float);
+
+                Measurement construct = measure(timing, [&]() { grid.reset(); },
+                                                [&]() { grid.reset(new NoiseGrid(detail)); });
+                record("construct", detail, threads, level, samples, heightBytes, construct);
+
+                // adding layers again doesn't change the amount of work
+                Measurement spike = measure(timing, []() {}, [&]() { grid->addSpike(-2, 1, 3); });
+                record("addSpike", detail, threads, level, samples, heightBytes, spike);
+
+                Measurement noise = measure(timing, []() {}, [&]() { grid->addOctaves(octaves, 1.0f, 4, seed); });
+                record("addOctaves", detail, threads, level, samples, heightBytes, noise);
+
+                // the spike and the octaves in a single pass
+                auto stages = sumStages(SpikeStage(-2, 1, 3), OctavesStage(octaves, 1.0f, 4, seed));
+                Measurement fused = measure(timing, []() {}, [&]() { grid->add(stages); });
+                record("addPipeline", detail, threads, level, samples, heightBytes, fused);
+
+                MeshData mesh;
+                Measurement meshData = measure(timing, [&]() { mesh = MeshData(); },
+                                               [&]() { mesh = grid->createMeshData(); });
+                record("createMeshData", detail, threads, level, samples, samples * sizeof(vertex), meshData);
+
+                Measurement heightmapData = measure(timing, []() {}, [&]() { grid->createHeightmapData(false); });
+                record("createHeightmapData", detail, threads, level, samples, samples * sizeof(GLfloat), heightmapData);
+
+                Measurement tangents = measure(timing, []() {},
+                                               [&]() { MeshData::calculateTangents(mesh.vertices, triangles); });
+                record("calculateTangents", detail, threads, level, samples, samples * sizeof(vertex), tangents);
+
+                // what the viewer does for every new seed: the memory of the
+                // terrain before is reused, so this shouldn't allocate at all
+                GenerationContext context;
+                TerrainParameters parameters = { detail, seed, false, 0, 1.0f, 0.0f, QString(), QString(),
+                                                 HeightEncoding::Float32 };
+
+                Measurement regenerate = measure(timing, [&]() { parameters.seed++; }, [&]() {
+                    GeneratedTerrain terrain;
+                    context.generate(parameters, terrain, []() { return false; });
+                });
+                record("regenerate", detail, threads, level, samples, samples * sizeof(vertex), regenerate);
+            }
+        }
+    }
+
+    // OBJ files are parsed in chunks on the global pool, so they are timed for
+    // every thread count, with the detected instruction set
+    setSimdLevel(detected);
+
+    std::vector< std::pair<QString, unsigned> > objFiles;
+    QString generatedObj = QDir::temp().filePath("terrain_benchmark.obj");
+    QString generatedMesh = MeshFile::getPath(generatedObj);
+
+    // what the mesh file reads add up to, so the reads aren't optimized away
+    volatile uint64_t checksum = 0;
+
+    for (unsigned detail = std::min(minDetail, maxObjDetail); detail <= maxObjDetail; detail++) {
+        NoiseGrid grid(detail);
+        grid.addSpike(-2, 1, 3);
+        grid.addOctaves(detail > 4 ? detail - 4 : 1, 1.0f, 4, seed);
+
+        MeshData mesh = grid.createMeshData();
+        if (!writeGridObj(generatedObj, mesh)) {
+            std::fprintf(stderr, "Can't write %s\n", qPrintable(generatedObj));
+            break;
+        }
+
+        double vertices = double(mesh.vertices.size());
+        double bytes = double(QFileInfo(generatedObj).size());
+
+        for (unsigned threads : threadCounts) {
+            ThreadPool::setGlobalThreadCount(threads);
+
+            // only reading the text, reading and welding it into a Model, and
+            // welding it straight into the vertices of a mesh like ModelData does
+            Measurement parse = measure(timing, []() {}, [&]() { ObjData data; parseObj(generatedObj, data); });
+            record("parseObj", detail, threads, getSimdLevel(), vertices, bytes, parse);
+
+            Measurement load = measure(timing, []() {}, [&]() { Model model(generatedObj); });
+            record("loadObj", detail, threads, getSimdLevel(), vertices, bytes, load);
+
+            Measurement loadMesh = measure(timing, []() {}, [&]() { MeshData mesh = loadObjMesh(generatedObj); });
+            record("loadObjMesh", detail, threads, getSimdLevel(), vertices, bytes, loadMesh);
+        }
+
+        // loading the OBJ once its mesh file exists: hashing the OBJ, opening the
+        // mesh file and reading its buffers once, like uploading them does
+        std::vector<GLuint> triangles = createGridTriangles(mesh.gridSize);
+        MeshFileInfo info;
+        MeshFile::hashSource(generatedObj, info.sourceHash, info.sourceSize);
+        MeshFile::write(generatedMesh, info, mesh.vertices.data(), mesh.vertices.size(), triangles.data(), triangles.size());
+
+        Measurement cached = measure(timing, []() {}, [&]() {
+            uint64_t hash, size;
+            MeshFile::hashSource(generatedObj, hash, size);
+
+            MeshFilePtr file = MeshFile::open(generatedMesh);
+            if (file != nullptr && file->isBuiltWith(info)) {
+                checksum += sumWords(file->getVertices(), file->getVertexBytes());
+                checksum += sumWords(file->getIndices(), file->getIndexCount() * sizeof(GLuint));
+            }
+        });
+        record("loadMeshFile", detail, 1, getSimdLevel(), vertices, bytes, cached);
+
+        // reordering the triangles of the OBJ, which the mesh file saves on later loads
+        std::vector<GLuint> ordered;
+        Measurement order = measure(timing, [&]() { ordered = triangles; },
+                                    [&]() { orderTriangles(ordered, mesh.vertices); });
+        record("orderTriangles", detail, 1, getSimdLevel(), vertices, double(triangles.size() * sizeof(GLuint)), order);
+    }
+
+    QFile::remove(generatedObj);
+    QFile::remove(generatedMesh);
+
+    if (parser.isSet(objOption)) {
+        QString path = parser.value(objOption);
+        Model model(path);
+
+        double vertices = std::max(1, model.getVertices_indexed().size());
+        double bytes = double(QFileInfo(path).size());
+
+        for (unsigned threads : threadCounts) {
+            ThreadPool::setGlobalThreadCount(threads);
+
+            Measurement load = measure(timing, []() {}, [&]() { Model model(path); });
+            record("loadObjFile", 0, threads, getSimdLevel(), vertices, bytes, load);
+        }
+    }
+
+    QJsonObject report;
+    report["benchmark"] = "terrain-generation";
+    report["hardwareThreads"] = static_cast<int>(std::thread::hardware_concurrency());
+    report["detectedSimd"] = getSimdLevelName(detected);
+    report["results"] = results;
+
+    QByteArray json = QJsonDocument(report).toJson();
+
+    if (parser.isSet(outputOption)) {
+        QFile output(parser.value(outputOption));
+        if (!output.open(QIODevice::WriteOnly) || output.write(json) != json.size()) {
+            std::fprintf(stderr, "Can't write %s\n", qPrintable(parser.value(outputOption)));
+            return 1;
+        }
+    } else {
+        std::fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    }
+
+    if (!parser.isSet(baselineOption)) {
+        return 0;
+    }
+
+    // compare the median times of the results both runs have
+    QFile baselineFile(parser.value(baselineOption));
+    if (!baselineFile.open(QIODevice::ReadOnly)) {
+        std::fprintf(stderr, "Can't read %s\n", qPrintable(parser.value(baselineOption)));
+        return 1;
+    }
+
+    QJsonArray baselineResults = QJsonDocument::fromJson(baselineFile.readAll()).object()["results"].toArray();
+    double tolerance = parser.value(toleranceOption).toDouble();
+    unsigned regressions = 0;
+
+    for (const QJsonValue& value : results) {
+        QJsonObject result = value.toObject();
+
+        for (const QJsonValue& baselineValue : baselineResults) {
+            QJsonObject baseline = baselineValue.toObject();
+            if (resultKey(baseline) != resultKey(result)) {
+                continue;
+            }
+
+            double ratio = result["medianNs"].toDouble() / baseline["medianNs"].toDouble();
+            bool regressed = ratio > 1.0 + tolerance;
+            regressions += regressed ? 1 : 0;
+
+            std::fprintf(stderr, "%-50s %6.2fx %s\n", qPrintable(resultKey(result)), 1.0 / ratio,
+                         regressed ? "REGRESSION" : "");
+            break;
+        }
+    }
+
+    std::fprintf(stderr, "%u regressions\n", regressions);
+    return regressions > 0 ? 2 : 0;
+}
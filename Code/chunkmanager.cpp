@@ -0,0 +1,182 @@
+#include "chunkmanager.h"
+
+#include <algorithm>
+#include <cmath>
+
+ChunkManager::ChunkManager(const ChunkSettings& settings, const std::vector<MaterialPtr>& materials) :
+        settings(settings), materials(materials),
+        heightfields(settings.heightfieldCacheSize),
+        // the visible chunks must always fit in the mesh cache
+        meshes(std::max(settings.meshCacheSize, static_cast<size_t>((2 * settings.viewRadius + 1) * (2 * settings.viewRadius + 1) + 1))),
+        stopping(false), center({0, 0}), hasActiveJob(false), activeJob({0, 0}) {
+
+    worker = std::thread(&ChunkManager::workerLoop, this);
+}
+
+ChunkManager::~ChunkManager() {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+    }
+
+    jobAvailable.notify_all();
+    worker.join();
+}
+
+void ChunkManager::update(const QVector3D& cameraTarget) {
+    ChunkCoordinate centerChunk = chunkAt(cameraTarget);
+    int radius = settings.viewRadius;
+
+    auto isNeeded = [&centerChunk, radius](const ChunkCoordinate& c) -> bool {
+        return std::abs(c.x - centerChunk.x) <= radius && std::abs(c.z - centerChunk.z) <= radius;
+    };
+
+    // take a limited number of finished chunks
+    std::vector<ChunkResult> finished;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+
+        while (!results.empty() && finished.size() < settings.uploadsPerFrame) {
+            finished.push_back(std::move(results.front()));
+            results.pop_front();
+        }
+    }
+
+    // Mark the visible meshes as used before inserting new ones, so the
+    // cache evicts meshes that are out of view first.
+    visibleChunks.clear();
+    std::vector<ChunkCoordinate> missing;
+
+    for (int x = centerChunk.x - radius; x <= centerChunk.x + radius; x++) {
+        for (int z = centerChunk.z - radius; z <= centerChunk.z + radius; z++) {
+            ObjectPtr *chunk = meshes.find({x, z});
+
+            if (chunk != nullptr) {
+                visibleChunks.push_back(*chunk);
+            } else {
+                missing.push_back({x, z});
+            }
+        }
+    }
+
+    // upload the finished chunks that are still in view
+    for (auto& result : finished) {
+        heightfields.insert(result.coordinate, result.grid);
+
+        if (isNeeded(result.coordinate)) {
+            ObjectPtr chunk = createChunkObject(result.coordinate, *result.mesh);
+            meshes.insert(result.coordinate, chunk);
+            visibleChunks.push_back(chunk);
+
+            missing.erase(std::remove(missing.begin(), missing.end(), result.coordinate), missing.end());
+        }
+    }
+
+    // replace the job list with the chunks that are still missing
+    std::lock_guard<std::mutex> guard(mutex);
+
+    jobs.clear();
+    for (const auto& coordinate : missing) {
+        bool pending = hasActiveJob && activeJob == coordinate;
+        for (const auto& result : results) {
+            pending = pending || result.coordinate == coordinate;
+        }
+
+        if (pending) {
+            continue;
+        }
+
+        // chunks with a cached heightfield only need their mesh rebuilt
+        NoiseGridPtr *grid = heightfields.find(coordinate);
+        jobs.push_back({coordinate, grid != nullptr ? *grid : nullptr});
+    }
+
+    center = centerChunk;
+    jobAvailable.notify_all();
+}
+
+void ChunkManager::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+        if (stopping) {
+            return;
+        }
+
+        // generate the chunk closest to the camera first
+        auto distance = [this](const ChunkJob& job) -> int64_t {
+            int64_t dx = job.coordinate.x - center.x;
+            int64_t dz = job.coordinate.z - center.z;
+            return dx * dx + dz * dz;
+        };
+
+        auto closest = std::min_element(jobs.begin(), jobs.end(), [&distance](const ChunkJob& a, const ChunkJob& b) {
+            return distance(a) < distance(b);
+        });
+
+        ChunkJob job = *closest;
+        jobs.erase(closest);
+
+        hasActiveJob = true;
+        activeJob = job.coordinate;
+
+        lock.unlock();
+        ChunkResult result = generate(job);
+        lock.lock();
+
+        hasActiveJob = false;
+        results.push_back(std::move(result));
+    }
+}
+
+ChunkManager::ChunkResult ChunkManager::generate(const ChunkJob& job) const {
+    ChunkResult result;
+    result.coordinate = job.coordinate;
+    result.grid = job.grid;
+
+    if (!result.grid) {
+        std::shared_ptr<NoiseGrid> grid(new NoiseGrid(settings.detail, job.coordinate.x, job.coordinate.z));
+
+        // the coarsest octave has one lattice quad per chunk
+        grid->addOctaves(settings.detail, 1.0f, 0, settings.seed);
+
+        GridPlacement placement = grid->getPlacement();
+        placement.heightScale = settings.heightScale;
+        placement.heightOffset = settings.heightOffset;
+        grid->setPlacement(placement);
+
+        result.grid = grid;
+    }
+
+    // the normals are uploaded too, since the shader can't see the neighbouring chunks
+    result.mesh.reset(new MeshData(settings.heightmap ?
+            result.grid->createHeightmapData(true) : result.grid->createMeshData()));
+    result.mesh->compress();
+
+    return result;
+}
+
+ChunkCoordinate ChunkManager::chunkAt(const QVector3D& position) const {
+    float chunkSize = static_cast<float>(1 << settings.detail);
+
+    return {
+        static_cast<int32_t>(std::floor(position.x() / chunkSize)),
+        static_cast<int32_t>(std::floor(position.z() / chunkSize))
+    };
+}
+
+ObjectPtr ChunkManager::createChunkObject(const ChunkCoordinate& coordinate, const MeshData& mesh) const {
+    ModelDataPtr model(new ModelData(mesh));
+
+    // the grid vertices are centered around the middle of the chunk
+    float chunkSize = static_cast<float>(1 << settings.detail);
+    float halfSize = (chunkSize + 1) / 2.0f;
+
+    ObjectPtr chunk(new Object(model, materials));
+    chunk->setScale({1, settings.heightScale, 1});
+    chunk->setTranslation({coordinate.x * chunkSize + halfSize, settings.heightOffset, coordinate.z * chunkSize + halfSize});
+
+    return chunk;
+}
@@ -0,0 +1,130 @@
+#ifndef CHUNKMANAGER_H
+#define CHUNKMANAGER_H
+
+#include "object.h"
+#include "noisegrid.h"
+#include "lrucache.h"
+
+#include <QVector3D>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * The coordinate of a chunk in the unbounded chunk grid
+ */
+struct ChunkCoordinate {
+    int32_t x, z;
+
+    inline bool operator==(const ChunkCoordinate& other) const { return x == other.x && z == other.z; }
+    inline bool operator!=(const ChunkCoordinate& other) const { return !(*this == other); }
+};
+
+struct ChunkCoordinateHash {
+    inline size_t operator()(const ChunkCoordinate& c) const {
+        return std::hash<uint64_t>()((static_cast<uint64_t>(static_cast<uint32_t>(c.x)) << 32) | static_cast<uint32_t>(c.z));
+    }
+};
+
+struct ChunkSettings {
+    // chunks are 2^detail quads wide
+    unsigned detail = 7;
+    uint64_t seed = 0;
+
+    // chunks within this many chunks of the camera are drawn
+    int viewRadius = 3;
+
+    // bounds on the number of cached CPU heightfields and GPU meshes
+    size_t heightfieldCacheSize = 256;
+    size_t meshCacheSize = 96;
+
+    // the number of meshes uploaded per frame, to avoid stalls
+    unsigned uploadsPerFrame = 4;
+
+    // upload height and normal textures instead of vertex buffers
+    bool heightmap = false;
+
+    // transformation applied to all chunks
+    float heightScale = 8.5f;
+    float heightOffset = -8.0f;
+};
+
+/**
+ * @brief The ChunkManager class
+ *
+ * Streams an unbounded terrain made of seamless NoiseGrid tiles around
+ * the camera. Missing chunks are generated on a background thread,
+ * closest to the camera first. Heightfields and uploaded meshes are
+ * kept in separate LRU caches, so RAM and VRAM use stay bounded no
+ * matter how far the camera travels.
+ *
+ * update() and the destructor must be called on the GL thread.
+ */
+class ChunkManager {
+
+public:
+    ChunkManager(const ChunkSettings& settings, const std::vector<MaterialPtr>& materials);
+    ~ChunkManager();
+
+    ChunkManager(const ChunkManager&) = delete;
+    ChunkManager& operator=(const ChunkManager&) = delete;
+
+    /**
+     * @brief update
+     *
+     * Uploads finished chunks, schedules missing ones and updates the
+     * set of visible chunks for a camera looking at the given point
+     */
+    void update(const QVector3D& cameraTarget);
+
+    inline const std::vector<ObjectPtr>& getVisibleChunks() const { return visibleChunks; }
+
+private:
+    typedef std::shared_ptr<const NoiseGrid> NoiseGridPtr;
+
+    // a chunk to generate; if the heightfield is cached, only the mesh is built
+    struct ChunkJob {
+        ChunkCoordinate coordinate;
+        NoiseGridPtr grid;
+    };
+
+    struct ChunkResult {
+        ChunkCoordinate coordinate;
+        NoiseGridPtr grid;
+        std::unique_ptr<MeshData> mesh;
+    };
+
+    void workerLoop();
+    ChunkResult generate(const ChunkJob& job) const;
+
+    ChunkCoordinate chunkAt(const QVector3D& position) const;
+    ObjectPtr createChunkObject(const ChunkCoordinate& coordinate, const MeshData& mesh) const;
+
+    ChunkSettings settings;
+    std::vector<MaterialPtr> materials;
+
+    // only used on the GL thread
+    LruCache<ChunkCoordinate, NoiseGridPtr, ChunkCoordinateHash> heightfields;
+    LruCache<ChunkCoordinate, ObjectPtr, ChunkCoordinateHash> meshes;
+    std::vector<ObjectPtr> visibleChunks;
+
+    // shared with the worker thread
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    bool stopping;
+
+    std::vector<ChunkJob> jobs;
+    ChunkCoordinate center;
+    bool hasActiveJob;
+    ChunkCoordinate activeJob;
+    std::deque<ChunkResult> results;
+
+};
+
+#endif // CHUNKMANAGER_H
@@ -0,0 +1,54 @@
+#include "frustum.h"
+
+#include <cmath>
+
+BoundingBox BoundingBox::transformed(const QMatrix4x4& matrix) const {
+    QVector3D center = (min + max) / 2;
+    QVector3D extent = (max - min) / 2;
+
+    // every axis of the box adds the absolute value of its image to the extent
+    QVector3D newCenter;
+    QVector3D newExtent;
+
+    for (int i = 0; i < 3; i++) {
+        newCenter[i] = matrix(i, 3);
+        for (int j = 0; j < 3; j++) {
+            newCenter[i] += matrix(i, j) * center[j];
+            newExtent[i] += std::fabs(matrix(i, j)) * extent[j];
+        }
+    }
+
+    return { newCenter - newExtent, newCenter + newExtent };
+}
+
+Frustum::Frustum(const QMatrix4x4& viewProjection) {
+    // a point is inside when -w <= x, y, z <= w in clip space, which gives
+    // a plane per side in terms of the rows of the matrix
+    QVector4D w = viewProjection.row(3);
+
+    for (int i = 0; i < 3; i++) {
+        QVector4D row = viewProjection.row(i);
+        planes.push_back(w + row);
+        planes.push_back(w - row);
+    }
+}
+
+void Frustum::addPlane(const QVector4D& plane) {
+    planes.push_back(plane);
+}
+
+bool Frustum::intersects(const BoundingBox& box) const {
+    for (const QVector4D& plane : planes) {
+        // the corner furthest along the plane normal
+        QVector4D corner(plane.x() >= 0 ? box.max.x() : box.min.x(),
+                         plane.y() >= 0 ? box.max.y() : box.min.y(),
+                         plane.z() >= 0 ? box.max.z() : box.min.z(),
+                         1.0f);
+
+        if (QVector4D::dotProduct(plane, corner) < 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
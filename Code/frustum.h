@@ -0,0 +1,58 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+
+#include <vector>
+
+/**
+ * An axis aligned bounding box
+ */
+struct BoundingBox {
+    QVector3D min;
+    QVector3D max;
+
+    /**
+     * @brief transformed
+     *
+     * The axis aligned box around this box after an affine transformation
+     */
+    BoundingBox transformed(const QMatrix4x4& matrix) const;
+};
+
+/**
+ * @brief The Frustum class
+ *
+ * The planes bounding what a camera sees, to skip drawing objects outside
+ * of it. Extra planes, like the water clip plane of a pass, can be added
+ * to cut it further.
+ *
+ * The tests are conservative: a box that intersects no plane but still
+ * misses the frustum near one of its corners counts as visible.
+ */
+class Frustum {
+
+public:
+    /**
+     * @param viewProjection the projection matrix times the view matrix
+     */
+    explicit Frustum(const QMatrix4x4& viewProjection);
+
+    /**
+     * @brief addPlane
+     *
+     * Adds a plane (a, b, c, d) in world space, of which the points with
+     * a x + b y + c z + d >= 0 are kept, like gl_ClipDistance
+     */
+    void addPlane(const QVector4D& plane);
+
+    bool intersects(const BoundingBox& box) const;
+
+private:
+    std::vector<QVector4D> planes;
+
+};
+
+#endif // FRUSTUM_H
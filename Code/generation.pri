@@ -0,0 +1,48 @@
+# The terrain generation code. None of it uses OpenGL, so it is shared
+# between the viewer and the headless command line generator.
+
+SOURCES += \
+    $$PWD/heightfield.cpp \
+    $$PWD/simd.cpp \
+    $$PWD/upsample.cpp \
+    $$PWD/normals.cpp \
+    $$PWD/noisegrid.cpp \
+    $$PWD/meshdata.cpp \
+    $$PWD/vertexformat.cpp \
+    $$PWD/meshfile.cpp \
+    $$PWD/triangleorder.cpp \
+    $$PWD/frustum.cpp \
+    $$PWD/gridsampling.cpp \
+    $$PWD/heightpyramid.cpp \
+    $$PWD/terrainfile.cpp \
+    $$PWD/terrainpipeline.cpp \
+    $$PWD/streamedterrain.cpp \
+    $$PWD/heightfieldraycaster.cpp \
+    $$PWD/generationcontext.cpp \
+    $$PWD/arena.cpp \
+    $$PWD/threadpool.cpp
+
+HEADERS += \
+    $$PWD/heightfield.h \
+    $$PWD/simd.h \
+    $$PWD/upsample.h \
+    $$PWD/normals.h \
+    $$PWD/noisegrid.h \
+    $$PWD/noisehash.h \
+    $$PWD/meshdata.h \
+    $$PWD/vertex.h \
+    $$PWD/vertexformat.h \
+    $$PWD/meshfile.h \
+    $$PWD/triangleorder.h \
+    $$PWD/frustum.h \
+    $$PWD/gridsampling.h \
+    $$PWD/heightpyramid.h \
+    $$PWD/terrainfile.h \
+    $$PWD/terrainpipeline.h \
+    $$PWD/streamedterrain.h \
+    $$PWD/heightfieldraycaster.h \
+    $$PWD/generationcontext.h \
+    $$PWD/arena.h \
+    $$PWD/threadpool.h
+
+INCLUDEPATH += $$PWD
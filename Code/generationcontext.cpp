@@ -0,0 +1,108 @@
+#include "generationcontext.h"
+
+#include <algorithm>
+#include <atomic>
+
+GenerationContext::GenerationContext() {
+}
+
+bool GenerationContext::generate(const TerrainParameters& parameters, GeneratedTerrain& terrain,
+                                 const std::function<bool()>& cancelled) {
+    TerrainBuffers& buffers = acquire(parameters.detail);
+    NoiseGrid& grid = *buffers.grid;
+
+    // the finest octave always has a lattice of half the grid size, so
+    // larger grids get more detail instead of just more vertices
+    unsigned octaves = parameters.detail > 4 ? parameters.detail - 4 : 1;
+
+    // the spike and the octaves are added in a single pass over the grid
+    grid.add(sumStages(SpikeStage(-2, 1, 3), OctavesStage(octaves, 1.0f, 4, parameters.seed)));
+
+    // the job is checked once, after the fused grid pass, so a new request
+    // doesn't have to wait for the mesh of an outdated terrain
+    if (cancelled()) {
+        return false;
+    }
+
+    GridPlacement placement = grid.getPlacement();
+    placement.heightScale = parameters.heightScale;
+    placement.heightOffset = parameters.heightOffset;
+    grid.setPlacement(placement);
+
+    if (parameters.lodPatchQuads != 0) {
+        if (buffers.bounds == nullptr) {
+            buffers.bounds.reset(new HeightPyramid(grid.getHeights(), parameters.lodPatchQuads));
+        } else {
+            buffers.bounds->build(grid.getHeights(), parameters.lodPatchQuads);
+        }
+
+        terrain.bounds = buffers.bounds;
+    } else {
+        if (buffers.mesh == nullptr) {
+            buffers.mesh.reset(new MeshData());
+        }
+
+        if (parameters.heightmap) {
+            grid.createHeightmapData(*buffers.mesh, false);
+        } else {
+            grid.createMeshData(*buffers.mesh);
+        }
+
+        buffers.mesh->compress();
+        terrain.mesh = buffers.mesh;
+    }
+
+    if (buffers.rayCaster == nullptr) {
+        buffers.rayCaster.reset(new HeightfieldRayCaster(buffers.grid));
+    } else {
+        buffers.rayCaster->setGrid(buffers.grid);
+    }
+
+    terrain.rayCaster = buffers.rayCaster;
+    terrain.grid = buffers.grid;
+
+    return true;
+}
+
+bool GenerationContext::TerrainBuffers::isFree() const {
+    // the ray caster holds the grid as well
+    long gridOwners = rayCaster != nullptr ? 2 : 1;
+
+    bool free = grid.use_count() <= gridOwners && mesh.use_count() <= 1 && bounds.use_count() <= 1 &&
+                rayCaster.use_count() <= 1;
+
+    // the last other owner released the buffers when it dropped its reference,
+    // this makes everything it did with them happen before they are reused or freed
+    if (free) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+
+    return free;
+}
+
+/**
+ * @brief GenerationContext::acquire
+ *
+ * The buffers of a terrain of the same size that nobody holds anymore,
+ * with its grid of 2^detail + 1 vertices reset. Free terrains of other
+ * sizes are dropped, since their vectors would only be oversized or
+ * regrown. Only if no terrain of the size is free, a new one is added.
+ */
+GenerationContext::TerrainBuffers& GenerationContext::acquire(unsigned detail) {
+    unsigned size = (1u << detail) + 1;
+
+    terrains.erase(std::remove_if(terrains.begin(), terrains.end(), [size](const TerrainBuffers& candidate) {
+        return candidate.grid->getSize() != size && candidate.isFree();
+    }), terrains.end());
+
+    for (TerrainBuffers& candidate : terrains) {
+        if (candidate.isFree()) {
+            candidate.grid->reset();
+            return candidate;
+        }
+    }
+
+    terrains.emplace_back();
+    terrains.back().grid.reset(new NoiseGrid(detail));
+    return terrains.back();
+}
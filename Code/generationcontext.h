@@ -0,0 +1,123 @@
+#ifndef GENERATIONCONTEXT_H
+#define GENERATIONCONTEXT_H
+
+#include "noisegrid.h"
+#include "meshdata.h"
+#include "heightpyramid.h"
+#include "heightfieldraycaster.h"
+#include "terrainfile.h"
+
+#include <QString>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * The parameters a terrain is generated from
+ */
+struct TerrainParameters {
+    unsigned detail;
+    uint64_t seed;
+
+    // only build the height texture data, see NoiseGrid::createHeightmapData
+    bool heightmap;
+
+    // 0 builds a mesh. Otherwise, no mesh is built, but the node bounds of
+    // a LodQuadtree with patches of this many quads.
+    unsigned lodPatchQuads;
+
+    // how the terrain is scaled and moved vertically when it is drawn,
+    // so the height queries of the grid give world heights
+    float heightScale;
+    float heightOffset;
+
+    // load the terrain from this terrain file instead of generating it
+    QString loadPath;
+
+    // save generated terrains to this terrain file
+    QString savePath;
+    HeightEncoding saveEncoding;
+};
+
+/**
+ * A finished terrain: the grid itself, and what has to be uploaded
+ */
+struct GeneratedTerrain {
+    std::shared_ptr<const NoiseGrid> grid;
+
+    // the mesh, or the node bounds for a level of detail terrain
+    std::shared_ptr<const MeshData> mesh;
+    HeightPyramidPtr bounds;
+
+    // for picking points on the terrain
+    HeightfieldRayCasterPtr rayCaster;
+
+    // a loaded terrain file, instead of all of the above
+    TerrainFilePtr file;
+};
+
+/**
+ * @brief The GenerationContext class
+ *
+ * Generates terrains in memory it keeps between generations. The grid,
+ * mesh, bounds and ray caster of a terrain are handed out as shared
+ * pointers, and once the context holds the last reference to all of
+ * them, they are reused for the next terrain of the same size. The grid
+ * passes take their rows from the scratch arenas of the pool threads, so
+ * regenerating a terrain of a size that was generated before makes no
+ * heap allocations.
+ *
+ * That costs memory: the context keeps the grid, mesh, bounds and ray
+ * caster of every terrain that was in use at once, at least the one on
+ * screen and the one being generated. A compacted mesh also keeps the
+ * capacity of its full vertices, 44 bytes per vertex on top of the
+ * compact ones, so they don't have to be allocated again. Free terrains
+ * are dropped as soon as a terrain of another size is generated.
+ *
+ * A context must only be used by one thread at a time. The terrains it
+ * hands out can be read and dropped on any thread.
+ */
+class GenerationContext {
+
+public:
+    GenerationContext();
+
+    GenerationContext(const GenerationContext&) = delete;
+    GenerationContext& operator=(const GenerationContext&) = delete;
+
+    /**
+     * @brief generate
+     *
+     * Generates the grid of a terrain, and its mesh or its node bounds,
+     * into terrain. The file paths of the parameters are ignored.
+     *
+     * @param cancelled checked once after the fused grid pass, generation stops there if it returns true
+     * @return false if the generation was cancelled
+     */
+    bool generate(const TerrainParameters& parameters, GeneratedTerrain& terrain,
+                  const std::function<bool()>& cancelled);
+
+    // the terrains the context keeps memory for, the most that were in use at once
+    inline size_t getTerrainCount() const { return terrains.size(); }
+
+private:
+    // the parts of one terrain
+    struct TerrainBuffers {
+        std::shared_ptr<NoiseGrid> grid;
+        std::shared_ptr<MeshData> mesh;
+        std::shared_ptr<HeightPyramid> bounds;
+        std::shared_ptr<HeightfieldRayCaster> rayCaster;
+
+        // whether nobody but the context holds any of the parts anymore
+        bool isFree() const;
+    };
+
+    TerrainBuffers& acquire(unsigned detail);
+
+    std::vector<TerrainBuffers> terrains;
+
+};
+
+#endif // GENERATIONCONTEXT_H
@@ -0,0 +1,264 @@
+#include "gridsampling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SAMPLING_X86
+#include <immintrin.h>
+#endif
+
+// GCC and clang need AVX2 functions to be marked, MSVC always allows the intrinsics
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace {
+
+// what every kernel needs to know about the grid
+struct SampleGrid {
+    const float *data;
+    size_t stride;
+
+    // the largest grid coordinate, and the largest first corner of a quad
+    float last;
+    float lastQuad;
+
+    GridPlacement placement;
+};
+
+// writes the world height and normal of a sample, from its grid height h
+// and slopes dx and dz. Shared by all kernels, for their remainders.
+inline void storeSample(const SampleGrid& grid, size_t i, float h, float dx, float dz, float *heights, float *normals) {
+    if (heights != nullptr) {
+        heights[i] = h * grid.placement.heightScale + grid.placement.heightOffset;
+    }
+
+    if (normals != nullptr) {
+        float nx = -dx * grid.placement.heightScale;
+        float nz = -dz * grid.placement.heightScale;
+        float inverseLength = 1.0f / std::sqrt(nx * nx + nz * nz + 1.0f);
+
+        normals[3 * i + 0] = nx * inverseLength;
+        normals[3 * i + 1] = inverseLength;
+        normals[3 * i + 2] = nz * inverseLength;
+    }
+}
+
+typedef void (*SampleKernel)(const SampleGrid& grid, const float *x, const float *z, size_t begin, size_t end,
+                             float *heights, float *normals);
+
+// --- scalar kernel
+
+void sampleScalar(const SampleGrid& grid, const float *x, const float *z, size_t begin, size_t end,
+                  float *heights, float *normals) {
+    for (size_t i = begin; i < end; i++) {
+        float gx = std::min(std::max(x[i] - grid.placement.offsetX, 0.0f), grid.last);
+        float gz = std::min(std::max(z[i] - grid.placement.offsetZ, 0.0f), grid.last);
+
+        // the quad, which is the last one on the far edges
+        int ix = static_cast<int>(std::min(gx, grid.lastQuad));
+        int iz = static_cast<int>(std::min(gz, grid.lastQuad));
+        float fx = gx - static_cast<float>(ix);
+        float fz = gz - static_cast<float>(iz);
+
+        const float *row0 = grid.data + size_t(ix) * grid.stride + iz;
+        const float *row1 = row0 + grid.stride;
+
+        float dz0 = row0[1] - row0[0];
+        float dz1 = row1[1] - row1[0];
+        float low = row0[0] + dz0 * fz;
+        float high = row1[0] + dz1 * fz;
+
+        float dx = high - low;
+        float dz = dz0 + (dz1 - dz0) * fx;
+        storeSample(grid, i, low + dx * fx, dx, dz, heights, normals);
+    }
+}
+
+#ifdef SAMPLING_X86
+
+// --- SSE2 kernel
+
+void sampleSSE2(const SampleGrid& grid, const float *x, const float *z, size_t begin, size_t end,
+                float *heights, float *normals) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 last = _mm_set1_ps(grid.last);
+    const __m128 lastQuad = _mm_set1_ps(grid.lastQuad);
+    const __m128 offsetX = _mm_set1_ps(grid.placement.offsetX);
+    const __m128 offsetZ = _mm_set1_ps(grid.placement.offsetZ);
+    const __m128 heightScale = _mm_set1_ps(grid.placement.heightScale);
+    const __m128 heightOffset = _mm_set1_ps(grid.placement.heightOffset);
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 gx = _mm_min_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(x + i), offsetX), zero), last);
+        __m128 gz = _mm_min_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(z + i), offsetZ), zero), last);
+
+        // the coordinates are positive, so truncating floors them
+        __m128i ix = _mm_cvttps_epi32(_mm_min_ps(gx, lastQuad));
+        __m128i iz = _mm_cvttps_epi32(_mm_min_ps(gz, lastQuad));
+        __m128 fx = _mm_sub_ps(gx, _mm_cvtepi32_ps(ix));
+        __m128 fz = _mm_sub_ps(gz, _mm_cvtepi32_ps(iz));
+
+        // SSE2 can't gather, so the corners are loaded one lane at a time
+        alignas(16) int xs[4];
+        alignas(16) int zs[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(xs), ix);
+        _mm_store_si128(reinterpret_cast<__m128i *>(zs), iz);
+
+        alignas(16) float corners[4][4];
+        for (int lane = 0; lane < 4; lane++) {
+            const float *row0 = grid.data + size_t(xs[lane]) * grid.stride + zs[lane];
+            const float *row1 = row0 + grid.stride;
+
+            corners[0][lane] = row0[0];
+            corners[1][lane] = row0[1];
+            corners[2][lane] = row1[0];
+            corners[3][lane] = row1[1];
+        }
+
+        __m128 h00 = _mm_load_ps(corners[0]);
+        __m128 h01 = _mm_load_ps(corners[1]);
+        __m128 h10 = _mm_load_ps(corners[2]);
+        __m128 h11 = _mm_load_ps(corners[3]);
+
+        __m128 dz0 = _mm_sub_ps(h01, h00);
+        __m128 dz1 = _mm_sub_ps(h11, h10);
+        __m128 low = _mm_add_ps(h00, _mm_mul_ps(dz0, fz));
+        __m128 high = _mm_add_ps(h10, _mm_mul_ps(dz1, fz));
+
+        __m128 dx = _mm_sub_ps(high, low);
+        __m128 dz = _mm_add_ps(dz0, _mm_mul_ps(_mm_sub_ps(dz1, dz0), fx));
+
+        if (heights != nullptr) {
+            __m128 h = _mm_add_ps(low, _mm_mul_ps(dx, fx));
+            _mm_storeu_ps(heights + i, _mm_add_ps(_mm_mul_ps(h, heightScale), heightOffset));
+        }
+
+        if (normals != nullptr) {
+            __m128 nx = _mm_mul_ps(_mm_xor_ps(dx, signBit), heightScale);
+            __m128 nz = _mm_mul_ps(_mm_xor_ps(dz, signBit), heightScale);
+            __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(nz, nz)), one);
+            __m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+
+            alignas(16) float components[3][4];
+            _mm_store_ps(components[0], _mm_mul_ps(nx, inverseLength));
+            _mm_store_ps(components[1], inverseLength);
+            _mm_store_ps(components[2], _mm_mul_ps(nz, inverseLength));
+
+            for (int lane = 0; lane < 4; lane++) {
+                normals[3 * (i + lane) + 0] = components[0][lane];
+                normals[3 * (i + lane) + 1] = components[1][lane];
+                normals[3 * (i + lane) + 2] = components[2][lane];
+            }
+        }
+    }
+
+    sampleScalar(grid, x, z, i, end, heights, normals);
+}
+
+// --- AVX2 kernel
+
+TARGET_AVX2 void sampleAVX2(const SampleGrid& grid, const float *x, const float *z, size_t begin, size_t end,
+                            float *heights, float *normals) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 last = _mm256_set1_ps(grid.last);
+    const __m256 lastQuad = _mm256_set1_ps(grid.lastQuad);
+    const __m256 offsetX = _mm256_set1_ps(grid.placement.offsetX);
+    const __m256 offsetZ = _mm256_set1_ps(grid.placement.offsetZ);
+    const __m256 heightScale = _mm256_set1_ps(grid.placement.heightScale);
+    const __m256 heightOffset = _mm256_set1_ps(grid.placement.heightOffset);
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+    const __m256i stride = _mm256_set1_epi32(static_cast<int>(grid.stride));
+    const __m256i next = _mm256_set1_epi32(1);
+
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 gx = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(x + i), offsetX), zero), last);
+        __m256 gz = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(z + i), offsetZ), zero), last);
+
+        __m256i ix = _mm256_cvttps_epi32(_mm256_min_ps(gx, lastQuad));
+        __m256i iz = _mm256_cvttps_epi32(_mm256_min_ps(gz, lastQuad));
+        __m256 fx = _mm256_sub_ps(gx, _mm256_cvtepi32_ps(ix));
+        __m256 fz = _mm256_sub_ps(gz, _mm256_cvtepi32_ps(iz));
+
+        // the grids are small enough for 32-bit offsets
+        __m256i index00 = _mm256_add_epi32(_mm256_mullo_epi32(ix, stride), iz);
+        __m256i index10 = _mm256_add_epi32(index00, stride);
+
+        __m256 h00 = _mm256_i32gather_ps(grid.data, index00, 4);
+        __m256 h01 = _mm256_i32gather_ps(grid.data, _mm256_add_epi32(index00, next), 4);
+        __m256 h10 = _mm256_i32gather_ps(grid.data, index10, 4);
+        __m256 h11 = _mm256_i32gather_ps(grid.data, _mm256_add_epi32(index10, next), 4);
+
+        __m256 dz0 = _mm256_sub_ps(h01, h00);
+        __m256 dz1 = _mm256_sub_ps(h11, h10);
+        __m256 low = _mm256_add_ps(h00, _mm256_mul_ps(dz0, fz));
+        __m256 high = _mm256_add_ps(h10, _mm256_mul_ps(dz1, fz));
+
+        __m256 dx = _mm256_sub_ps(high, low);
+        __m256 dz = _mm256_add_ps(dz0, _mm256_mul_ps(_mm256_sub_ps(dz1, dz0), fx));
+
+        if (heights != nullptr) {
+            __m256 h = _mm256_add_ps(low, _mm256_mul_ps(dx, fx));
+            _mm256_storeu_ps(heights + i, _mm256_add_ps(_mm256_mul_ps(h, heightScale), heightOffset));
+        }
+
+        if (normals != nullptr) {
+            __m256 nx = _mm256_mul_ps(_mm256_xor_ps(dx, signBit), heightScale);
+            __m256 nz = _mm256_mul_ps(_mm256_xor_ps(dz, signBit), heightScale);
+            __m256 lengthSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(nz, nz)), one);
+            __m256 inverseLength = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSquared));
+
+            alignas(32) float components[3][8];
+            _mm256_store_ps(components[0], _mm256_mul_ps(nx, inverseLength));
+            _mm256_store_ps(components[1], inverseLength);
+            _mm256_store_ps(components[2], _mm256_mul_ps(nz, inverseLength));
+
+            for (int lane = 0; lane < 8; lane++) {
+                normals[3 * (i + lane) + 0] = components[0][lane];
+                normals[3 * (i + lane) + 1] = components[1][lane];
+                normals[3 * (i + lane) + 2] = components[2][lane];
+            }
+        }
+    }
+
+    sampleScalar(grid, x, z, i, end, heights, normals);
+}
+
+#endif // SAMPLING_X86
+
+SampleKernel getKernel(SimdLevel level) {
+#ifdef SAMPLING_X86
+    switch (level) {
+    case SimdLevel::AVX2: return sampleAVX2;
+    case SimdLevel::SSE2: return sampleSSE2;
+    default:              break;
+    }
+#else
+    (void) level;
+#endif
+
+    return sampleScalar;
+}
+
+} // namespace
+
+void sampleGridBilinear(const Heightfield& grid, const GridPlacement& placement,
+                        const float *x, const float *z, size_t count, float *heights, float *normals,
+                        SimdLevel level) {
+    SampleGrid sampleGrid;
+    sampleGrid.data = grid.row(0);
+    sampleGrid.stride = grid.getStride();
+    sampleGrid.last = static_cast<float>(grid.getRows() - 1);
+    sampleGrid.lastQuad = static_cast<float>(grid.getRows() - 2);
+    sampleGrid.placement = placement;
+
+    getKernel(level)(sampleGrid, x, z, 0, count, heights, normals);
+}
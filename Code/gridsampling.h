@@ -0,0 +1,57 @@
+#ifndef GRIDSAMPLING_H
+#define GRIDSAMPLING_H
+
+#include "heightfield.h"
+#include "simd.h"
+
+#include <cstddef>
+
+/**
+ * Where a grid lies in the world: grid point (x, z) with height h is drawn
+ * at (x + offsetX, h * heightScale + heightOffset, z + offsetZ)
+ */
+struct GridPlacement {
+    float offsetX = 0;
+    float offsetZ = 0;
+    float heightScale = 1;
+    float heightOffset = 0;
+};
+
+/**
+ * How a grid is sampled between its points
+ */
+enum class GridSampling {
+    // interpolating the four surrounding grid points, like the level of
+    // detail terrain samples its height texture
+    Bilinear,
+
+    // evaluating the noise the grid was generated from, which gives the
+    // grid values exactly on the grid points
+    Smooth
+};
+
+/**
+ * @brief sampleGridBilinear
+ *
+ * Samples a heightfield at world positions, interpolating the four
+ * surrounding grid points bilinearly. Positions outside of the grid are
+ * clamped to its edges. The normals are those of the interpolated surface,
+ * in world space.
+ *
+ * The positions are processed a register at a time, and all SIMD levels
+ * produce bit-identical results.
+ *
+ * @param grid the heights
+ * @param placement where the grid lies in the world
+ * @param x the world x of every position
+ * @param z the world z of every position
+ * @param count the number of positions
+ * @param heights count world heights, or nullptr
+ * @param normals count world normals of three floats each, or nullptr
+ * @param level the instruction set to use
+ */
+void sampleGridBilinear(const Heightfield& grid, const GridPlacement& placement,
+                        const float *x, const float *z, size_t count, float *heights, float *normals,
+                        SimdLevel level = getSimdLevel());
+
+#endif // GRIDSAMPLING_H
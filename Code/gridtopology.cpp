@@ -0,0 +1,155 @@
+#include "gridtopology.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <vector>
+
+/**
+ * @brief createStripIndices
+ *
+ * Per block, one strip per pair of columns z and z + 1, zigzagging along
+ * x. The first triangle of every quad is (x, z), (x, z + 1), (x + 1, z)
+ * and the second (x + 1, z), (x, z + 1), (x + 1, z + 1), as with
+ * GL_TRIANGLES. The blocks follow each other row-major, separated by a
+ * restart like the strips, and ranges receives where each block starts
+ * and how many indices it has.
+ */
+template<typename Index>
+static std::vector<Index> createStripIndices(unsigned size, unsigned blockQuads, Index restartIndex,
+                                             std::vector< std::pair<GLsizei, GLsizei> >& ranges) {
+    std::vector<Index> indices;
+    // every column of a block has two indices per row and a restart
+    unsigned blocks = (size - 2) / blockQuads + 1;
+    indices.reserve(size_t(size - 1) * (2 * (size - 1) + 3 * blocks));
+
+    for (unsigned blockX = 0; blockX + 1 < size; blockX += blockQuads) {
+        for (unsigned blockZ = 0; blockZ + 1 < size; blockZ += blockQuads) {
+            unsigned endX = std::min(blockX + blockQuads, size - 1);
+            unsigned endZ = std::min(blockZ + blockQuads, size - 1);
+
+            if (!indices.empty()) {
+                indices.push_back(restartIndex);
+            }
+
+            GLsizei first = static_cast<GLsizei>(indices.size());
+
+            for (unsigned z = blockZ; z < endZ; z++) {
+                if (z > blockZ) {
+                    indices.push_back(restartIndex);
+                }
+
+                for (unsigned x = blockX; x <= endX; x++) {
+                    indices.push_back(static_cast<Index>(x * size + z));
+                    indices.push_back(static_cast<Index>(x * size + z + 1));
+                }
+            }
+
+            ranges.emplace_back(first, static_cast<GLsizei>(indices.size()) - first);
+        }
+    }
+
+    return indices;
+}
+
+GridTopology::GridTopology(unsigned size) :
+        size(size), blockQuads(getBlockQuads(size)), blocks((size - 2) / blockQuads + 1) {
+    initializeOpenGLFunctions();
+
+    glGenBuffers(1, &eab);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eab);
+
+    // the largest index is reserved for restarting the strip
+    if (size_t(size) * size <= std::numeric_limits<GLushort>::max()) {
+        std::vector<GLushort> indices = createStripIndices<GLushort>(size, blockQuads, std::numeric_limits<GLushort>::max(), blockRanges);
+
+        indexType = GL_UNSIGNED_SHORT;
+        restartIndex = std::numeric_limits<GLushort>::max();
+        indexCount = static_cast<GLsizei>(indices.size());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices.size() * sizeof(GLushort)), indices.data(), GL_STATIC_DRAW);
+    } else {
+        std::vector<GLuint> indices = createStripIndices<GLuint>(size, blockQuads, std::numeric_limits<GLuint>::max(), blockRanges);
+
+        indexType = GL_UNSIGNED_INT;
+        restartIndex = std::numeric_limits<GLuint>::max();
+        indexCount = static_cast<GLsizei>(indices.size());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices.size() * sizeof(GLuint)), indices.data(), GL_STATIC_DRAW);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    qDebug() << ":: Uploaded grid topology of size" << size << "with" << indexCount << "indices";
+}
+
+GridTopology::~GridTopology() {
+    glDeleteBuffers(1, &eab);
+}
+
+bool GridTopology::fits(unsigned size) {
+    if (size < 2) {
+        return false;
+    }
+
+    // as reserved by createStripIndices, which is at least the actual count
+    uint64_t blocks = (size - 2) / getBlockQuads(size) + 1;
+    uint64_t indices = uint64_t(size - 1) * (2 * uint64_t(size - 1) + 3 * blocks);
+    return indices <= uint64_t(std::numeric_limits<GLsizei>::max());
+}
+
+std::shared_ptr<GridTopology> GridTopology::get(unsigned size) {
+    // Only weak references are cached, so the buffer is deleted together
+    // with the last grid using it, while the context is still current.
+    static std::map<unsigned, std::weak_ptr<GridTopology>> topologies;
+
+    std::shared_ptr<GridTopology> topology = topologies[size].lock();
+    if (!topology) {
+        topology.reset(new GridTopology(size));
+        topologies[size] = topology;
+    }
+
+    return topology;
+}
+
+void GridTopology::bind() {
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eab);
+}
+
+void GridTopology::draw() {
+    glEnable(GL_PRIMITIVE_RESTART);
+    glPrimitiveRestartIndex(restartIndex);
+
+    glDrawElements(GL_TRIANGLE_STRIP, indexCount, indexType, (GLvoid *) 0);
+
+    glDisable(GL_PRIMITIVE_RESTART);
+}
+
+void GridTopology::draw(const std::vector<bool>& visibleBlocks) {
+    glEnable(GL_PRIMITIVE_RESTART);
+    glPrimitiveRestartIndex(restartIndex);
+
+    GLsizei indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    // consecutive visible blocks are drawn together, the restarts between
+    // them keep their strips apart
+    for (size_t block = 0; block < blockRanges.size(); block++) {
+        if (!visibleBlocks[block]) {
+            continue;
+        }
+
+        size_t last = block;
+        while (last + 1 < blockRanges.size() && visibleBlocks[last + 1]) {
+            last++;
+        }
+
+        GLsizei first = blockRanges[block].first;
+        GLsizei count = blockRanges[last].first + blockRanges[last].second - first;
+        glDrawElements(GL_TRIANGLE_STRIP, count, indexType, (GLvoid *) (size_t(first) * indexSize));
+
+        block = last;
+    }
+
+    glDisable(GL_PRIMITIVE_RESTART);
+}
@@ -0,0 +1,101 @@
+#ifndef GRIDTOPOLOGY_H
+#define GRIDTOPOLOGY_H
+
+#include <QOpenGLFunctions_3_3_Core>
+
+#include "meshdata.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The GridTopology class
+ *
+ * The index buffer of a regular grid of size by size vertices, stored
+ * row-major like NoiseGrid. The quads are drawn as one triangle strip per
+ * pair of columns, separated by primitive restarts, with the same
+ * triangles and winding as two independent triangles per quad.
+ *
+ * The topology only depends on the size of the grid, so all grids of the
+ * same size share one buffer, which is uploaded when the first of them is
+ * created. Grids with fewer than 65535 vertices use 16-bit indices.
+ *
+ * The strips are grouped in square blocks of at most BLOCK_QUADS quads,
+ * so parts of a grid can be drawn on their own, e.g. to skip the blocks
+ * outside the view.
+ *
+ * Must only be used on the GL thread.
+ */
+class GridTopology : protected QOpenGLFunctions_3_3_Core {
+
+public:
+    static constexpr unsigned BLOCK_QUADS = GRID_BLOCK_QUADS;
+
+    // see getGridBlockQuads
+    static inline unsigned getBlockQuads(unsigned size) { return getGridBlockQuads(size); }
+
+    /**
+     * @brief get
+     *
+     * The topology of a size by size grid, uploaded on first use. It is
+     * kept alive for as long as any grid of that size uses it.
+     */
+    static std::shared_ptr<GridTopology> get(unsigned size);
+
+    /**
+     * @brief fits
+     *
+     * Whether the indices of a size by size grid can be counted with a
+     * GLsizei. Larger grids can't be drawn, get must not be called for them.
+     */
+    static bool fits(unsigned size);
+
+    ~GridTopology();
+
+    GridTopology(const GridTopology&) = delete;
+    GridTopology& operator=(const GridTopology&) = delete;
+
+    /**
+     * @brief bind
+     *
+     * Binds the index buffer to the currently bound VAO
+     */
+    void bind();
+    void draw();
+
+    /**
+     * @brief draw
+     *
+     * Draws only the visible blocks, which are numbered row-major
+     */
+    void draw(const std::vector<bool>& visibleBlocks);
+
+    inline unsigned getSize() const { return size; }
+
+    // blocks per side of the grid
+    inline unsigned getBlocks() const { return blocks; }
+
+private:
+    explicit GridTopology(unsigned size);
+
+    unsigned size;
+    unsigned blockQuads;
+    unsigned blocks;
+
+    GLuint eab;
+    GLsizei indexCount;
+
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, with the largest value as restart index
+    GLenum indexType;
+    GLuint restartIndex;
+
+    // the first index and index count of every block
+    std::vector< std::pair<GLsizei, GLsizei> > blockRanges;
+
+};
+
+typedef std::shared_ptr<GridTopology> GridTopologyPtr;
+
+#endif // GRIDTOPOLOGY_H
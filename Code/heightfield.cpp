@@ -0,0 +1,27 @@
+#include "heightfield.h"
+
+#include <algorithm>
+#include <cstdint>
+
+Heightfield::Heightfield(unsigned rows, unsigned columns) : rows(rows), columns(columns) {
+    // round the row length up so every row starts on an aligned address
+    const size_t floatsPerAlignment = ALIGNMENT / sizeof(float);
+    stride = (columns + floatsPerAlignment - 1) / floatsPerAlignment * floatsPerAlignment;
+
+    // over-allocate so the start of the data can be aligned
+    allocation = new float[rows * stride + floatsPerAlignment];
+
+    uintptr_t address = reinterpret_cast<uintptr_t>(allocation);
+    address = (address + ALIGNMENT - 1) & ~static_cast<uintptr_t>(ALIGNMENT - 1);
+    data = reinterpret_cast<float *>(address);
+
+    fill(0);
+}
+
+Heightfield::~Heightfield() {
+    delete[] allocation;
+}
+
+void Heightfield::fill(float value) {
+    std::fill(data, data + rows * stride, value);
+}
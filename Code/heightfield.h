@@ -0,0 +1,47 @@
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include <cstddef>
+
+/**
+ * @brief The Heightfield class
+ *
+ * A row-major grid of heights stored in a single aligned allocation.
+ * Row x starts at data + x * stride, and every row starts on a
+ * ALIGNMENT byte boundary, so rows can be walked with aligned SIMD loads.
+ */
+class Heightfield {
+
+public:
+    static constexpr size_t ALIGNMENT = 64;
+
+    Heightfield(unsigned rows, unsigned columns);
+    ~Heightfield();
+
+    Heightfield(const Heightfield&) = delete;
+    Heightfield& operator=(const Heightfield&) = delete;
+
+    void fill(float value);
+
+    inline unsigned getRows() const { return rows; }
+    inline unsigned getColumns() const { return columns; }
+    inline size_t getStride() const { return stride; }
+
+    inline float *row(unsigned x) { return data + x * stride; }
+    inline const float *row(unsigned x) const { return data + x * stride; }
+
+    inline float& at(unsigned x, unsigned z) { return data[x * stride + z]; }
+    inline float at(unsigned x, unsigned z) const { return data[x * stride + z]; }
+
+private:
+    unsigned rows;
+    unsigned columns;
+    size_t stride;
+
+    // the allocation itself, and the aligned pointer into it
+    float *allocation;
+    float *data;
+
+};
+
+#endif // HEIGHTFIELD_H
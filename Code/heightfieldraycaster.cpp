@@ -0,0 +1,245 @@
+#include "heightfieldraycaster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace {
+
+/**
+ * @brief clipToBox
+ *
+ * Clips the ray interval [start, end] to an axis aligned box with the slab
+ * method. Axes the ray runs parallel to only need the origin in the slab.
+ */
+bool clipToBox(const float *origin, const float *direction, const float *min, const float *max,
+               float& start, float& end) {
+    for (int axis = 0; axis < 3; axis++) {
+        if (direction[axis] == 0) {
+            if (origin[axis] < min[axis] || origin[axis] > max[axis]) {
+                return false;
+            }
+
+            continue;
+        }
+
+        float inverse = 1.0f / direction[axis];
+        float enter = (min[axis] - origin[axis]) * inverse;
+        float leave = (max[axis] - origin[axis]) * inverse;
+
+        if (enter > leave) {
+            std::swap(enter, leave);
+        }
+
+        start = std::max(start, enter);
+        end = std::min(end, leave);
+
+        if (start > end) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief intersectTriangle
+ *
+ * Möller-Trumbore intersection of a ray with triangle (a, b, c)
+ */
+bool intersectTriangle(const float *origin, const float *direction,
+                       const float *a, const float *b, const float *c, float& distance) {
+    float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+
+    float p[3] = {
+        direction[1] * e2[2] - direction[2] * e2[1],
+        direction[2] * e2[0] - direction[0] * e2[2],
+        direction[0] * e2[1] - direction[1] * e2[0]
+    };
+
+    float determinant = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if (determinant == 0) {
+        return false;
+    }
+
+    float inverse = 1.0f / determinant;
+    float s[3] = { origin[0] - a[0], origin[1] - a[1], origin[2] - a[2] };
+
+    float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverse;
+    if (u < 0 || u > 1) {
+        return false;
+    }
+
+    float q[3] = {
+        s[1] * e1[2] - s[2] * e1[1],
+        s[2] * e1[0] - s[0] * e1[2],
+        s[0] * e1[1] - s[1] * e1[0]
+    };
+
+    float v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverse;
+    if (v < 0 || u + v > 1) {
+        return false;
+    }
+
+    distance = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverse;
+    return true;
+}
+
+} // namespace
+
+HeightfieldRayCaster::HeightfieldRayCaster(std::shared_ptr<const NoiseGrid> grid, unsigned leafQuads) :
+        grid(grid), leafQuads(leafQuads), pyramid(grid->getHeights(), std::min(leafQuads, grid->getSize() - 1)) {
+}
+
+void HeightfieldRayCaster::setGrid(std::shared_ptr<const NoiseGrid> grid) {
+    this->grid = std::move(grid);
+    pyramid.build(this->grid->getHeights(), std::min(leafQuads, this->grid->getSize() - 1));
+}
+
+bool HeightfieldRayCaster::intersect(const QVector3D& origin, const QVector3D& direction, float maxDistance,
+                                     RayHit& hit) const {
+    // walk the grid in its own space, where grid point (x, z) lies at
+    // (x, height, z). This mapping is affine, so distances along the ray
+    // stay the same.
+    const GridPlacement& placement = grid->getPlacement();
+
+    float gridOrigin[3] = {
+        origin.x() - placement.offsetX,
+        (origin.y() - placement.heightOffset) / placement.heightScale,
+        origin.z() - placement.offsetZ
+    };
+
+    float gridDirection[3] = {
+        direction.x(),
+        direction.y() / placement.heightScale,
+        direction.z()
+    };
+
+    // the children of a block are visited front to back, so the first hit
+    // found is the nearest one. Only the signs of the direction matter:
+    // a ray crosses at most three of the four children, in this order.
+    unsigned nearX = gridDirection[0] >= 0 ? 0 : 1;
+    unsigned nearZ = gridDirection[2] >= 0 ? 0 : 1;
+    const unsigned childOrder[4][2] = {
+        { nearX, nearZ }, { 1 - nearX, nearZ }, { nearX, 1 - nearZ }, { 1 - nearX, 1 - nearZ }
+    };
+
+    struct Block {
+        unsigned level, bx, bz;
+    };
+
+    // at most three siblings wait on every level
+    Block stack[4 * 32];
+    unsigned stackSize = 0;
+    stack[stackSize++] = { pyramid.getLevelCount() - 1, 0, 0 };
+
+    while (stackSize > 0) {
+        Block block = stack[--stackSize];
+
+        const HeightRange& range = pyramid.getRange(block.level, block.bx, block.bz);
+        float quads = static_cast<float>(pyramid.getBlockQuads(block.level));
+        float min[3] = { block.bx * quads, range.min, block.bz * quads };
+        float max[3] = { min[0] + quads, range.max, min[2] + quads };
+
+        float start = 0;
+        float end = maxDistance;
+        if (!clipToBox(gridOrigin, gridDirection, min, max, start, end)) {
+            continue;
+        }
+
+        if (block.level == 0) {
+            float distance;
+            if (intersectBlock(gridOrigin, gridDirection, block.bx, block.bz, start, end, distance)) {
+                hit.distance = distance;
+                hit.position = origin + distance * direction;
+                return true;
+            }
+
+            continue;
+        }
+
+        // push the children back to front
+        for (int child = 3; child >= 0; child--) {
+            stack[stackSize++] = { block.level - 1, 2 * block.bx + childOrder[child][0], 2 * block.bz + childOrder[child][1] };
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief HeightfieldRayCaster::intersectBlock
+ *
+ * Walks the quads of a level 0 block in the order the ray crosses them,
+ * testing the two triangles of every quad, from where the ray enters the
+ * block at distance start until it leaves it at distance end
+ */
+bool HeightfieldRayCaster::intersectBlock(const float *origin, const float *direction, unsigned bx, unsigned bz,
+                                          float start, float end, float& distance) const {
+    const Heightfield& heights = grid->getHeights();
+    int quads = static_cast<int>(pyramid.getBlockQuads(0));
+    int firstX = static_cast<int>(bx) * quads;
+    int firstZ = static_cast<int>(bz) * quads;
+
+    // the quad the ray enters the block in
+    auto cellAt = [&](float position, int first) -> int {
+        return std::min(std::max(static_cast<int>(std::floor(position)), first), first + quads - 1);
+    };
+
+    int x = cellAt(origin[0] + start * direction[0], firstX);
+    int z = cellAt(origin[2] + start * direction[2], firstZ);
+
+    // distances to the next quad borders, and between quad borders
+    const float infinity = std::numeric_limits<float>::infinity();
+    int stepX = direction[0] >= 0 ? 1 : -1;
+    int stepZ = direction[2] >= 0 ? 1 : -1;
+    float deltaX = direction[0] != 0 ? std::abs(1.0f / direction[0]) : infinity;
+    float deltaZ = direction[2] != 0 ? std::abs(1.0f / direction[2]) : infinity;
+    float nextX = direction[0] != 0 ? (x + (stepX > 0 ? 1 : 0) - origin[0]) / direction[0] : infinity;
+    float nextZ = direction[2] != 0 ? (z + (stepZ > 0 ? 1 : 0) - origin[2]) / direction[2] : infinity;
+
+    while (x >= firstX && x < firstX + quads && z >= firstZ && z < firstZ + quads) {
+        // the triangles of the quad, split like the grid topology strips
+        float p00[3] = { float(x),     heights.at(x, z),         float(z) };
+        float p01[3] = { float(x),     heights.at(x, z + 1),     float(z + 1) };
+        float p10[3] = { float(x + 1), heights.at(x + 1, z),     float(z) };
+        float p11[3] = { float(x + 1), heights.at(x + 1, z + 1), float(z + 1) };
+
+        float nearest = infinity;
+        float candidate;
+
+        if (intersectTriangle(origin, direction, p00, p01, p10, candidate) && candidate >= 0) {
+            nearest = std::min(nearest, candidate);
+        }
+
+        if (intersectTriangle(origin, direction, p01, p11, p10, candidate) && candidate >= 0) {
+            nearest = std::min(nearest, candidate);
+        }
+
+        if (nearest <= end) {
+            distance = nearest;
+            return true;
+        }
+
+        // step to the neighbouring quad the ray crosses into first
+        if (nextX < nextZ) {
+            if (nextX > end) {
+                break;
+            }
+
+            x += stepX;
+            nextX += deltaX;
+        } else {
+            if (nextZ > end) {
+                break;
+            }
+
+            z += stepZ;
+            nextZ += deltaZ;
+        }
+    }
+
+    return false;
+}
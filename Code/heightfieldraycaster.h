@@ -0,0 +1,76 @@
+#ifndef HEIGHTFIELDRAYCASTER_H
+#define HEIGHTFIELDRAYCASTER_H
+
+#include "noisegrid.h"
+#include "heightpyramid.h"
+
+#include <QVector3D>
+
+#include <memory>
+
+/**
+ * Where a ray first hits a terrain
+ */
+struct RayHit {
+    // along the ray, in units of its direction
+    float distance;
+    QVector3D position;
+};
+
+/**
+ * @brief The HeightfieldRayCaster class
+ *
+ * Intersects rays with the triangles of a NoiseGrid, as they are drawn at
+ * the placement of the grid. The grid is walked through a HeightPyramid of
+ * small blocks: every block the ray passes above or below is skipped with
+ * all of its children, so a query only tests the triangles of the few
+ * quads the ray actually comes close to.
+ *
+ * Queries only read, so they can run on any thread.
+ */
+class HeightfieldRayCaster {
+
+public:
+    /**
+     * @param grid the grid to cast rays at
+     * @param leafQuads the quads per side of the smallest pyramid blocks, a power of two
+     */
+    explicit HeightfieldRayCaster(std::shared_ptr<const NoiseGrid> grid, unsigned leafQuads = LEAF_QUADS);
+
+    /**
+     * @brief setGrid
+     *
+     * Casts rays at another grid, or at the same grid after its heights
+     * changed. The pyramid is rebuilt in the memory it has.
+     */
+    void setGrid(std::shared_ptr<const NoiseGrid> grid);
+
+    /**
+     * @brief intersect
+     *
+     * Finds the first hit of the ray origin + t * direction with the
+     * terrain, for t in [0, maxDistance]
+     *
+     * @return whether the ray hit the terrain, in which case hit is filled in
+     */
+    bool intersect(const QVector3D& origin, const QVector3D& direction, float maxDistance, RayHit& hit) const;
+
+    inline const NoiseGrid& getGrid() const { return *grid; }
+
+    // blocks of 4 x 4 quads keep the pyramid at half the size of the grid,
+    // while the quads in a block are walked cheaply one by one
+    static constexpr unsigned LEAF_QUADS = 4;
+
+private:
+    bool intersectBlock(const float *origin, const float *direction, unsigned bx, unsigned bz,
+                        float start, float end, float& distance) const;
+
+    std::shared_ptr<const NoiseGrid> grid;
+    unsigned leafQuads;
+    HeightPyramid pyramid;
+
+};
+
+typedef std::shared_ptr<const HeightfieldRayCaster> HeightfieldRayCasterPtr;
+
+#endif // HEIGHTFIELDRAYCASTER_H
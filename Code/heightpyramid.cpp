@@ -0,0 +1,52 @@
+#include "heightpyramid.h"
+
+#include <cassert>
+
+HeightPyramid::HeightPyramid(const Heightfield& heights, unsigned blockQuads) {
+    build(heights, blockQuads);
+}
+
+void HeightPyramid::build(const Heightfield& heights, unsigned blockQuads) {
+    this->blockQuads = blockQuads;
+    blocks = (heights.getRows() - 1) / blockQuads;
+
+    assert(blockQuads > 0 && (blockQuads & (blockQuads - 1)) == 0);
+    assert(blocks > 0 && blocks * blockQuads + 1 == heights.getRows());
+
+    // a level for every power of two up to a single block
+    unsigned levelCount = 1;
+    for (unsigned levelBlocks = blocks / 2; levelBlocks > 0; levelBlocks /= 2) {
+        levelCount++;
+    }
+
+    levels.resize(levelCount);
+
+    // level 0 straight from the heights
+    std::vector<HeightRange>& base = levels[0];
+    base.resize(size_t(blocks) * blocks);
+
+    computeBlockRanges(heights, blockQuads, [&](unsigned bx, unsigned bz, const HeightRange& range) {
+        base[bx * blocks + bz] = range;
+    });
+
+    // every next level merges 2 x 2 blocks of the previous one
+    unsigned level = 1;
+    for (unsigned levelBlocks = blocks / 2; levelBlocks > 0; levelBlocks /= 2, level++) {
+        const std::vector<HeightRange>& finer = levels[level - 1];
+        std::vector<HeightRange>& coarser = levels[level];
+        coarser.resize(size_t(levelBlocks) * levelBlocks);
+        unsigned finerBlocks = 2 * levelBlocks;
+
+        for (unsigned bx = 0; bx < levelBlocks; bx++) {
+            for (unsigned bz = 0; bz < levelBlocks; bz++) {
+                const HeightRange *a = &finer[(2 * bx) * finerBlocks + 2 * bz];
+                const HeightRange *b = &finer[(2 * bx + 1) * finerBlocks + 2 * bz];
+
+                coarser[bx * levelBlocks + bz] = {
+                    std::min(std::min(a[0].min, a[1].min), std::min(b[0].min, b[1].min)),
+                    std::max(std::max(a[0].max, a[1].max), std::max(b[0].max, b[1].max))
+                };
+            }
+        }
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef HEIGHTPYRAMID_H
+#define HEIGHTPYRAMID_H
+
+#include "heightfield.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+/**
+ * The lowest and highest height in a part of a grid
+ */
+struct HeightRange {
+    float min;
+    float max;
+};
+
+/**
+ * @brief The HeightPyramid class
+ *
+ * The height ranges of square blocks of a grid, at every power of two
+ * block size. Level 0 has a range per block of blockQuads by blockQuads
+ * quads, including the vertices on the block borders, and every next
+ * level merges 2 x 2 blocks, up to a single block covering the grid.
+ *
+ * Blocks are numbered like the grid: block (bx, bz) of a level covers the
+ * grid points x in [bx * quads, (bx + 1) * quads] and likewise for z.
+ */
+class HeightPyramid {
+
+public:
+    /**
+     * @param heights a grid of 2^N + 1 by 2^N + 1 heights
+     * @param blockQuads the block size of level 0, a power of two of at most 2^N
+     */
+    HeightPyramid(const Heightfield& heights, unsigned blockQuads);
+
+    /**
+     * @brief build
+     *
+     * Replaces the pyramid by the one of other heights, in the memory of
+     * the levels it has, so rebuilding it for a grid of the same size
+     * allocates nothing
+     */
+    void build(const Heightfield& heights, unsigned blockQuads);
+
+    /**
+     * @brief computeBlockRanges
+     *
+     * Computes the ranges of level 0 alone, without a pyramid, and calls
+     * output(bx, bz, range) for every block, from multiple threads
+     */
+    template<typename Output>
+    static void computeBlockRanges(const Heightfield& heights, unsigned blockQuads, const Output& output);
+
+    inline unsigned getLevelCount() const { return static_cast<unsigned>(levels.size()); }
+
+    // blocks per side of a level, and quads per side of its blocks
+    inline unsigned getBlocks(unsigned level) const { return blocks >> level; }
+    inline unsigned getBlockQuads(unsigned level) const { return blockQuads << level; }
+
+    inline const HeightRange& getRange(unsigned level, unsigned bx, unsigned bz) const {
+        return levels[level][bx * getBlocks(level) + bz];
+    }
+
+private:
+    unsigned blockQuads;
+    unsigned blocks;
+
+    std::vector< std::vector<HeightRange> > levels;
+
+};
+
+template<typename Output>
+void HeightPyramid::computeBlockRanges(const Heightfield& heights, unsigned blockQuads, const Output& output) {
+    unsigned blocks = (heights.getRows() - 1) / blockQuads;
+
+    // one band of block rows per thread
+    ThreadPool::global().parallelFor(0, blocks, [&](unsigned begin, unsigned end) {
+        for (unsigned bx = begin; bx < end; bx++) {
+            for (unsigned bz = 0; bz < blocks; bz++) {
+                HeightRange range = { heights.at(bx * blockQuads, bz * blockQuads),
+                                      heights.at(bx * blockQuads, bz * blockQuads) };
+
+                for (unsigned x = bx * blockQuads; x <= (bx + 1) * blockQuads; x++) {
+                    const float *row = heights.row(x);
+
+                    for (unsigned z = bz * blockQuads; z <= (bz + 1) * blockQuads; z++) {
+                        range.min = std::min(range.min, row[z]);
+                        range.max = std::max(range.max, row[z]);
+                    }
+                }
+
+                output(bx, bz, range);
+            }
+        }
+    });
+}
+
+typedef std::shared_ptr<const HeightPyramid> HeightPyramidPtr;
+
+#endif // HEIGHTPYRAMID_H
@@ -0,0 +1,119 @@
+#include "lodquadtree.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+LodQuadtree::LodQuadtree(const HeightPyramidPtr& bounds, const LodSettings& settings) :
+        bounds(bounds), settings(settings),
+        gridSize(bounds->getBlocks(0) * bounds->getBlockQuads(0) + 1) {
+
+    assert(bounds->getBlockQuads(0) == settings.patchQuads);
+    assert(settings.patchQuads >= 4);
+}
+
+void LodQuadtree::select(const QVector3D& cameraPosition, float projectionScale) {
+    this->cameraPosition = cameraPosition;
+
+    // The vertex spacing of level l is 2^l, which is pixelError pixels on
+    // screen at the distance projectionScale * 2^l / pixelError. The range
+    // of level 0 is kept at four patches at least, so a node is always
+    // small compared to the morph area of its level and neighbouring nodes
+    // never differ by more than one level.
+    float baseRange = std::max(projectionScale / settings.pixelError, 4.0f * settings.patchQuads);
+
+    ranges.resize(getLevelCount());
+    for (unsigned level = 0; level < ranges.size(); level++) {
+        ranges[level] = std::ldexp(baseRange, static_cast<int>(level));
+    }
+
+    nodes.clear();
+    selectNode(getLevelCount() - 1, 0, 0);
+}
+
+size_t LodQuadtree::getTriangleCount() const {
+    size_t triangles = 0;
+    for (const LodNode& node : nodes) {
+        triangles += 2 * size_t(node.quads) * node.quads;
+    }
+
+    return triangles;
+}
+
+QVector2D LodQuadtree::getMorphRange(unsigned level) const {
+    float previous = level > 0 ? ranges[level - 1] : 0.0f;
+    float start = previous + (ranges[level] - previous) * settings.morphStart;
+
+    return QVector2D(start, ranges[level]);
+}
+
+/**
+ * @brief LodQuadtree::selectNode
+ *
+ * Adds the node, or its children where they are in range of the finer
+ * level. Returns false if the node is outside the range of its own level,
+ * in which case its parent has to cover it.
+ */
+bool LodQuadtree::selectNode(unsigned level, unsigned bx, unsigned bz) {
+    BoundingBox nodeBounds = getNodeBounds(level, bx, bz);
+
+    // the root covers everything out of range
+    if (level + 1 < getLevelCount() && !intersectsRange(nodeBounds, ranges[level])) {
+        return false;
+    }
+
+    unsigned quads = bounds->getBlockQuads(level);
+
+    if (level == 0 || !intersectsRange(nodeBounds, ranges[level - 1])) {
+        nodes.push_back({ level, bx * quads, bz * quads, settings.patchQuads, nodeBounds });
+        return true;
+    }
+
+    // the children that are too far for the finer level are drawn as a
+    // quarter of this node
+    for (unsigned i = 0; i < 2; i++) {
+        for (unsigned j = 0; j < 2; j++) {
+            if (!selectNode(level - 1, 2 * bx + i, 2 * bz + j)) {
+                nodes.push_back({ level, (2 * bx + i) * quads / 2, (2 * bz + j) * quads / 2, settings.patchQuads / 2,
+                                  getNodeBounds(level - 1, 2 * bx + i, 2 * bz + j) });
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief LodQuadtree::intersectsRange
+ *
+ * Whether a bounding box lies partly within range of the camera
+ */
+bool LodQuadtree::intersectsRange(const BoundingBox& bounds, float range) const {
+    float distanceSquared = 0;
+    for (int i = 0; i < 3; i++) {
+        float outside = std::max(0.0f, std::max(bounds.min[i] - cameraPosition[i], cameraPosition[i] - bounds.max[i]));
+        distanceSquared += outside * outside;
+    }
+
+    return distanceSquared <= range * range;
+}
+
+/**
+ * @brief LodQuadtree::getNodeBounds
+ *
+ * The world space bounding box of a node
+ */
+BoundingBox LodQuadtree::getNodeBounds(unsigned level, unsigned bx, unsigned bz) const {
+    const HeightRange& heights = bounds->getRange(level, bx, bz);
+    float quads = static_cast<float>(bounds->getBlockQuads(level));
+
+    // grid point x lies at x - gridSize / 2, like the vertices of a NoiseGrid
+    QVector3D minimum(bx * quads - gridSize / 2.0f,
+                      heights.min * settings.heightScale + settings.heightOffset,
+                      bz * quads - gridSize / 2.0f);
+    QVector3D maximum(minimum.x() + quads,
+                      heights.max * settings.heightScale + settings.heightOffset,
+                      minimum.z() + quads);
+
+    return { minimum, maximum };
+}
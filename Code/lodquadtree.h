@@ -0,0 +1,114 @@
+#ifndef LODQUADTREE_H
+#define LODQUADTREE_H
+
+#include "heightpyramid.h"
+#include "frustum.h"
+
+#include <QVector2D>
+#include <QVector3D>
+
+#include <vector>
+
+/**
+ * The settings of a continuous level of detail terrain
+ */
+struct LodSettings {
+    // quads per side of the patch every node is drawn with, a power of two
+    unsigned patchQuads = 32;
+
+    // the largest distance between vertices on screen, in pixels
+    float pixelError = 4.0f;
+
+    // the fraction of a level's range after which its vertices start
+    // morphing to the next coarser level
+    float morphStart = 0.7f;
+
+    // the model transformation of the heights
+    float heightScale = 8.5f;
+    float heightOffset = -1.0f;
+};
+
+/**
+ * A node picked to be drawn. Nodes are drawn with a patch of quads by
+ * quads quads, which is either a full patch or a quarter of one, for the
+ * part of a node whose child was not selected.
+ */
+struct LodNode {
+    unsigned level;
+
+    // the first grid point of the patch
+    unsigned x;
+    unsigned z;
+
+    unsigned quads;
+
+    // in world space, for culling
+    BoundingBox bounds;
+};
+
+/**
+ * @brief The LodQuadtree class
+ *
+ * Selects the nodes of a terrain to draw, in the style of CDLOD. A node
+ * of level l covers patchQuads * 2^l quads and is drawn with patchQuads
+ * quads, so its vertices lie 2^l grid points apart. Level l is used as
+ * long as that spacing stays below the pixel error on screen, which
+ * gives every level a range around the camera that doubles per level.
+ *
+ * Inside the last part of its range, a level morphs its odd vertices onto
+ * their even neighbours, so at the end of the range it matches the next
+ * coarser level exactly and switching levels does not pop.
+ *
+ * The node bounds come from a HeightPyramid with patchQuads quad blocks,
+ * so pyramid level l holds the height ranges of the nodes of level l.
+ * Doesn't use OpenGL, so it can be used from any thread.
+ */
+class LodQuadtree {
+
+public:
+    LodQuadtree(const HeightPyramidPtr& bounds, const LodSettings& settings);
+
+    /**
+     * @brief select
+     *
+     * Selects the nodes for a camera.
+     *
+     * @param cameraPosition in world space
+     * @param projectionScale the size in pixels of an object of size 1 at
+     *        distance 1, i.e. viewport height / (2 tan(fov / 2))
+     */
+    void select(const QVector3D& cameraPosition, float projectionScale);
+
+    inline const std::vector<LodNode>& getSelectedNodes() const { return nodes; }
+    size_t getTriangleCount() const;
+
+    inline unsigned getLevelCount() const { return bounds->getLevelCount(); }
+    inline unsigned getGridSize() const { return gridSize; }
+    inline const LodSettings& getSettings() const { return settings; }
+
+    /**
+     * @brief getMorphRange
+     *
+     * The world space distances between which the vertices of a level
+     * morph to the next coarser level, as (start, end)
+     */
+    QVector2D getMorphRange(unsigned level) const;
+
+private:
+    bool selectNode(unsigned level, unsigned bx, unsigned bz);
+    bool intersectsRange(const BoundingBox& bounds, float range) const;
+    BoundingBox getNodeBounds(unsigned level, unsigned bx, unsigned bz) const;
+
+    HeightPyramidPtr bounds;
+    LodSettings settings;
+    unsigned gridSize;
+
+    // the range of every level for the current selection
+    QVector3D cameraPosition;
+    std::vector<float> ranges;
+
+    std::vector<LodNode> nodes;
+
+};
+
+#endif // LODQUADTREE_H
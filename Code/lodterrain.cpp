@@ -0,0 +1,91 @@
+#include "lodterrain.h"
+
+#include <QDebug>
+
+LodTerrain::LodTerrain(const Heightfield& heights, const HeightPyramidPtr& bounds, const LodSettings& settings) :
+        quadtree(bounds, settings),
+        patch(GridTopology::get(settings.patchQuads + 1)),
+        quarterPatch(GridTopology::get(settings.patchQuads / 2 + 1)),
+        vao(0) {
+
+    initializeOpenGLFunctions();
+
+    GLsizei size = static_cast<GLsizei>(heights.getRows());
+
+    // nothing is uploaded when the heights don't fit in a texture, see isUploaded
+    GLint maximumSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maximumSize);
+    if (size > maximumSize) {
+        qWarning() << ":: A terrain of size" << size << "doesn't fit in a texture of at most" << maximumSize;
+        return;
+    }
+
+    // the patches have no attributes, but the core profile needs a VAO to draw
+    glGenVertexArrays(1, &vao);
+
+    // a row of the grid is a row of the texture. The rows are uploaded
+    // straight from the heightfield, skipping the padding between them.
+    heightTexture = TexturePtr(new Texture());
+    heightTexture->bind(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(heights.getStride()));
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, size, size, 0, GL_RED, GL_FLOAT, heights.row(0));
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    qDebug() << ":: Uploaded level of detail terrain of size" << size << "with" << quadtree.getLevelCount() << "levels";
+}
+
+LodTerrain::~LodTerrain() {
+    if (vao != 0) {
+        glDeleteVertexArrays(1, &vao);
+    }
+}
+
+void LodTerrain::select(const QVector3D& cameraPosition, float projectionScale) {
+    this->cameraPosition = cameraPosition;
+    quadtree.select(cameraPosition, projectionScale);
+}
+
+void LodTerrain::draw(ShaderProgram& shader, const Frustum& frustum) {
+    glBindVertexArray(vao);
+
+    const unsigned patchQuads = quadtree.getSettings().patchQuads;
+    GridTopology *bound = nullptr;
+
+    for (const LodNode& node : quadtree.getSelectedNodes()) {
+        if (!frustum.intersects(node.bounds)) {
+            continue;
+        }
+
+        GridTopology *topology = node.quads == patchQuads ? patch.get() : quarterPatch.get();
+        if (topology != bound) {
+            topology->bind();
+            bound = topology;
+        }
+
+        shader.setUniform("lodNode", QVector3D(node.x, node.z, static_cast<float>(1u << node.level)));
+        shader.setUniform("lodPatchSize", static_cast<GLint>(node.quads + 1));
+        shader.setUniform("lodMorph", quadtree.getMorphRange(node.level));
+
+        topology->draw();
+    }
+}
+
+void LodTerrain::bindHeightTexture(GLuint slot) {
+    glActiveTexture(GL_TEXTURE0 + slot);
+    heightTexture->bind(GL_TEXTURE_2D);
+}
+
+QMatrix4x4 LodTerrain::getModelMatrix() const {
+    const LodSettings& settings = quadtree.getSettings();
+
+    QMatrix4x4 modelMatrix;
+    modelMatrix.translate(QVector3D(0, settings.heightOffset, 0));
+    modelMatrix.scale(QVector3D(1, settings.heightScale, 1));
+
+    return modelMatrix;
+}
@@ -0,0 +1,74 @@
+#ifndef LODTERRAIN_H
+#define LODTERRAIN_H
+
+#include "lodquadtree.h"
+#include "gridtopology.h"
+#include "shaderprogram.h"
+#include "texture.h"
+#include "heightfield.h"
+
+#include <QOpenGLFunctions_3_3_Core>
+#include <QMatrix4x4>
+
+#include <memory>
+
+/**
+ * @brief The LodTerrain class
+ *
+ * A terrain drawn with a continuous level of detail. The heights are
+ * uploaded once as a texture, and every selected node of the LodQuadtree
+ * is drawn with the same patch topology. The terrain shader places the
+ * patch vertices of a node from its lodNode uniform, and morphs them
+ * between levels by their distance to lodCameraPosition.
+ *
+ * Must only be used on the GL thread.
+ */
+class LodTerrain : protected QOpenGLFunctions_3_3_Core {
+
+public:
+    LodTerrain(const Heightfield& heights, const HeightPyramidPtr& bounds, const LodSettings& settings);
+    ~LodTerrain();
+
+    LodTerrain(const LodTerrain&) = delete;
+    LodTerrain& operator=(const LodTerrain&) = delete;
+
+    /**
+     * @brief select
+     *
+     * Selects the nodes to draw for a camera. The same selection should be
+     * used for all passes of a frame, so the reflections morph along.
+     */
+    void select(const QVector3D& cameraPosition, float projectionScale);
+
+    /**
+     * @brief draw
+     *
+     * Draws the selected nodes within the frustum. The height texture has
+     * to be bound, and the terrain shader has to be bound with heightmapMode 3.
+     */
+    void draw(ShaderProgram& shader, const Frustum& frustum);
+
+    void bindHeightTexture(GLuint slot);
+
+    QMatrix4x4 getModelMatrix() const;
+
+    // false if the heights didn't fit in a texture, then nothing can be drawn
+    inline bool isUploaded() const { return heightTexture != nullptr; }
+
+    inline const QVector3D& getSelectionCameraPosition() const { return cameraPosition; }
+    inline const LodQuadtree& getQuadtree() const { return quadtree; }
+
+private:
+    LodQuadtree quadtree;
+    QVector3D cameraPosition;
+
+    // full patches, and quarter patches for partially covered nodes
+    GridTopologyPtr patch;
+    GridTopologyPtr quarterPatch;
+
+    GLuint vao;
+    TexturePtr heightTexture;
+
+};
+
+#endif // LODTERRAIN_H
@@ -0,0 +1,82 @@
+#ifndef LRUCACHE_H
+#define LRUCACHE_H
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * @brief The LruCache class
+ *
+ * A map with a bounded number of entries. Inserting into a full cache
+ * evicts the entry that was least recently inserted or looked up.
+ * Evicted values are destroyed in the thread that inserts.
+ */
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+
+public:
+    explicit LruCache(size_t capacity) : capacity(capacity) {}
+
+    /**
+     * @brief find
+     *
+     * Looks up a value and marks it as most recently used
+     *
+     * @return the value, or nullptr if it is not cached
+     */
+    Value *find(const Key& key) {
+        auto iter = index.find(key);
+        if (iter == index.end()) {
+            return nullptr;
+        }
+
+        entries.splice(entries.begin(), entries, iter->second);
+        return &iter->second->second;
+    }
+
+    inline bool contains(const Key& key) const { return index.find(key) != index.end(); }
+
+    /**
+     * @brief insert
+     *
+     * Inserts or replaces a value, and evicts the least recently used
+     * entries if the cache is over capacity
+     */
+    void insert(const Key& key, Value value) {
+        auto iter = index.find(key);
+        if (iter != index.end()) {
+            iter->second->second = std::move(value);
+            entries.splice(entries.begin(), entries, iter->second);
+            return;
+        }
+
+        entries.emplace_front(key, std::move(value));
+        index[key] = entries.begin();
+
+        while (entries.size() > capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+
+    void clear() {
+        index.clear();
+        entries.clear();
+    }
+
+    inline size_t size() const { return entries.size(); }
+    inline size_t getCapacity() const { return capacity; }
+
+private:
+    size_t capacity;
+
+    // most recently used first
+    std::list< std::pair<Key, Value> > entries;
+    std::unordered_map<Key, typename std::list< std::pair<Key, Value> >::iterator, Hash> index;
+
+};
+
+#endif // LRUCACHE_H
@@ -1,11 +1,76 @@
 #include "mainwindow.h"
+#include "threadpool.h"
+#include "vertexformat.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QDebug>
 #include <QSurfaceFormat>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
 
+    // command line options
+    QCommandLineParser parser;
+    parser.addHelpOption();
+
+    QCommandLineOption threadsOption("threads",
+            "Number of threads used to generate the terrain (0 = one per hardware thread).", "count", "0");
+    parser.addOption(threadsOption);
+
+    QCommandLineOption seedOption("seed", "Seed of the first generated terrain.", "seed");
+    parser.addOption(seedOption);
+
+    QCommandLineOption infiniteOption("infinite", "Stream an infinite terrain around the camera instead of an island.");
+    parser.addOption(infiniteOption);
+
+    QCommandLineOption heightmapOption("heightmap", "Upload the terrain as a height texture instead of a vertex buffer.");
+    parser.addOption(heightmapOption);
+
+    QCommandLineOption lodOption("lod", "Draw the island with a continuous level of detail from a height texture.");
+    parser.addOption(lodOption);
+
+    QCommandLineOption detailOption("detail", "The island is 2^detail + 1 vertices wide.", "detail", "9");
+    parser.addOption(detailOption);
+
+    QCommandLineOption terrainFileOption("terrain-file",
+            "Load the island from this terrain file if it exists, and save every generated island to it.", "file");
+    parser.addOption(terrainFileOption);
+
+    QCommandLineOption quantizeOption("quantize", "Store the heights in terrain files as 16-bit values.");
+    parser.addOption(quantizeOption);
+
+    QCommandLineOption vertexErrorOption("vertex-error",
+            "Largest position error of compressed vertices, in model units (0 = never compress).", "error");
+    parser.addOption(vertexErrorOption);
+    parser.process(a);
+
+    // the octaves start at a lattice of 2^4 quads. Beyond 2^14 + 1 vertices
+    // no mode can draw the grid: its strip indices don't fit in a GLsizei,
+    // and its height texture is larger than GPUs allow.
+    bool detailValid = false;
+    unsigned detail = parser.value(detailOption).toUInt(&detailValid);
+    if (!detailValid || detail < 4 || detail > 14) {
+        qCritical() << ":: The detail must be a number between 4 and 14, not" << parser.value(detailOption);
+        return 1;
+    }
+
+    bool threadsValid = false;
+    unsigned threads = parser.value(threadsOption).toUInt(&threadsValid);
+    if (!threadsValid) {
+        qCritical() << ":: The thread count must be a number, 0 for one per hardware thread, not"
+                    << parser.value(threadsOption);
+        return 1;
+    }
+
+    ThreadPool::setGlobalThreadCount(threads);
+
+    if (parser.isSet(vertexErrorOption)) {
+        VertexTolerance tolerance;
+        tolerance.position = parser.value(vertexErrorOption).toFloat();
+        setVertexTolerance(tolerance);
+    }
+
     // Request OpenGL 3.3 Core
     QSurfaceFormat glFormat;
     glFormat.setProfile(QSurfaceFormat::CoreProfile);
@@ -21,6 +86,16 @@ int main(int argc, char *argv[])
     QSurfaceFormat::setDefaultFormat(glFormat);
 
     MainWindow w;
+    w.setInfiniteTerrain(parser.isSet(infiniteOption));
+    w.setHeightmapTerrain(parser.isSet(heightmapOption));
+    w.setLevelOfDetail(parser.isSet(lodOption));
+    w.setTerrainDetail(detail);
+    w.setTerrainFile(parser.value(terrainFileOption), parser.isSet(quantizeOption));
+
+    if (parser.isSet(seedOption)) {
+        w.setTerrainSeed(parser.value(seedOption).toULongLong());
+    }
+
     w.show();
 
     return a.exec();
@@ -3,9 +3,11 @@
 #include "noisegrid.h"
 
 #include <QDateTime>
+#include <QFile>
 
 #include <vector>
 #include <chrono>
+#include <random>
 #include <ctime>
 
 #define PI 3.14159265359f
@@ -18,6 +20,10 @@
 #define TEXTURE_LOCATION_REFRACTION  2
 #define TEXTURE_LOCATION_DEPTHMAP    3
 
+// after the textures of the three terrain materials
+#define TEXTURE_LOCATION_HEIGHTS         9
+#define TEXTURE_LOCATION_HEIGHT_NORMALS 10
+
 /**
  * @brief MainView::MainView
  *
@@ -25,9 +31,14 @@
  *
  * @param parent
  */
-MainView::MainView(QWidget *parent) : QOpenGLWidget(parent) {
+MainView::MainView(QWidget *parent) : QOpenGLWidget(parent),
+        infiniteTerrain(false), heightmapTerrain(false), levelOfDetail(false), terrainDetail(9),
+        terrainFileEncoding(HeightEncoding::Float32), loadTerrainFile(false),
+        cameraTarget(0, 0, 0) {
     qDebug() << "MainView constructor";
 
+    terrainSeed = randomSeed();
+
     connect(&timer, SIGNAL(timeout()), this, SLOT(update()));
 }
 
@@ -113,6 +124,8 @@ void MainView::createShaderProgram() {
             TEXTURE_LOCATION_NORMAL, TEXTURE_LOCATION_NORMAL + 3, TEXTURE_LOCATION_NORMAL + 6 });
     terrainShaderProgram->setUniform("specularTexture", std::vector<GLint>{
             TEXTURE_LOCATION_SPECULAR, TEXTURE_LOCATION_SPECULAR + 3, TEXTURE_LOCATION_SPECULAR + 6 });
+    terrainShaderProgram->setUniform("heightTexture", TEXTURE_LOCATION_HEIGHTS);
+    terrainShaderProgram->setUniform("heightNormalTexture", TEXTURE_LOCATION_HEIGHT_NORMALS);
 
     waterShaderProgram->setUniform("dudvMap", TEXTURE_LOCATION_DUDV);
     waterShaderProgram->setUniform("reflectionTexture", TEXTURE_LOCATION_REFLECTION);
@@ -144,7 +157,7 @@ void MainView::createModels() {
 
     // water model
     NoiseGrid waterGrid(1);
-    ModelDataPtr waterModel = waterGrid.createModelData();
+    ModelDataPtr waterModel(new ModelData(waterGrid.createMeshData()));
 
     // water material
     MaterialPtr waterMaterial(new Material(0.1f, 0.9f, 0.58f, 91));
@@ -180,11 +193,9 @@ void MainView::createFramebuffers() {
 }
 
 void MainView::updateProjectionMatrix() {
-    float fov = 60;
-
     // Change the projection matrix
     projMatrix.setToIdentity();
-    projMatrix.perspective(fov, float(width) / float(height), nearPlane, farPlane);
+    projMatrix.perspective(fieldOfView, float(width) / float(height), nearPlane, farPlane);
 
     // Upload the projection matrix to the current shader
     terrainShaderProgram->setUniform("projMatrix", projMatrix);
@@ -209,6 +220,7 @@ void MainView::updateViewMatrix() {
     viewMatrix.scale(viewScale);
     viewMatrix.rotate(rotation.x(), { -1, 0, 0 });
     viewMatrix.rotate(rotation.y(), {  0, 1, 0 });
+    viewMatrix.translate(-cameraTarget.x(), 0, -cameraTarget.z());
 
     // Change the camera position
     QVector4D pos(0, 0, 0, 1);
@@ -222,6 +234,7 @@ void MainView::updateViewMatrix() {
     reflectedViewMatrix.rotate(rotation.x(), { 1, 0, 0 });
     reflectedViewMatrix.rotate(rotation.y(), { 0, 1, 0 });
     reflectedViewMatrix.translate(0, -2 * waterHeight, 0);
+    reflectedViewMatrix.translate(-cameraTarget.x(), 0, -cameraTarget.z());
 
     // Change the reflected camera position
     reflectedCameraPosition = QVector3D(pos.x(), -pos.y() + 2 * waterHeight, pos.z());
@@ -241,10 +254,23 @@ void MainView::paintGL() {
     // First: perform the animation
     animate();
 
-    // if the terrain should be regenerated, do that here
-    if (shouldRegenerate) {
-        regenerateTerrain();
-        shouldRegenerate = false;
+    // swap in a newly generated terrain, if there is one. The old
+    // terrain is drawn until the new one is uploaded.
+    std::unique_ptr<GeneratedTerrain> terrain = terrainGenerator.takeResult();
+    if (terrain) {
+        updateTerrain(*terrain);
+    }
+
+    // pick the level of detail once per frame, so all passes draw the same nodes
+    if (lodTerrain != nullptr) {
+        float projectionScale = height / (2.0f * tanf(fieldOfView * PI / 360.0f));
+        lodTerrain->select(cameraPosition, projectionScale);
+    }
+
+    // stream in the chunks around the camera, and keep the water under it
+    if (chunkManager != nullptr) {
+        chunkManager->update(cameraTarget);
+        objects["water"]->setTranslation({cameraTarget.x(), waterHeight, cameraTarget.z()});
     }
 
     // set the light
@@ -282,7 +308,13 @@ void MainView::paintGL() {
     terrainShaderProgram->setUniform("cameraPosition", reflectedCameraPosition);
     terrainShaderProgram->setUniform("viewMatrix", reflectedViewMatrix);
 
+    // only what is above the water is reflected
+    Frustum reflectionFrustum(projMatrix * reflectedViewMatrix);
+    reflectionFrustum.addPlane(QVector4D(0, 1, 0, -waterHeight));
+
     // draw objects to the texture
+    paintChunks(reflectionFrustum);
+    paintLodTerrain(reflectionFrustum);
     for (const auto& p : objects) {
         // don't render the water
         if (p.first == "water") {
@@ -290,7 +322,7 @@ void MainView::paintGL() {
         }
 
         // render the objects
-        paintObject(p.second);
+        paintObject(p.second, reflectionFrustum);
     }
 
 
@@ -307,7 +339,13 @@ void MainView::paintGL() {
     terrainShaderProgram->setUniform("cameraPosition", cameraPosition);
     terrainShaderProgram->setUniform("viewMatrix", viewMatrix);
 
+    // only what is below the water is refracted
+    Frustum refractionFrustum(projMatrix * viewMatrix);
+    refractionFrustum.addPlane(QVector4D(0, -1, 0, waterHeight));
+
     // draw objects to the texture
+    paintChunks(refractionFrustum);
+    paintLodTerrain(refractionFrustum);
     for (const auto& p : objects) {
         // don't render the water
         if (p.first == "water") {
@@ -315,7 +353,7 @@ void MainView::paintGL() {
         }
 
         // render the objects
-        paintObject(p.second);
+        paintObject(p.second, refractionFrustum);
     }
 
     //----------------------------------//
@@ -333,14 +371,73 @@ void MainView::paintGL() {
     waterShaderProgram->setUniform("cameraPosition", cameraPosition);
     waterShaderProgram->setUniform("viewMatrix", viewMatrix);
 
+    Frustum frustum(projMatrix * viewMatrix);
+
     // draw all objects
+    paintChunks(frustum);
+    paintLodTerrain(frustum);
     for (const auto& p : objects) {
         // render the objects
-        paintObject(p.second);
+        paintObject(p.second, frustum);
+    }
+}
+
+void MainView::paintChunks(const Frustum& frustum) {
+    if (chunkManager == nullptr) {
+        return;
+    }
+
+    for (const auto& chunk : chunkManager->getVisibleChunks()) {
+        paintObject(chunk, frustum);
+    }
+}
+
+void MainView::paintLodTerrain(const Frustum& frustum) {
+    if (lodTerrain == nullptr) {
+        return;
+    }
+
+    terrainShaderProgram->bind();
+
+    QMatrix4x4 modelMatrix = lodTerrain->getModelMatrix();
+    terrainShaderProgram->setUniform("modelMatrix", modelMatrix);
+    terrainShaderProgram->setUniform("normalModelMatrix", modelMatrix.normalMatrix());
+
+    bindMaterials(terrainShaderProgram, { grassMaterial, rockMaterial, sandMaterial });
+
+    terrainShaderProgram->setUniform("vertexFormat", static_cast<GLint>(VertexFormat::Full));
+    terrainShaderProgram->setUniform("uvScale", QVector2D(1, 1));
+    terrainShaderProgram->setUniform("uvBias", QVector2D(0, 0));
+
+    // the reflection pass morphs by the same camera as the others
+    lodTerrain->bindHeightTexture(TEXTURE_LOCATION_HEIGHTS);
+    terrainShaderProgram->setUniform("heightmapMode", 3);
+    terrainShaderProgram->setUniform("uvOffset", QVector2D(0, 0));
+    terrainShaderProgram->setUniform("lodCameraPosition", lodTerrain->getSelectionCameraPosition());
+
+    lodTerrain->draw(*terrainShaderProgram, frustum);
+}
+
+void MainView::bindMaterials(const ShaderProgramPtr& shader, const std::vector<MaterialPtr>& materials) {
+    std::vector<QVector4D> materialVectors;
+    GLuint startSlot = 0;
+    for (const auto& material : materials) {
+        material->bindTextures(startSlot);
+        materialVectors.push_back(material->getMaterialVector());
+        startSlot += 3;
     }
+    shader->setUniform("material", materialVectors);
 }
 
-void MainView::paintObject(const ObjectPtr &object) {
+void MainView::paintObject(const ObjectPtr &object, const Frustum& frustum) {
+    const ModelDataPtr& model = object->getModel();
+    QMatrix4x4 modelMatrix = object->getModelMatrix();
+
+    // skip objects outside the frustum of the pass, before binding anything
+    if (model->hasBounds() && !frustum.intersects(model->getBounds().transformed(modelMatrix))) {
+        return;
+    }
+
     // get the correct shader
     ShaderProgramPtr shader = terrainShaderProgram;
 
@@ -355,22 +452,28 @@ void MainView::paintObject(const ObjectPtr &object) {
     shader->bind();
 
     // update the (normal) model matrix
-    QMatrix4x4 modelMatrix = object->getModelMatrix();
     shader->setUniform("modelMatrix", modelMatrix);
     shader->setUniform("normalModelMatrix", modelMatrix.normalMatrix());
 
     // update the material
-    std::vector<QVector4D> materials;
-    GLuint startSlot = 0;
-    for (const auto& material : object->getMaterials()) {
-        material->bindTextures(startSlot);
-        materials.push_back(material->getMaterialVector());
-        startSlot += 3;
+    bindMaterials(shader, object->getMaterials());
+
+    // compact vertices need to be decoded
+    shader->setUniform("vertexFormat", static_cast<GLint>(model->getVertexFormat()));
+    shader->setUniform("uvScale", model->getUvScale());
+    shader->setUniform("uvBias", model->getUvBias());
+
+    // height texture grids build their vertices in the vertex shader
+    if (model->isHeightmap()) {
+        model->bindHeightTextures(TEXTURE_LOCATION_HEIGHTS, TEXTURE_LOCATION_HEIGHT_NORMALS);
+        shader->setUniform("heightmapMode", model->hasNormalTexture() ? 2 : 1);
+        shader->setUniform("uvOffset", model->getUvOffset());
+    } else {
+        shader->setUniform("heightmapMode", 0);
     }
-    shader->setUniform("material", materials);
 
-    // draw the model
-    object->getModel()->draw();
+    // draw the blocks of the model that are in the frustum
+    model->draw(frustum, modelMatrix);
 }
 
 /**
@@ -424,25 +527,170 @@ void MainView::setScale(int s)
 }
 
 void MainView::regenerate() {
-    shouldRegenerate = true;
+    terrainSeed = randomSeed();
+    regenerateTerrain();
+}
+
+void MainView::setSeed(uint64_t seed) {
+    terrainSeed = seed;
+
+    // before initializeGL, the first terrain will use the seed anyway
+    if (isValid()) {
+        regenerateTerrain();
+    }
+}
+
+void MainView::setInfiniteTerrain(bool enabled) {
+    infiniteTerrain = enabled;
+}
+
+void MainView::setHeightmapTerrain(bool enabled) {
+    heightmapTerrain = enabled;
+}
+
+void MainView::setLevelOfDetail(bool enabled) {
+    levelOfDetail = enabled;
+}
+
+void MainView::setTerrainDetail(unsigned detail) {
+    terrainDetail = detail;
+}
+
+void MainView::setTerrainFile(const QString& path, bool quantized) {
+    terrainFilePath = path;
+    terrainFileEncoding = quantized ? HeightEncoding::UInt16 : HeightEncoding::Float32;
+    loadTerrainFile = !path.isEmpty();
+}
+
+void MainView::moveCameraTarget(float forward, float right) {
+    // move in the horizontal directions the camera is facing
+    float angle = rotation.y() * PI / 180.0f;
+    QVector3D forwardDirection(sinf(angle), 0, -cosf(angle));
+    QVector3D rightDirection(cosf(angle), 0, sinf(angle));
+
+    cameraTarget += cameraStep * (forward * forwardDirection + right * rightDirection);
+
+    updateViewMatrix();
+}
+
+bool MainView::pickTerrain(const QPointF& point, QVector3D& position) const {
+    if (infiniteTerrain || terrainRayCaster == nullptr) {
+        return false;
+    }
+
+    // the ray from the near plane to the far plane through the point
+    float x = 2.0f * static_cast<float>(point.x()) / QWidget::width() - 1.0f;
+    float y = 1.0f - 2.0f * static_cast<float>(point.y()) / QWidget::height();
+
+    QMatrix4x4 inverseViewProjection = (projMatrix * viewMatrix).inverted();
+    QVector3D nearPoint = inverseViewProjection.map(QVector3D(x, y, -1));
+    QVector3D farPoint = inverseViewProjection.map(QVector3D(x, y, 1));
+
+    RayHit hit;
+    if (!terrainRayCaster->intersect(nearPoint, farPoint - nearPoint, 1.0f, hit)) {
+        return false;
+    }
+
+    position = hit.position;
+    return true;
 }
 
 void MainView::regenerateTerrain() {
-    // terrain model
-    NoiseGrid terrainGrid(9);
-    terrainGrid.addSpike(-2, 1, 3);
-    terrainGrid.addOctaves(5, 1.0f, 4);
-    ModelDataPtr terrainModel = terrainGrid.createModelData();
+    if (!infiniteTerrain) {
+        // grids smaller than a patch are drawn as a single mesh
+        unsigned lodPatchQuads = levelOfDetail && (1u << terrainDetail) >= lodSettings.patchQuads ? lodSettings.patchQuads : 0;
+
+        // the terrain is generated in the background, and picked up by paintGL
+        TerrainParameters parameters = { terrainDetail, terrainSeed, heightmapTerrain, lodPatchQuads,
+                                         lodSettings.heightScale, lodSettings.heightOffset,
+                                         QString(), terrainFilePath, terrainFileEncoding };
+
+        // only the first terrain comes from the file, regenerating replaces it
+        if (loadTerrainFile && QFile::exists(terrainFilePath)) {
+            parameters.loadPath = terrainFilePath;
+        }
+
+        loadTerrainFile = false;
+        terrainGenerator.request(parameters);
+        return;
+    }
+
+    ChunkSettings settings;
+    settings.seed = terrainSeed;
+    settings.heightmap = heightmapTerrain;
+
+    // the old chunks delete their buffers, so the context has to be current
+    if (chunkManager != nullptr) {
+        makeCurrent();
+        chunkManager.reset();
+        doneCurrent();
+    }
+
+    chunkManager.reset(new ChunkManager(settings, { grassMaterial, rockMaterial, sandMaterial }));
+}
+
+void MainView::updateTerrain(const GeneratedTerrain& terrain) {
+    auto start = std::chrono::high_resolution_clock::now();
+    terrainRayCaster = terrain.rayCaster;
+
+    // level of detail terrains only upload their heights
+    if (terrain.bounds != nullptr) {
+        lodTerrain.reset(new LodTerrain(terrain.grid->getHeights(), terrain.bounds, lodSettings));
+        objects.erase("terrain");
+
+        if (!lodTerrain->isUploaded()) {
+            qWarning() << ":: The terrain is too large for this GPU, use a lower --detail";
+            lodTerrain.reset();
+            terrainRayCaster.reset();
+            return;
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        qDebug() << ":: Uploaded terrain in" << std::chrono::duration<double, std::milli>(end - start).count() << "ms";
+        return;
+    }
+
+    // terrain model. Terrain files are drawn from height textures, and are
+    // placed the way they were when they were saved.
+    lodTerrain.reset();
+    ModelDataPtr terrainModel(terrain.file != nullptr ? new ModelData(*terrain.file) : new ModelData(*terrain.mesh));
+
+    if (!terrainModel->isUploaded()) {
+        qWarning() << ":: The terrain is too large for this GPU, it is not drawn";
+        objects.erase("terrain");
+        terrainRayCaster.reset();
+        return;
+    }
+
+    GridPlacement placement;
+    placement.heightScale = lodSettings.heightScale;
+    placement.heightOffset = lodSettings.heightOffset;
+
+    if (terrain.file != nullptr) {
+        placement = terrain.file->getInfo().placement;
+        terrainSeed = terrain.file->getInfo().seed;
+
+        // the heights stay in the file, a ray caster would read all of them
+        qDebug() << ":: Terrains loaded from a file can't be picked, regenerate the island to pick points on it";
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    qDebug() << ":: Uploaded terrain in" << std::chrono::duration<double, std::milli>(end - start).count() << "ms";
 
     // creating the terrain object
-    ObjectPtr terrain(new Object(terrainModel, { grassMaterial, rockMaterial, sandMaterial }));
-    terrain->setScale({1, 8.5f, 1});
-    terrain->setTranslation({0, -1.0f, 0});
-    objects["terrain"] = terrain;
+    ObjectPtr terrainObject(new Object(terrainModel, { grassMaterial, rockMaterial, sandMaterial }));
+    terrainObject->setScale({1, placement.heightScale, 1});
+    terrainObject->setTranslation({0, placement.heightOffset, 0});
+    objects["terrain"] = terrainObject;
 }
 
 // --- Private helpers
 
+uint64_t MainView::randomSeed() {
+    std::random_device device;
+    return (static_cast<uint64_t>(device()) << 32) | device();
+}
+
 /**
  * @brief MainView::onMessageLogged
  *
@@ -4,6 +4,9 @@
 #include "object.h"
 #include "shaderprogram.h"
 #include "framebuffer.h"
+#include "terraingenerator.h"
+#include "chunkmanager.h"
+#include "lodterrain.h"
 
 #include <QKeyEvent>
 #include <QMouseEvent>
@@ -13,6 +16,7 @@
 #include <QTimer>
 #include <QVector3D>
 #include <memory>
+#include <cstdint>
 
 class MainView : public QOpenGLWidget, protected QOpenGLFunctions_3_3_Core {
     Q_OBJECT
@@ -36,6 +40,24 @@ public:
     void setRotation(int rotateX, int rotateY);
     void setScale(int scale);
     void regenerate();
+    void setSeed(uint64_t seed);
+    void setInfiniteTerrain(bool enabled);
+    void setHeightmapTerrain(bool enabled);
+    void setLevelOfDetail(bool enabled);
+    void setTerrainDetail(unsigned detail);
+    void setTerrainFile(const QString& path, bool quantized);
+    void moveCameraTarget(float forward, float right);
+
+    /**
+     * @brief pickTerrain
+     *
+     * Casts a ray through a point of the widget, in widget coordinates,
+     * and finds where it first hits the island. Islands loaded from a
+     * terrain file have no ray caster and are never hit.
+     *
+     * @return whether the island was hit, in which case position is set to the world position of the hit
+     */
+    bool pickTerrain(const QPointF& point, QVector3D& position) const;
 
 protected:
     void initializeGL();
@@ -63,8 +85,14 @@ private:
     void createFramebuffers();
     void updateProjectionMatrix();
     void updateViewMatrix();
-    void paintObject(const ObjectPtr& object);
+    void paintObject(const ObjectPtr& object, const Frustum& frustum);
+    void paintChunks(const Frustum& frustum);
+    void paintLodTerrain(const Frustum& frustum);
+    void bindMaterials(const ShaderProgramPtr& shader, const std::vector<MaterialPtr>& materials);
     void regenerateTerrain();
+    void updateTerrain(const GeneratedTerrain& terrain);
+
+    static uint64_t randomSeed();
 
     std::map<std::string, ObjectPtr> objects;
 
@@ -82,13 +110,45 @@ private:
 
     float t;
     float waterHeight;
-    bool shouldRegenerate;
+    uint64_t terrainSeed;
+    TerrainGenerator terrainGenerator;
+
+    // streams chunks around the camera instead of a single island
+    bool infiniteTerrain;
+    std::unique_ptr<ChunkManager> chunkManager;
+
+    // upload terrains as height textures instead of vertex buffers
+    bool heightmapTerrain;
+
+    // draw the island with a continuous level of detail
+    bool levelOfDetail;
+    LodSettings lodSettings;
+    std::unique_ptr<LodTerrain> lodTerrain;
+
+    // casts rays at the current island, for picking
+    HeightfieldRayCasterPtr terrainRayCaster;
+
+    // the terrain grid is 2^terrainDetail + 1 vertices wide
+    unsigned terrainDetail;
+
+    // the island is loaded from this terrain file at startup if it exists,
+    // and every generated island is saved to it
+    QString terrainFilePath;
+    HeightEncoding terrainFileEncoding;
+    bool loadTerrainFile;
+
+    // the point the camera orbits around
+    QVector3D cameraTarget;
 
     FramebufferPtr reflectionBuffer;
     FramebufferPtr refractionBuffer;
 
     static constexpr GLfloat nearPlane = 0.1f;
     static constexpr GLfloat farPlane = 100.0f;
+    static constexpr float fieldOfView = 60.0f;
+
+    // distance the camera target moves per key press
+    static constexpr float cameraStep = 32.0f;
 
 };
 
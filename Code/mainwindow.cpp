@@ -15,6 +15,36 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
+void MainWindow::setTerrainSeed(quint64 seed)
+{
+    ui->mainView->setSeed(seed);
+}
+
+void MainWindow::setInfiniteTerrain(bool enabled)
+{
+    ui->mainView->setInfiniteTerrain(enabled);
+}
+
+void MainWindow::setHeightmapTerrain(bool enabled)
+{
+    ui->mainView->setHeightmapTerrain(enabled);
+}
+
+void MainWindow::setLevelOfDetail(bool enabled)
+{
+    ui->mainView->setLevelOfDetail(enabled);
+}
+
+void MainWindow::setTerrainDetail(unsigned detail)
+{
+    ui->mainView->setTerrainDetail(detail);
+}
+
+void MainWindow::setTerrainFile(const QString& path, bool quantized)
+{
+    ui->mainView->setTerrainFile(path, quantized);
+}
+
 // --- Functions that listen for widget events
 // forewards to the mainview
 
@@ -17,6 +17,13 @@ public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
+    void setTerrainSeed(quint64 seed);
+    void setInfiniteTerrain(bool enabled);
+    void setHeightmapTerrain(bool enabled);
+    void setLevelOfDetail(bool enabled);
+    void setTerrainDetail(unsigned detail);
+    void setTerrainFile(const QString& path, bool quantized);
+
 private slots:
     void on_ResetRotationButton_clicked(bool checked);
     void on_RotationDialX_sliderMoved(int value);
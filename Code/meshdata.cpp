@@ -0,0 +1,111 @@
+#include "meshdata.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <limits>
+
+void MeshData::compress(const VertexTolerance& tolerance) {
+    if (compactVertices(vertices, tolerance, compact)) {
+        // the memory is kept, for meshes that are built again
+        vertices.clear();
+
+        // the positions may move by the tolerance
+        QVector3D padding(tolerance.position, tolerance.position, tolerance.position);
+        for (BoundingBox& block : blockBounds) {
+            block.min -= padding;
+            block.max += padding;
+        }
+    } else {
+        compact.vertices.clear();
+    }
+}
+
+/**
+ * @brief triangleTangent
+ *
+ * Calculates the tangent of the triangle starting at indices[i]
+ */
+static QVector3D triangleTangent(const std::vector<vertex>& vertices, const std::vector<GLuint>& indices, size_t i) {
+    // get the indices of the triangle
+    unsigned i0 = indices[i + 0];
+    unsigned i1 = indices[i + 1];
+    unsigned i2 = indices[i + 2];
+
+    // get the vertex position and UV coordinate edges of the triangle
+    QVector3D pEdge1 = vertices[i1].getPosition() - vertices[i0].getPosition();
+    QVector3D pEdge2 = vertices[i2].getPosition() - vertices[i0].getPosition();
+    QVector2D tEdge1 = vertices[i1].getUV() - vertices[i0].getUV();
+    QVector2D tEdge2 = vertices[i2].getUV() - vertices[i0].getUV();
+
+    // calculate UV edge matrix determinant
+    float det = tEdge1.x() * tEdge2.y() - tEdge1.y() * tEdge2.x();
+
+    // Had an issue where det would be 0 on the cat model. This code
+    // should solve the issue of (+- inf, +- inf, +- inf) tangents
+    if (det < 0.00001f && det > 0) {
+        det = 0.00001f;
+    } else if (det > -0.00001f && det < 0.00001f) {
+        det = -0.00001f;
+    }
+
+    // calculate the tangent
+    QVector3D tangent = (pEdge1 * tEdge2.y() - pEdge2 * tEdge1.y()) / det;
+    tangent.normalize();
+
+    return tangent;
+}
+
+void MeshData::calculateTangents(std::vector<vertex>& vertices, const std::vector<GLuint>& indices) {
+    const unsigned noTriangle = std::numeric_limits<unsigned>::max();
+
+    // A vertex shared by several triangles gets the tangent of the last
+    // of them. Find that triangle for every vertex first, so the vertices
+    // can be written in parallel bands without any two bands sharing one.
+    std::vector<unsigned> lastTriangle(vertices.size(), noTriangle);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        unsigned triangle = static_cast<unsigned>(i / 3);
+        lastTriangle[indices[i + 0]] = triangle;
+        lastTriangle[indices[i + 1]] = triangle;
+        lastTriangle[indices[i + 2]] = triangle;
+    }
+
+    unsigned vertexCount = static_cast<unsigned>(vertices.size());
+    ThreadPool::global().parallelFor(0, vertexCount, [&](unsigned begin, unsigned end) {
+        for (unsigned v = begin; v < end; v++) {
+            if (lastTriangle[v] == noTriangle) {
+                continue;
+            }
+
+            QVector3D tangent = triangleTangent(vertices, indices, size_t(lastTriangle[v]) * 3);
+
+            // set the tangent of the vertex in the std::vector
+            vertices[v].tx = tangent.x();
+            vertices[v].ty = tangent.y();
+            vertices[v].tz = tangent.z();
+        }
+    }, 4096);
+}
+
+void MeshData::unitize(std::vector<vertex>& vertices) {
+    if (vertices.empty()) {
+        return;
+    }
+
+    QVector3D min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    QVector3D max(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+
+    for (const vertex& v : vertices) {
+        min = QVector3D(std::min(min.x(), v.x), std::min(min.y(), v.y), std::min(min.z(), v.z));
+        max = QVector3D(std::max(max.x(), v.x), std::max(max.y(), v.y), std::max(max.z(), v.z));
+    }
+
+    QVector3D want = (max - min) / 2.0f;
+    QVector3D move = -min - want;
+    float scale = std::min(1.0f / want.x(), std::min(1.0f / want.y(), 1.0f / want.z()));
+
+    for (vertex& v : vertices) {
+        v.x = (v.x + move.x()) * scale;
+        v.y = (v.y + move.y()) * scale;
+        v.z = (v.z + move.z()) * scale;
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef MESHDATA_H
+#define MESHDATA_H
+
+#include <QVector2D>
+
+#include <algorithm>
+#include <vector>
+
+#include "vertex.h"
+#include "vertexformat.h"
+#include "frustum.h"
+
+/**
+ * Grids are drawn and culled in square blocks of at most this many quads per side
+ */
+constexpr unsigned GRID_BLOCK_QUADS = 64;
+
+/**
+ * @brief getGridBlockQuads
+ *
+ * Quads per side of the blocks of a grid of size by size vertices. The
+ * last blocks of a row are smaller if the grid doesn't divide evenly.
+ */
+inline unsigned getGridBlockQuads(unsigned size) { return std::min(GRID_BLOCK_QUADS, size - 1); }
+
+/**
+ * @brief The MeshData struct
+ *
+ * CPU-side vertices and indices of a mesh. Unlike ModelData, this can be
+ * built on any thread, and is turned into a ModelData on the GL thread.
+ */
+struct MeshData {
+    std::vector<vertex> vertices;
+    std::vector<GLuint> indices;
+
+    // Regular grids of gridSize by gridSize vertices have no indices of
+    // their own, they are drawn with the shared GridTopology instead
+    unsigned gridSize = 0;
+
+    // Grids can also be uploaded as a height texture instead of vertices,
+    // the terrain vertex shader then builds the vertices from gl_VertexID.
+    // The heights are row-major, normals holds the x and z component of
+    // every normal (or nothing, to compute the normals in the shader).
+    std::vector<GLfloat> heights;
+    std::vector<GLshort> normals;
+    QVector2D uvOffset;
+
+    // the vertices in the compact format, if compress() found it accurate enough
+    CompactVertices compact;
+
+    // the model space bounds of the GridTopology blocks of a grid, row-major
+    std::vector<BoundingBox> blockBounds;
+
+    /**
+     * @brief compress
+     *
+     * Replaces the vertices by compact ones, if they are within the
+     * tolerance. This is done off the GL thread, so uploading stays cheap.
+     * The vectors keep their memory, for meshes that are built again.
+     */
+    void compress(const VertexTolerance& tolerance = getVertexTolerance());
+
+    /**
+     * @brief calculateTangents
+     *
+     * Sets the tangent of every vertex of a triangle list from the
+     * positions and uvs of the last triangle using it
+     */
+    static void calculateTangents(std::vector<vertex>& vertices, const std::vector<GLuint>& indices);
+
+    /**
+     * @brief unitize
+     *
+     * Moves and scales vertices like Model::unitize, so their bounds are
+     * centred on the origin and the longest side goes from -1 to 1
+     */
+    static void unitize(std::vector<vertex>& vertices);
+};
+
+#endif // MESHDATA_H
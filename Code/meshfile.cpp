@@ -0,0 +1,245 @@
+#include "meshfile.h"
+
+#include <QDebug>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const char MAGIC[8] = { 'M', 'E', 'S', 'H', 'F', 'I', 'L', 'E' };
+
+const uint64_t PRIME1 = 0x9e3779b185ebca87ull;
+const uint64_t PRIME2 = 0xc2b2ae3d27d4eb4full;
+
+inline uint64_t alignUp(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+inline uint64_t rotateLeft(uint64_t value, unsigned bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// the finalizer of MurmurHash3, every input bit affects every output bit
+inline uint64_t mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdull;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+/**
+ * @brief hashBytes
+ *
+ * A 64-bit hash in the style of xxHash: four independent lanes take a word
+ * each per 32 bytes, so the multiplications overlap and the hash runs at
+ * several GB/s. Good for noticing changed files, not against tampering.
+ */
+uint64_t hashBytes(const uchar *data, size_t size) {
+    uint64_t lanes[4] = { PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1 };
+
+    size_t blocks = size / 32;
+    for (size_t block = 0; block < blocks; block++) {
+        for (unsigned k = 0; k < 4; k++) {
+            uint64_t word;
+            std::memcpy(&word, data + block * 32 + k * 8, sizeof(word));
+            lanes[k] = rotateLeft(lanes[k] + word * PRIME2, 31) * PRIME1;
+        }
+    }
+
+    uint64_t hash = size;
+    for (uint64_t lane : lanes) {
+        hash = (hash ^ mix(lane)) * PRIME1;
+    }
+
+    // the last bytes, up to 31
+    for (size_t i = blocks * 32; i < size; i += 8) {
+        uint64_t word = 0;
+        std::memcpy(&word, data + i, std::min<size_t>(8, size - i));
+        hash = rotateLeft(hash ^ (word * PRIME2), 27) * PRIME1;
+    }
+
+    return mix(hash);
+}
+
+} // namespace
+
+MeshFile::MeshFile() :
+        data(nullptr), header(nullptr) {
+}
+
+MeshFile::~MeshFile() {
+    if (data != nullptr) {
+        file.unmap(const_cast<uchar *>(data));
+    }
+}
+
+uint32_t MeshFile::getVertexSize(VertexFormat format) {
+    return format == VertexFormat::Compact ? sizeof(CompactVertex) : sizeof(vertex);
+}
+
+std::shared_ptr<const MeshFile> MeshFile::open(const QString& path) {
+    std::shared_ptr<MeshFile> mesh(new MeshFile());
+    mesh->file.setFileName(path);
+
+    if (!mesh->file.open(QIODevice::ReadOnly)) {
+        qWarning() << ":: Can't open mesh file" << path << ":" << mesh->file.errorString();
+        return nullptr;
+    }
+
+    qint64 fileSize = mesh->file.size();
+    if (fileSize < qint64(sizeof(Header))) {
+        qWarning() << ":: Mesh file" << path << "is too small";
+        return nullptr;
+    }
+
+    mesh->data = mesh->file.map(0, fileSize);
+    if (mesh->data == nullptr) {
+        qWarning() << ":: Can't map mesh file" << path << ":" << mesh->file.errorString();
+        return nullptr;
+    }
+
+    // the buffers are only pointed at once the header is known to describe them.
+    // The counts are 32-bit, so the sizes can't overflow, and the offsets are
+    // compared by subtracting from the file size, so they can't wrap around.
+    const Header *header = reinterpret_cast<const Header *>(mesh->data);
+    uint64_t size = uint64_t(fileSize);
+    uint64_t vertexBytes = uint64_t(header->vertexCount) * header->vertexSize;
+    uint64_t indexBytes = uint64_t(header->indexCount) * sizeof(GLuint);
+
+    bool valid = std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 && header->version == VERSION &&
+            header->format <= uint32_t(VertexFormat::Compact) &&
+            header->vertexSize == getVertexSize(static_cast<VertexFormat>(header->format)) &&
+            header->fileSize == size &&
+            header->verticesOffset % BUFFER_ALIGNMENT == 0 && header->verticesOffset >= sizeof(Header) &&
+            header->verticesOffset <= size && vertexBytes <= size - header->verticesOffset &&
+            header->indicesOffset % BUFFER_ALIGNMENT == 0 && header->indicesOffset <= size &&
+            header->indicesOffset >= header->verticesOffset && header->indicesOffset - header->verticesOffset >= vertexBytes &&
+            indexBytes <= size - header->indicesOffset;
+
+    // the indices go to the GPU as they are, so every one has to be a vertex
+    if (valid) {
+        const GLuint *indices = reinterpret_cast<const GLuint *>(mesh->data + header->indicesOffset);
+        GLuint largest = 0;
+        for (uint32_t i = 0; i < header->indexCount; i++) {
+            largest = std::max(largest, indices[i]);
+        }
+
+        valid = header->indexCount == 0 || largest < header->vertexCount;
+    }
+
+    if (!valid) {
+        qWarning() << ":: File" << path << "is not a valid mesh file";
+        return nullptr;
+    }
+
+    mesh->header = header;
+
+    MeshFileInfo& info = mesh->info;
+    info.sourceHash = header->sourceHash;
+    info.sourceSize = header->sourceSize;
+    info.weldEpsilon = header->weldEpsilon;
+    info.tolerance.position = header->positionTolerance;
+    info.tolerance.normal = header->normalTolerance;
+    info.tolerance.tangent = header->tangentTolerance;
+    info.tolerance.uv = header->uvTolerance;
+    info.order.vertexCache = header->vertexCacheOrder != 0;
+    info.order.overdrawThreshold = header->overdrawThreshold;
+    info.format = static_cast<VertexFormat>(header->format);
+    info.uvScale = QVector2D(header->uvScale[0], header->uvScale[1]);
+    info.uvBias = QVector2D(header->uvBias[0], header->uvBias[1]);
+
+    return mesh;
+}
+
+bool MeshFile::write(const QString& path, const MeshFileInfo& info, const void *vertices, size_t vertexCount,
+                     const GLuint *indices, size_t indexCount) {
+    uint32_t vertexSize = getVertexSize(info.format);
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.format = static_cast<uint32_t>(info.format);
+    header.sourceHash = info.sourceHash;
+    header.sourceSize = info.sourceSize;
+    header.weldEpsilon = info.weldEpsilon;
+    header.positionTolerance = info.tolerance.position;
+    header.normalTolerance = info.tolerance.normal;
+    header.tangentTolerance = info.tolerance.tangent;
+    header.uvTolerance = info.tolerance.uv;
+    header.vertexCacheOrder = info.order.vertexCache ? 1 : 0;
+    header.overdrawThreshold = info.order.overdrawThreshold;
+    header.uvScale[0] = info.uvScale.x();
+    header.uvScale[1] = info.uvScale.y();
+    header.uvBias[0] = info.uvBias.x();
+    header.uvBias[1] = info.uvBias.y();
+    header.vertexSize = vertexSize;
+    header.vertexCount = static_cast<uint32_t>(vertexCount);
+    header.indexCount = static_cast<uint32_t>(indexCount);
+    header.verticesOffset = alignUp(sizeof(Header), BUFFER_ALIGNMENT);
+    header.indicesOffset = alignUp(header.verticesOffset + uint64_t(vertexCount) * vertexSize, BUFFER_ALIGNMENT);
+    header.fileSize = header.indicesOffset + uint64_t(indexCount) * sizeof(GLuint);
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << ":: Can't write mesh file" << path << ":" << file.errorString();
+        return false;
+    }
+
+    // the buffers are written as they are, only the padding is copied
+    std::vector<char> padding(header.verticesOffset, 0);
+    std::memcpy(padding.data(), &header, sizeof(header));
+    file.write(padding.data(), qint64(padding.size()));
+    file.write(static_cast<const char *>(vertices), qint64(vertexCount * vertexSize));
+
+    padding.assign(header.indicesOffset - (header.verticesOffset + uint64_t(vertexCount) * vertexSize), 0);
+    file.write(padding.data(), qint64(padding.size()));
+    file.write(reinterpret_cast<const char *>(indices), qint64(indexCount * sizeof(GLuint)));
+
+    if (!file.commit()) {
+        qWarning() << ":: Can't write mesh file" << path << ":" << file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool MeshFile::hashSource(const QString& path, uint64_t& hash, uint64_t& size) {
+    QFile source(path);
+    if (!source.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    size = uint64_t(source.size());
+    if (size == 0) {
+        hash = hashBytes(nullptr, 0);
+        return true;
+    }
+
+    uchar *mapping = source.map(0, qint64(size));
+    if (mapping == nullptr) {
+        return false;
+    }
+
+    hash = hashBytes(mapping, size_t(size));
+    source.unmap(mapping);
+    return true;
+}
+
+QString MeshFile::getPath(const QString& sourcePath) {
+    return sourcePath + ".mesh";
+}
+
+bool MeshFile::isBuiltWith(const MeshFileInfo& other) const {
+    return info.sourceHash == other.sourceHash && info.sourceSize == other.sourceSize &&
+           info.weldEpsilon == other.weldEpsilon &&
+           info.tolerance.position == other.tolerance.position && info.tolerance.normal == other.tolerance.normal &&
+           info.tolerance.tangent == other.tolerance.tangent && info.tolerance.uv == other.tolerance.uv &&
+           info.order.vertexCache == other.order.vertexCache &&
+           info.order.overdrawThreshold == other.order.overdrawThreshold;
+}
@@ -0,0 +1,155 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include "triangleorder.h"
+#include "vertexformat.h"
+
+#include <QFile>
+#include <QString>
+#include <QVector2D>
+
+#include <cstdint>
+#include <memory>
+
+/**
+ * What a mesh file records about its mesh: the source it was built from,
+ * how it was built, and how its vertices are stored
+ */
+struct MeshFileInfo {
+    // the content hash and size of the source file, see MeshFile::hashSource
+    uint64_t sourceHash = 0;
+    uint64_t sourceSize = 0;
+
+    // the weld epsilon of the Model, and the tolerance the vertices were compacted with
+    float weldEpsilon = 0.0f;
+    VertexTolerance tolerance;
+
+    // how the triangles were reordered
+    TriangleOrder order;
+
+    VertexFormat format = VertexFormat::Full;
+
+    // of compact vertices
+    QVector2D uvScale = QVector2D(1, 1);
+    QVector2D uvBias = QVector2D(0, 0);
+};
+
+/**
+ * @brief The MeshFile class
+ *
+ * A model in the form it is uploaded in: its vertex buffer, in the full or
+ * the compact format, and its index buffer. ModelData writes one next to
+ * every OBJ file it loads, and later loads of the same OBJ upload the
+ * buffers straight from the mapping of the mesh file, instead of parsing,
+ * welding, unitizing, calculating tangents and reordering the triangles
+ * again.
+ *
+ * The file holds a header, followed by the vertices and the indices, each
+ * starting on a cache line boundary. All values are stored little-endian,
+ * with the layout of the structs below.
+ */
+class MeshFile {
+
+public:
+    /**
+     * @brief open
+     *
+     * Maps a mesh file. Returns nullptr if the file can't be mapped or is
+     * not a valid mesh file of this version, which includes indices that
+     * are not below the vertex count, so open reads the indices once.
+     */
+    static std::shared_ptr<const MeshFile> open(const QString& path);
+
+    /**
+     * @brief write
+     *
+     * Writes a mesh file, replacing it atomically
+     *
+     * @param vertices vertexCount vertices of info.format
+     * @param indices indexCount indices into the vertices
+     * @return whether the file was written
+     */
+    static bool write(const QString& path, const MeshFileInfo& info, const void *vertices, size_t vertexCount,
+                      const GLuint *indices, size_t indexCount);
+
+    /**
+     * @brief hashSource
+     *
+     * Hashes the contents of a source file, so a mesh file can be checked
+     * against it. Much faster than parsing the file.
+     *
+     * @return false if the file can't be read
+     */
+    static bool hashSource(const QString& path, uint64_t& hash, uint64_t& size);
+
+    // where the mesh file of a source file is kept, next to it
+    static QString getPath(const QString& sourcePath);
+
+    ~MeshFile();
+
+    MeshFile(const MeshFile&) = delete;
+    MeshFile& operator=(const MeshFile&) = delete;
+
+    inline const MeshFileInfo& getInfo() const { return info; }
+
+    /**
+     * @brief isBuiltWith
+     *
+     * Whether the mesh was built from the source and with the settings of
+     * info, so it can be used instead of building the mesh again
+     */
+    bool isBuiltWith(const MeshFileInfo& info) const;
+
+    // the vertices in the format of getInfo(), straight from the mapping
+    inline const void *getVertices() const { return data + header->verticesOffset; }
+    inline size_t getVertexCount() const { return header->vertexCount; }
+    inline size_t getVertexBytes() const { return size_t(header->vertexCount) * header->vertexSize; }
+
+    inline const GLuint *getIndices() const { return reinterpret_cast<const GLuint *>(data + header->indicesOffset); }
+    inline size_t getIndexCount() const { return header->indexCount; }
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t format;
+        uint64_t sourceHash;
+        uint64_t sourceSize;
+        float weldEpsilon;
+        float positionTolerance;
+        float normalTolerance;
+        float tangentTolerance;
+        float uvTolerance;
+        uint32_t vertexCacheOrder;
+        float overdrawThreshold;
+        float uvScale[2];
+        float uvBias[2];
+        uint32_t vertexSize;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint64_t verticesOffset;
+        uint64_t indicesOffset;
+        uint64_t fileSize;
+    };
+
+    static constexpr uint32_t VERSION = 2;
+
+    // the buffers start on cache line boundaries
+    static constexpr uint64_t BUFFER_ALIGNMENT = 64;
+
+    MeshFile();
+
+    // the bytes of one vertex of a format
+    static uint32_t getVertexSize(VertexFormat format);
+
+    QFile file;
+    const uchar *data;
+
+    const Header *header;
+    MeshFileInfo info;
+
+};
+
+typedef std::shared_ptr<const MeshFile> MeshFilePtr;
+
+#endif // MESHFILE_H
@@ -0,0 +1,155 @@
+#include "noisegrid.h"
+#include "objparser.h"
+#include "terrainpipeline.h"
+#include "threadpool.h"
+#include "triangleorder.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+/**
+ * What is reported of every mesh
+ */
+struct StatsSettings {
+    unsigned cacheSize = 16;
+    float overdrawThreshold = 1.05f;
+};
+
+void printStats(const char *name, const VertexCacheStats& stats, const VertexCacheStats& input, double milliseconds) {
+    double saved = input.transformed > 0 ? 100.0 * (1.0 - double(stats.transformed) / input.transformed) : 0.0;
+
+    std::printf("  %-10s ACMR %6.3f   ATVR %6.3f   %12zu vertex shader invocations", name,
+                stats.acmr, stats.atvr, stats.transformed);
+
+    // the input itself is not timed
+    if (milliseconds >= 0.0) {
+        std::printf(" (%+6.1f%%) in %9.2f ms", -saved, milliseconds);
+    }
+    std::printf("\n");
+}
+
+/**
+ * @brief reportMesh
+ *
+ * Prints the cache statistics of the triangle list in its own order, after
+ * optimizeVertexCache and after optimizeOverdraw, the way ModelData
+ * reorders it before uploading it
+ */
+void reportMesh(const QString& name, const std::vector<vertex>& vertices, std::vector<GLuint> indices,
+                const StatsSettings& settings) {
+    std::printf("%s: %zu vertices, %zu triangles, FIFO cache of %u vertices\n", qPrintable(name), vertices.size(),
+                indices.size() / 3, settings.cacheSize);
+
+    VertexCacheStats input = analyzeVertexCache(indices, vertices.size(), settings.cacheSize);
+    printStats("input", input, input, -1.0);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    optimizeVertexCache(indices, vertices.size());
+    auto end = std::chrono::high_resolution_clock::now();
+
+    printStats("cache", analyzeVertexCache(indices, vertices.size(), settings.cacheSize), input,
+               std::chrono::duration<double, std::milli>(end - start).count());
+
+    if (settings.overdrawThreshold > 0.0f) {
+        start = std::chrono::high_resolution_clock::now();
+        optimizeOverdraw(indices, vertices, settings.overdrawThreshold);
+        end = std::chrono::high_resolution_clock::now();
+
+        printStats("overdraw", analyzeVertexCache(indices, vertices.size(), settings.cacheSize), input,
+                   std::chrono::duration<double, std::milli>(end - start).count());
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("meshstats");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Reports the average cache miss ratio (ACMR, vertex shader invocations per "
+                                     "triangle) and the average transform to vertex ratio (ATVR, per vertex) of "
+                                     "meshes, before and after their triangles are reordered.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("files", "OBJ files to report on.", "[files...]");
+
+    QCommandLineOption cacheSizeOption("cache-size", "Vertices in the simulated FIFO cache.", "vertices", "16");
+    parser.addOption(cacheSizeOption);
+
+    QCommandLineOption thresholdOption("overdraw-threshold",
+            "How much worse the overdraw clusters may use the cache, 0 skips them.", "factor", "1.05");
+    parser.addOption(thresholdOption);
+
+    QCommandLineOption weldEpsilonOption("weld-epsilon", "Weld epsilon the OBJ files are loaded with.", "epsilon", "0");
+    parser.addOption(weldEpsilonOption);
+
+    QCommandLineOption gridDetailOption("grid-detail",
+            "Also report a generated terrain grid of 2^detail + 1 vertices, as a row-major triangle list.", "detail");
+    parser.addOption(gridDetailOption);
+
+    QCommandLineOption threadsOption("threads", "Number of threads the OBJ files are parsed on (0 = hardware threads).",
+                                     "threads", "0");
+    parser.addOption(threadsOption);
+
+    parser.process(a);
+
+    StatsSettings settings;
+    settings.cacheSize = std::max(3u, parser.value(cacheSizeOption).toUInt());
+    settings.overdrawThreshold = parser.value(thresholdOption).toFloat();
+    float weldEpsilon = parser.value(weldEpsilonOption).toFloat();
+
+    bool threadsValid = false;
+    unsigned threads = parser.value(threadsOption).toUInt(&threadsValid);
+    if (!threadsValid) {
+        std::fprintf(stderr, "The thread count must be a number, 0 for one per hardware thread\n");
+        return 1;
+    }
+
+    ThreadPool::setGlobalThreadCount(threads);
+
+    QStringList files = parser.positionalArguments();
+    if (files.isEmpty() && !parser.isSet(gridDetailOption)) {
+        std::fprintf(stderr, "Give OBJ files or --grid-detail\n");
+        return 1;
+    }
+
+    bool failed = false;
+
+    for (const QString& file : files) {
+        MeshData mesh = loadObjMesh(file, weldEpsilon);
+        if (mesh.vertices.empty()) {
+            std::fprintf(stderr, "Can't read %s\n", qPrintable(file));
+            failed = true;
+            continue;
+        }
+
+        reportMesh(QFileInfo(file).fileName(), mesh.vertices, std::move(mesh.indices), settings);
+    }
+
+    if (parser.isSet(gridDetailOption)) {
+        unsigned detail = parser.value(gridDetailOption).toUInt();
+        if (detail < 1 || detail > 13) {
+            std::fprintf(stderr, "The grid detail must be between 1 and 13\n");
+            return 1;
+        }
+
+        // the terrain of the viewer, so the overdraw clusters see its hills
+        NoiseGrid grid(detail);
+        grid.add(sumStages(SpikeStage(-2, 1, std::min(3u, detail)),
+                           OctavesStage(detail > 4 ? detail - 4 : 1, 1.0f, std::min(4u, detail - 1), 1)));
+        MeshData mesh = grid.createMeshData();
+
+        reportMesh(QString("grid of detail %1").arg(detail), mesh.vertices, createGridTriangles(mesh.gridSize),
+                   settings);
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# Reports how well the index buffers of OBJ files and
+# terrain grids use the post-transform vertex cache,
+# before and after their triangles are reordered
+#
+#-------------------------------------------------
+
+QT       += core gui
+QT       -= widgets
+
+TARGET = meshstats
+TEMPLATE = app
+CONFIG += c++14 console
+CONFIG -= app_bundle
+
+include(../generation.pri)
+
+SOURCES += main.cpp \
+    ../objparser.cpp
+
+HEADERS += ../objparser.h
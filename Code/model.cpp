@@ -1,76 +1,28 @@
 #include "model.h"
 
 #include <QDebug>
-#include <QFile>
-#include <QTextStream>
 
+#include <algorithm>
 #include <limits>
+#include <vector>
 
-// A Private Vertex class for vertex comparison
-// DO NOT include "vertex.h" or something similar in this file
-struct Vertex {
-
-    QVector3D coord;
-    QVector3D normal;
-    QVector2D texCoord;
-
-    Vertex() : coord(), normal(), texCoord(){}
-    Vertex(QVector3D coords, QVector3D normal, QVector3D texc): coord(coords), normal(normal), texCoord(texc){}
-
-    bool operator==(const Vertex &other) const {
-        if (other.coord != coord)
-                return false;
-        if (other.normal != normal)
-            return false;
-        if (other.texCoord != texCoord)
-            return false;
-        return true;
-    }
-};
-
-Model::Model(QString filename) {
+Model::Model(QString filename, float weldEpsilon) {
     hNorms = false;
     hTexs = false;
 
     qDebug() << ":: Loading model:" << filename;
-    QFile file(filename);
-    if(file.open(QIODevice::ReadOnly)) {
-        QTextStream in(&file);
-
-        QString line;
-        QStringList tokens;
-
-        while(!in.atEnd()) {
-            line = in.readLine();
-            if (line.startsWith("#")) continue; // skip comments
-
-            tokens = line.split(" ", QString::SkipEmptyParts);
-
-            // Switch depending on first element
-            if (tokens[0] == "v") {
-                parseVertex(tokens);
-            }
-
-            if (tokens[0] == "vn" ) {
-                parseNormal(tokens);
-            }
-
-            if (tokens[0] == "vt" ) {
-                parseTexture(tokens);
-            }
-
-            if (tokens[0] == "f" ) {
-                parseFace(tokens);
-            }
-        }
 
-        file.close();
+    // indices out of range leave the model empty
+    ObjData data;
+    if (parseObj(filename, data) && checkObjIndices(data)) {
+        hNorms = !data.normals.empty() && data.normalIndices.size() == data.positionIndices.size();
+        hTexs = !data.textureCoords.empty() && data.textureCoordIndices.size() == data.positionIndices.size();
 
         // create an array version of the data
-        unpackIndexes();
+        unpackIndexes(data);
 
         // Allign all vertex indices with the right normal/texturecoord indices
-        alignData();
+        alignData(data, weldEpsilon);
     }
 }
 
@@ -164,74 +116,80 @@ QVector<unsigned>  Model::getIndices() {
 }
 
 QVector<float> Model::getVNInterleaved() {
-    QVector<float> buffer;
+    QVector<float> buffer(vertices.size() * 6);
+    float *out = buffer.data();
 
     for (int i = 0; i != vertices.size(); ++i) {
-        QVector3D vertex = vertices.at(i);
-        QVector3D normal = normals.at(i);
-        buffer.append(vertex.x());
-        buffer.append(vertex.y());
-        buffer.append(vertex.z());
-        buffer.append(normal.x());
-        buffer.append(normal.y());
-        buffer.append(normal.z());
+        const QVector3D& vertex = vertices.at(i);
+        const QVector3D& normal = normals.at(i);
+        *out++ = vertex.x();
+        *out++ = vertex.y();
+        *out++ = vertex.z();
+        *out++ = normal.x();
+        *out++ = normal.y();
+        *out++ = normal.z();
     }
 
     return buffer;
 }
 
 QVector<float> Model::getVNTInterleaved() {
-    QVector<float> buffer;
+    QVector<float> buffer(vertices.size() * 8);
+    float *out = buffer.data();
 
     for (int i = 0; i != vertices.size(); ++i) {
-        QVector3D vertex = vertices.at(i);
-        QVector3D normal = normals.at(i);
-        QVector2D uv = textureCoords.at(i);
-        buffer.append(vertex.x());
-        buffer.append(vertex.y());
-        buffer.append(vertex.z());
-        buffer.append(normal.x());
-        buffer.append(normal.y());
-        buffer.append(normal.z());
-        buffer.append(uv.x());
-        buffer.append(uv.y());
+        const QVector3D& vertex = vertices.at(i);
+        const QVector3D& normal = normals.at(i);
+        *out++ = vertex.x();
+        *out++ = vertex.y();
+        *out++ = vertex.z();
+        *out++ = normal.x();
+        *out++ = normal.y();
+        *out++ = normal.z();
+
+        const QVector2D& uv = textureCoords.at(i);
+        *out++ = uv.x();
+        *out++ = uv.y();
     }
 
     return buffer;
 }
 
 QVector<float> Model::getVNInterleaved_indexed() {
-    QVector<float> buffer;
+    QVector<float> buffer(vertices_indexed.size() * 6);
+    float *out = buffer.data();
 
     for (int i = 0; i != vertices_indexed.size(); ++i) {
-        QVector3D vertex = vertices_indexed.at(i);
-        QVector3D normal = normals_indexed.at(i);
-        buffer.append(vertex.x());
-        buffer.append(vertex.y());
-        buffer.append(vertex.z());
-        buffer.append(normal.x());
-        buffer.append(normal.y());
-        buffer.append(normal.z());
+        const QVector3D& vertex = vertices_indexed.at(i);
+        const QVector3D& normal = normals_indexed.at(i);
+        *out++ = vertex.x();
+        *out++ = vertex.y();
+        *out++ = vertex.z();
+        *out++ = normal.x();
+        *out++ = normal.y();
+        *out++ = normal.z();
     }
 
     return buffer;
 }
 
 QVector<float> Model::getVNTInterleaved_indexed() {
-    QVector<float> buffer;
+    QVector<float> buffer(vertices_indexed.size() * 8);
+    float *out = buffer.data();
 
     for (int i = 0; i != vertices_indexed.size(); ++i) {
-        QVector3D vertex = vertices_indexed.at(i);
-        QVector3D normal = normals_indexed.at(i);
-        QVector2D uv = textureCoords_indexed.at(i);
-        buffer.append(vertex.x());
-        buffer.append(vertex.y());
-        buffer.append(vertex.z());
-        buffer.append(normal.x());
-        buffer.append(normal.y());
-        buffer.append(normal.z());
-        buffer.append(uv.x());
-        buffer.append(uv.y());
+        const QVector3D& vertex = vertices_indexed.at(i);
+        const QVector3D& normal = normals_indexed.at(i);
+        *out++ = vertex.x();
+        *out++ = vertex.y();
+        *out++ = vertex.z();
+        *out++ = normal.x();
+        *out++ = normal.y();
+        *out++ = normal.z();
+
+        const QVector2D& uv = textureCoords_indexed.at(i);
+        *out++ = uv.x();
+        *out++ = uv.y();
     }
 
     return buffer;
@@ -250,109 +208,34 @@ int Model::getNumTriangles() {
     return vertices.size()/3;
 }
 
-void Model::parseVertex(QStringList tokens) {
-    float x,y,z;
-    x = tokens[1].toFloat();
-    y = tokens[2].toFloat();
-    z = tokens[3].toFloat();
-    vertices_indexed.append(QVector3D(x,y,z));
-}
-
-void Model::parseNormal(QStringList tokens) {
-    hNorms = true;
-    float x,y,z;
-    x = tokens[1].toFloat();
-    y = tokens[2].toFloat();
-    z = tokens[3].toFloat();
-    norm.append(QVector3D(x,y,z));
-}
-
-void Model::parseTexture(QStringList tokens) {
-    hTexs = true;
-    float u,v;
-    u = tokens[1].toFloat();
-    v = tokens[2].toFloat();
-    tex.append(QVector2D(u,v));
-}
-
-void Model::parseFace(QStringList tokens) {
-    QStringList elements;
-
-    for( int i = 1; i != tokens.size(); ++i ) {
-        elements = tokens[i].split("/");
-        // -1 since .obj count from 1
-        indices.append(elements[0].toInt()-1);
-
-        if ( elements.size() > 1 && ! elements[1].isEmpty() ) {
-            texcoord_indices.append(elements[1].toInt()-1);
-        }
-
-        if (elements.size() > 2 && ! elements[2].isEmpty() ) {
-            normal_indices.append(elements[2].toInt()-1);
-        }
-    }
-}
-
-
 /**
  * @brief Model::alignData
  *
  * Make sure that the indices from the vertices align with those
  * of the normals and the texture coordinates, create extra vertices
  * if vertex has multiple normals or texturecoords
+ *
+ * The corners are welded by weldObj, in linear time. The vertices keep
+ * the order in which they are first used.
  */
-void Model::alignData() {
-    QVector<QVector3D> verts = QVector<QVector3D>();
-    verts.reserve(vertices_indexed.size());
-    QVector<QVector3D> norms = QVector<QVector3D>();
-    norms.reserve(vertices_indexed.size());
-    QVector<QVector2D> texcs = QVector<QVector2D>();
-    texcs.reserve(vertices_indexed.size());
-    QVector<Vertex> vs = QVector<Vertex>();
-
-    QVector<unsigned> ind = QVector<unsigned>();
-    ind.reserve(indices.size());
-
-    unsigned currentIndex = 0;
-
-    for (int i = 0; i != indices.size(); ++i) {
-        QVector3D v = vertices_indexed[indices[i]];
-
-        QVector3D n = QVector2D(0,0);
-        if ( hNorms ) {
-            n = norm[normal_indices[i]];
-        }
+void Model::alignData(ObjData& data, float weldEpsilon) {
+    std::vector<vertex> welded;
+    if (!weldObj(data, weldEpsilon, welded)) {
+        return;
+    }
 
-        QVector2D t = QVector2D(0,0);
-        if ( hTexs ) {
-            t = tex[texcoord_indices[i]];
-        }
+    vertices_indexed.resize(int(welded.size()));
+    normals_indexed.resize(int(welded.size()));
+    textureCoords_indexed.resize(int(welded.size()));
 
-        Vertex k = Vertex(v,n,t);
-        if (vs.contains(k)) {
-            // Vertex already exists, use that index
-            ind.append(vs.indexOf(k));
-        } else {
-            // Create a new vertex
-            verts.append(v);
-            norms.append(n);
-            texcs.append(t);
-            vs.append(k);
-            ind.append(currentIndex);
-            ++currentIndex;
-        }
+    for (size_t i = 0; i < welded.size(); i++) {
+        vertices_indexed[int(i)] = welded[i].getPosition();
+        normals_indexed[int(i)] = welded[i].getNormal();
+        textureCoords_indexed[int(i)] = welded[i].getUV();
     }
-    // Remove old data
-    vertices_indexed.clear();
-    normals_indexed.clear();
-    textureCoords_indexed.clear();
-    indices.clear();
-
-    // Set the new data
-    vertices_indexed = verts;
-    normals_indexed = norms;
-    textureCoords_indexed = texcs;
-    indices = ind;
+
+    indices.resize(int(data.positionIndices.size()));
+    std::copy(data.positionIndices.begin(), data.positionIndices.end(), indices.begin());
 }
 
 /**
@@ -361,19 +244,22 @@ void Model::alignData() {
  * Unpack indices so that they are available for glDrawArrays()
  *
  */
-void Model::unpackIndexes() {
-    vertices.clear();
-    normals.clear();
-    textureCoords.clear();
-    for ( int i = 0; i != indices.size(); ++i ) {
-        vertices.append(vertices_indexed[indices[i]]);
+void Model::unpackIndexes(const ObjData& data) {
+    int corners = int(data.positionIndices.size());
+
+    vertices.resize(corners);
+    normals.resize(hNorms ? corners : 0);
+    textureCoords.resize(hTexs ? corners : 0);
+
+    for ( int i = 0; i != corners; ++i ) {
+        vertices[i] = data.positions[data.positionIndices[i]];
 
         if ( hNorms ) {
-            normals.append(norm[normal_indices[i]]);
+            normals[i] = data.normals[data.normalIndices[i]];
         }
 
         if ( hTexs ) {
-            textureCoords.append(tex[texcoord_indices[i]]);
+            textureCoords[i] = data.textureCoords[data.textureCoordIndices[i]];
         }
     }
 }
@@ -1,8 +1,9 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include "objparser.h"
+
 #include <QString>
-#include <QStringList>
 #include <QVector>
 #include <QVector2D>
 #include <QVector3D>
@@ -19,7 +20,12 @@
 class Model
 {
 public:
-    Model(QString filename);
+    /**
+     * @param weldEpsilon face corners whose position, normal and texture
+     * coordinates round to the same multiples of this share a vertex,
+     * 0 only shares exactly equal corners. In the units of the file.
+     */
+    Model(QString filename, float weldEpsilon = 0.0f);
 
     // Used for glDrawArrays()
     QVector<QVector3D> getVertices();
@@ -48,15 +54,9 @@ public:
 
 private:
 
-    // OBJ parsing
-    void parseVertex(QStringList tokens);
-    void parseNormal(QStringList tokens);
-    void parseTexture(QStringList tokens);
-    void parseFace(QStringList tokens);
-
     // Alignment of data
-    void alignData();
-    void unpackIndexes();
+    void alignData(ObjData& data, float weldEpsilon);
+    void unpackIndexes(const ObjData& data);
 
     // Intermediate storage of values
     QVector<QVector3D> vertices_indexed;
@@ -68,12 +68,6 @@ private:
     QVector<QVector3D> normals;
     QVector<QVector2D> textureCoords;
 
-    // Utility storage
-    QVector<unsigned> normal_indices;
-    QVector<unsigned> texcoord_indices;
-    QVector<QVector3D> norm;
-    QVector<QVector2D> tex;
-
     bool hNorms;
     bool hTexs;
 };
@@ -1,133 +1,445 @@
 #include "modeldata.h"
 
-#include "model.h"
+#include "meshfile.h"
+#include "objparser.h"
+#include "triangleorder.h"
+
+#include <algorithm>
+#include <limits>
 
 /**
  * @brief ModelData::ModelData
  *
  * Constructor of ModelData. This puts vertices and indices into
- * OpenGL buffers.
+ * OpenGL buffers, with the triangles reordered for the vertex cache.
  *
  * @param vertices
  * @param indices
  */
 ModelData::ModelData(const std::vector<vertex>& vertices, const std::vector<GLuint>& indices, bool shouldCalculateTangents) {
-    std::vector<vertex> v(vertices);
+    initializeOpenGLFunctions();
+
+    // the tangents depend on the order of the triangles, they are still calculated from the given one
+    std::vector<GLuint> ordered(indices);
+    orderTriangles(ordered, vertices);
 
+    // only copy the vertices when the tangents have to be filled in
     if (shouldCalculateTangents) {
-        calculateTangents(v, indices);
+        std::vector<vertex> v(vertices);
+        MeshData::calculateTangents(v, indices);
+        initializeBuffers(v, ordered);
+    } else {
+        initializeBuffers(vertices, ordered);
     }
+}
 
+/**
+ * @brief ModelData::ModelData
+ *
+ * Uploads a mesh that is already complete, including its tangents.
+ * Grids share the index buffer of their size.
+ *
+ * @param mesh
+ */
+ModelData::ModelData(const MeshData& mesh) {
     initializeOpenGLFunctions();
-    initializeBuffers(v, indices);
+
+    if (mesh.gridSize > 0) {
+        topology = GridTopology::get(mesh.gridSize);
+        setBlockBounds(mesh.blockBounds);
+    }
+
+    if (!mesh.heights.empty()) {
+        initializeHeightTextures(mesh);
+    } else if (!mesh.compact.vertices.empty()) {
+        initializeBuffers(mesh.compact, mesh.indices);
+    } else {
+        // meshes are compressed by whoever builds them
+        initializeBuffers(mesh.vertices, mesh.indices, false);
+    }
 }
 
-ModelData::ModelData(const std::string& objFile) {
-    Model model(objFile.c_str());
-    model.unitize();
+/**
+ * @brief ModelData::ModelData
+ *
+ * Uploads a terrain file as a height texture grid. The blocks are culled
+ * with the tile ranges from the file directory when the tiles have the
+ * block size of the grid topology, so no heights are read for that.
+ * Files can hold grids far larger than the GPU can draw, those are not
+ * uploaded at all, see isUploaded.
+ *
+ * @param file
+ */
+ModelData::ModelData(const TerrainFile& file) {
+    initializeOpenGLFunctions();
 
-    QVector<QVector3D> vertices = model.getVertices_indexed();
-    QVector<QVector3D> normals = model.getNormals_indexed();
-    QVector<QVector2D> textureCoordinates = model.getTextureCoords_indexed();
-    QVector<unsigned> indices = model.getIndices();
+    unsigned size = file.getGridSize();
+    if (size > unsigned(std::numeric_limits<GLsizei>::max()) || !fitsInTexture(static_cast<GLsizei>(size))) {
+        return;
+    }
 
-    std::vector<vertex> mesh_vertices;
-    std::vector<GLuint> mesh_indices;
+    if (!GridTopology::fits(size)) {
+        qWarning() << ":: A terrain of size" << size << "has more indices than can be drawn";
+        return;
+    }
 
-    for (int i = 0; i < vertices.size(); i++) {
-        mesh_vertices.push_back({
-            // position
-            vertices[i].x(), vertices[i].y(), vertices[i].z(),
+    topology = GridTopology::get(size);
 
-            // normal
-            normals[i].x(), normals[i].y(), normals[i].z(),
+    if (file.getTileQuads() == GridTopology::getBlockQuads(size)) {
+        float tileQuads = static_cast<float>(file.getTileQuads());
+        std::vector<BoundingBox> tileBounds;
 
-            // tangent (calculated later)
-            0, 0, 0,
+        for (unsigned tx = 0; tx < file.getTiles(); tx++) {
+            for (unsigned tz = 0; tz < file.getTiles(); tz++) {
+                HeightRange range = file.getTileRange(tx, tz);
+                QVector3D min(tx * tileQuads - size / 2.0f, range.min, tz * tileQuads - size / 2.0f);
+                QVector3D max(min.x() + tileQuads, range.max, min.z() + tileQuads);
 
-            // texture coordinates
-            textureCoordinates[i].x(), textureCoordinates[i].y()
-        });
-    }
+                tileBounds.push_back({ min, max });
+            }
+        }
 
-    for (auto& i : indices) {
-        mesh_indices.push_back(i);
+        setBlockBounds(tileBounds);
     }
 
-    // calculate the tangent vectors
-    calculateTangents(mesh_vertices, mesh_indices);
+    initializeHeightTextures(file);
+}
 
-    // initialize everything
+/**
+ * @brief ModelData::ModelData
+ *
+ * Loads an OBJ file. The buffers are also written to the mesh file next
+ * to it, and as long as the OBJ file and the settings stay the same,
+ * later loads upload the buffers straight from that mesh file.
+ *
+ * @param objFile
+ * @param weldEpsilon see Model
+ */
+ModelData::ModelData(const std::string& objFile, float weldEpsilon) {
     initializeOpenGLFunctions();
-    initializeBuffers(mesh_vertices, mesh_indices);
+
+    QString path(objFile.c_str());
+    QString meshPath = MeshFile::getPath(path);
+
+    MeshFileInfo info;
+    info.weldEpsilon = weldEpsilon;
+    info.tolerance = getVertexTolerance();
+    info.order = getTriangleOrder();
+    bool hashed = MeshFile::hashSource(path, info.sourceHash, info.sourceSize);
+
+    if (hashed && QFile::exists(meshPath)) {
+        MeshFilePtr cached = MeshFile::open(meshPath);
+        if (cached != nullptr && cached->isBuiltWith(info)) {
+            initializeBuffers(*cached);
+            return;
+        }
+    }
+
+    // the OBJ is welded straight into the vertices of the mesh, the only copy of them
+    MeshData mesh = loadObjMesh(path, weldEpsilon);
+
+    // a file that couldn't be loaded is drawn as nothing, and not cached
+    if (mesh.vertices.empty()) {
+        initializeBuffers(mesh.vertices, mesh.indices, false);
+        return;
+    }
+
+    MeshData::unitize(mesh.vertices);
+    MeshData::calculateTangents(mesh.vertices, mesh.indices);
+    orderTriangles(mesh.indices, mesh.vertices, info.order);
+
+    // upload, and store what was uploaded
+    CompactVertices compact;
+    if (compactVertices(mesh.vertices, info.tolerance, compact)) {
+        info.format = VertexFormat::Compact;
+        info.uvScale = compact.uvScale;
+        info.uvBias = compact.uvBias;
+
+        // the full vertices are not needed anymore
+        std::vector<vertex>().swap(mesh.vertices);
+
+        initializeBuffers(compact, mesh.indices);
+        if (hashed) {
+            MeshFile::write(meshPath, info, compact.vertices.data(), compact.vertices.size(),
+                            mesh.indices.data(), mesh.indices.size());
+        }
+    } else {
+        initializeBuffers(mesh.vertices, mesh.indices, false);
+        if (hashed) {
+            MeshFile::write(meshPath, info, mesh.vertices.data(), mesh.vertices.size(),
+                            mesh.indices.data(), mesh.indices.size());
+        }
+    }
+}
+
+void ModelData::initializeBuffers(const std::vector<vertex> &vertices, const std::vector<GLuint> &indices, bool tryCompact) {
+    // use the smallest vertex format that is accurate enough
+    CompactVertices compact;
+    if (tryCompact && compactVertices(vertices, getVertexTolerance(), compact)) {
+        initializeBuffers(compact, indices);
+        return;
+    }
+
+    format = VertexFormat::Full;
+    uvScale = QVector2D(1, 1);
+    uvBias = QVector2D(0, 0);
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+
+    glBindVertexArray(vao);
+    uploadVertices(vertices.data(), vertices.size());
+    initializeIndices(indices.data(), indices.size());
 }
 
-void ModelData::initializeBuffers(const std::vector<vertex> &vertices, const std::vector<GLuint> &indices) {
-    vertexCount = static_cast<GLsizei>(indices.size());
+void ModelData::initializeBuffers(const CompactVertices& vertices, const std::vector<GLuint>& indices) {
+    format = VertexFormat::Compact;
+    uvScale = vertices.uvScale;
+    uvBias = vertices.uvBias;
 
     glGenVertexArrays(1, &vao);
     glGenBuffers(1, &vbo);
-    glGenBuffers(1, &eab);
 
     glBindVertexArray(vao);
+    uploadVertices(vertices.vertices.data(), vertices.vertices.size());
+    initializeIndices(indices.data(), indices.size());
+}
+
+/**
+ * @brief ModelData::initializeBuffers
+ *
+ * Uploads the buffers of a mesh file straight from its mapping
+ */
+void ModelData::initializeBuffers(const MeshFile& mesh) {
+    const MeshFileInfo& info = mesh.getInfo();
+    format = info.format;
+    uvScale = info.uvScale;
+    uvBias = info.uvBias;
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+
+    glBindVertexArray(vao);
+    if (format == VertexFormat::Compact) {
+        uploadVertices(static_cast<const CompactVertex *>(mesh.getVertices()), mesh.getVertexCount());
+    } else {
+        uploadVertices(static_cast<const vertex *>(mesh.getVertices()), mesh.getVertexCount());
+    }
+
+    initializeIndices(mesh.getIndices(), mesh.getIndexCount());
+}
+
+void ModelData::initializeIndices(const GLuint *indices, size_t count) {
+    vertexCount = static_cast<GLsizei>(count);
+
+    if (topology) {
+        eab = 0;
+        topology->bind();
+    } else {
+        glGenBuffers(1, &eab);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eab);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(count * sizeof(GLuint)), indices, GL_STATIC_DRAW);
+    }
+}
 
+/**
+ * @brief ModelData::uploadVertices
+ *
+ * Uploads the vertices to the VBO, and points the attributes of the
+ * bound VAO at them as described by the layout of the vertex type.
+ */
+template<typename Vertex>
+void ModelData::uploadVertices(const Vertex *vertices, size_t count) {
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertices.size() * sizeof(vertex)), vertices.data(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eab);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices.size() * sizeof(GLuint)), indices.data(), GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glEnableVertexAttribArray(3);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (GLvoid *) 0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (GLvoid *) (3 * sizeof(GLfloat)));
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), (GLvoid *) (6 * sizeof(GLfloat)));
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (GLvoid *) (9 * sizeof(GLfloat)));
-}
-
-void ModelData::calculateTangents(std::vector<vertex>& vertices, const std::vector<GLuint>& indices) {
-   for (unsigned i = 0; i < indices.size(); i += 3) {
-        // get the indices of the triangle
-        unsigned i0 = indices[i + 0];
-        unsigned i1 = indices[i + 1];
-        unsigned i2 = indices[i + 2];
-
-        // get the vertex position and UV coordinate edges of the triangle
-        QVector3D pEdge1 = vertices[i1].getPosition() - vertices[i0].getPosition();
-        QVector3D pEdge2 = vertices[i2].getPosition() - vertices[i0].getPosition();
-        QVector2D tEdge1 = vertices[i1].getUV() - vertices[i0].getUV();
-        QVector2D tEdge2 = vertices[i2].getUV() - vertices[i0].getUV();
-
-        // calculate UV edge matrix determinant
-        float det = tEdge1.x() * tEdge2.y() - tEdge1.y() * tEdge2.x();
-
-        // Had an issue where det would be 0 on the cat model. This code
-        // should solve the issue of (+- inf, +- inf, +- inf) tangents
-        if (det < 0.00001f && det > 0) {
-            det = 0.00001f;
-        } else if (det > -0.00001f && det < 0.00001f) {
-            det = -0.00001f;
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(count * sizeof(Vertex)), vertices, GL_STATIC_DRAW);
+
+    for (const VertexAttribute& attribute : VertexLayout<Vertex>::getAttributes()) {
+        glEnableVertexAttribArray(attribute.location);
+        glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized,
+                              sizeof(Vertex), (GLvoid *) attribute.offset);
+    }
+}
+
+/**
+ * @brief ModelData::setBlockBounds
+ *
+ * Stores the bounds of the blocks of a grid, and the bounds around them
+ */
+void ModelData::setBlockBounds(const std::vector<BoundingBox>& blocks) {
+    blockBounds = blocks;
+
+    if (blockBounds.empty()) {
+        return;
+    }
+
+    bounds = blockBounds.front();
+    for (const BoundingBox& block : blockBounds) {
+        for (int i = 0; i < 3; i++) {
+            bounds.min[i] = std::min(bounds.min[i], block.min[i]);
+            bounds.max[i] = std::max(bounds.max[i], block.max[i]);
         }
+    }
+}
 
-        // calculate the tangent
-        QVector3D tangent = (pEdge1 * tEdge2.y() - pEdge2 * tEdge1.y()) / det;
-        tangent.normalize();
+/**
+ * @brief ModelData::initializeHeightTextures
+ *
+ * Uploads the heights (and normals) of a grid as textures.
+ */
+void ModelData::initializeHeightTextures(const MeshData& mesh) {
+    GLsizei size = static_cast<GLsizei>(mesh.gridSize);
+    uvOffset = mesh.uvOffset;
+    if (!createHeightTextures(size, !mesh.normals.empty())) {
+        return;
+    }
 
-        // set the tangents of the vertices in the std::vector
-        vertices[i0].tx = tangent.x();
-        vertices[i0].ty = tangent.y();
-        vertices[i0].tz = tangent.z();
+    heightTexture->bind(GL_TEXTURE_2D);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RED, GL_FLOAT, mesh.heights.data());
 
-        vertices[i1].tx = tangent.x();
-        vertices[i1].ty = tangent.y();
-        vertices[i1].tz = tangent.z();
+    if (!mesh.normals.empty()) {
+        normalTexture->bind(GL_TEXTURE_2D);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RG, GL_SHORT, mesh.normals.data());
+    }
+}
 
-        vertices[i2].tx = tangent.x();
-        vertices[i2].ty = tangent.y();
-        vertices[i2].tz = tangent.z();
+/**
+ * @brief ModelData::initializeHeightTextures
+ *
+ * Uploads the tiles of a terrain file one by one. Unquantized heights and
+ * the normals go straight from the mapping to OpenGL. Neighbouring tiles
+ * share their border texels, and the tile uploaded last wins, the one
+ * with the higher tx or tz. Unquantized tiles store the same value there,
+ * but quantized tiles each use their own height range, so the two decoded
+ * values can differ by up to a quantization step of either tile.
+ */
+void ModelData::initializeHeightTextures(const TerrainFile& file) {
+    GLsizei size = static_cast<GLsizei>(file.getGridSize());
+    GLsizei tileSize = static_cast<GLsizei>(file.getTileQuads() + 1);
+    uvOffset = QVector2D(0, 0);
+    if (!createHeightTextures(size, file.hasNormals())) {
+        return;
+    }
+
+    std::vector<float> decoded;
+    if (file.getInfo().encoding != HeightEncoding::Float32) {
+        decoded.resize(size_t(tileSize) * tileSize);
+    }
+
+    for (unsigned tx = 0; tx < file.getTiles(); tx++) {
+        for (unsigned tz = 0; tz < file.getTiles(); tz++) {
+            // a row of the grid is a row of the texture, so z is the texture x
+            GLint xOffset = static_cast<GLint>(tz * file.getTileQuads());
+            GLint yOffset = static_cast<GLint>(tx * file.getTileQuads());
+
+            const float *heights = file.getTileHeights(tx, tz);
+            if (heights == nullptr) {
+                file.readTileHeights(tx, tz, decoded.data());
+                heights = decoded.data();
+            }
+
+            heightTexture->bind(GL_TEXTURE_2D);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, xOffset, yOffset, tileSize, tileSize, GL_RED, GL_FLOAT, heights);
+
+            if (file.hasNormals()) {
+                normalTexture->bind(GL_TEXTURE_2D);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, xOffset, yOffset, tileSize, tileSize, GL_RG, GL_SHORT,
+                                file.getTileNormals(tx, tz));
+            }
+        }
+    }
+}
+
+/**
+ * @brief ModelData::fitsInTexture
+ *
+ * Whether a grid of size by size texels fits in a texture, warns if not
+ */
+bool ModelData::fitsInTexture(GLsizei size) {
+    GLint maximumSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maximumSize);
+    if (size > maximumSize) {
+        qWarning() << ":: A terrain of size" << size << "doesn't fit in a texture of at most" << maximumSize;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief ModelData::createHeightTextures
+ *
+ * Allocates the textures of a height texture grid. The VAO has no
+ * attributes, but the core profile needs one bound to draw.
+ *
+ * @return false, with nothing allocated, if the textures are too large
+ * for the GPU or could not be allocated
+ */
+bool ModelData::createHeightTextures(GLsizei size, bool withNormals) {
+    if (!fitsInTexture(size)) {
+        return false;
+    }
+
+    vertexCount = size * size;
+
+    format = VertexFormat::Full;
+    uvScale = QVector2D(1, 1);
+    uvBias = QVector2D(0, 0);
+
+    vbo = 0;
+    eab = 0;
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    topology->bind();
+
+    // every texel is fetched exactly, so there is no filtering
+    auto setParameters = [this]() {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    };
+
+    // only the errors of the allocations below matter
+    while (glGetError() != GL_NO_ERROR) {
+    }
+
+    // a row of the grid is a row of the texture
+    heightTexture = TexturePtr(new Texture());
+    heightTexture->bind(GL_TEXTURE_2D);
+    setParameters();
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, size, size, 0, GL_RED, GL_FLOAT, nullptr);
+
+    if (withNormals) {
+        normalTexture = TexturePtr(new Texture());
+        normalTexture->bind(GL_TEXTURE_2D);
+        setParameters();
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16_SNORM, size, size, 0, GL_RG, GL_SHORT, nullptr);
+    }
+
+    // e.g. GL_OUT_OF_MEMORY, the textures would be incomplete
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        qWarning() << ":: Can't allocate the height textures of size" << size << ", error" << error;
+
+        heightTexture.reset();
+        normalTexture.reset();
+        glDeleteVertexArrays(1, &vao);
+        vao = 0;
+        vertexCount = 0;
+        return false;
+    }
+
+    return true;
+}
+
+void ModelData::bindHeightTextures(GLuint heightSlot, GLuint normalSlot) {
+    glActiveTexture(GL_TEXTURE0 + heightSlot);
+    heightTexture->bind(GL_TEXTURE_2D);
+
+    if (normalTexture != nullptr) {
+        glActiveTexture(GL_TEXTURE0 + normalSlot);
+        normalTexture->bind(GL_TEXTURE_2D);
     }
 }
 
@@ -135,6 +447,7 @@ ModelData::~ModelData() {
 
     qDebug() << "ModelData destructor";
 
+    // deleting 0 is ignored, so grids don't need a special case
     glDeleteBuffers(1, &eab);
     glDeleteBuffers(1, &vbo);
     glDeleteVertexArrays(1, &vao);
@@ -147,5 +460,30 @@ ModelData::~ModelData() {
  */
 void ModelData::draw() {
     glBindVertexArray(vao);
-    glDrawElements(GL_TRIANGLES, vertexCount, GL_UNSIGNED_INT, (GLvoid *) 0);
+
+    if (topology) {
+        topology->draw();
+    } else {
+        glDrawElements(GL_TRIANGLES, vertexCount, GL_UNSIGNED_INT, (GLvoid *) 0);
+    }
+}
+
+void ModelData::draw(const Frustum& frustum, const QMatrix4x4& modelMatrix) {
+    if (!hasBounds()) {
+        draw();
+        return;
+    }
+
+    std::vector<bool> visibleBlocks(blockBounds.size());
+    bool anyVisible = false;
+
+    for (size_t block = 0; block < blockBounds.size(); block++) {
+        visibleBlocks[block] = frustum.intersects(blockBounds[block].transformed(modelMatrix));
+        anyVisible = anyVisible || visibleBlocks[block];
+    }
+
+    if (anyVisible) {
+        glBindVertexArray(vao);
+        topology->draw(visibleBlocks);
+    }
 }
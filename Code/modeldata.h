@@ -7,28 +7,89 @@
 #include <vector>
 #include <memory>
 
-#include "vertex.h"
+#include "meshdata.h"
 #include "material.h"
+#include "gridtopology.h"
+#include "texture.h"
+#include "frustum.h"
+#include "terrainfile.h"
+
+class MeshFile;
 
 class ModelData : protected QOpenGLFunctions_3_3_Core {
 
 public:
     ModelData(const std::vector<vertex>& vertices, const std::vector<GLuint>& indices, bool calculateTangents = false);
-    ModelData(const std::string& objFile);
+    ModelData(const MeshData& mesh);
+    explicit ModelData(const TerrainFile& file);
+    // weldEpsilon as for Model, before the model is unitized
+    ModelData(const std::string& objFile, float weldEpsilon = 0.0f);
     ~ModelData();
 
     void draw();
 
+    // false when a height texture grid was too large to upload, it must not be drawn then
+    inline bool isUploaded() const { return vao != 0; }
+
+    /**
+     * @brief draw
+     *
+     * Draws only the blocks of a grid that lie in a world space frustum.
+     * Models without bounds are drawn completely.
+     */
+    void draw(const Frustum& frustum, const QMatrix4x4& modelMatrix);
+
+    // the model space bounds of grids, to skip them when they are not visible
+    inline bool hasBounds() const { return !blockBounds.empty(); }
+    inline const BoundingBox& getBounds() const { return bounds; }
+
+    // height texture grids, see MeshData
+    inline bool isHeightmap() const { return heightTexture != nullptr; }
+    inline bool hasNormalTexture() const { return normalTexture != nullptr; }
+    inline const QVector2D& getUvOffset() const { return uvOffset; }
+    void bindHeightTextures(GLuint heightSlot, GLuint normalSlot);
+
+    // how the shaders have to decode the vertices
+    inline VertexFormat getVertexFormat() const { return format; }
+    inline const QVector2D& getUvScale() const { return uvScale; }
+    inline const QVector2D& getUvBias() const { return uvBias; }
+
 private:
-    void initializeBuffers(const std::vector<vertex>& vertices, const std::vector<GLuint>& indices);
+    void initializeBuffers(const std::vector<vertex>& vertices, const std::vector<GLuint>& indices, bool tryCompact = true);
+    void initializeBuffers(const CompactVertices& vertices, const std::vector<GLuint>& indices);
+    void initializeBuffers(const MeshFile& mesh);
+    void initializeIndices(const GLuint *indices, size_t count);
+    void setBlockBounds(const std::vector<BoundingBox>& blocks);
+    void initializeHeightTextures(const MeshData& mesh);
+    void initializeHeightTextures(const TerrainFile& file);
+    bool fitsInTexture(GLsizei size);
+    bool createHeightTextures(GLsizei size, bool withNormals);
 
-    static void calculateTangents(std::vector<vertex>& vertices, const std::vector<GLuint>& indices);
+    template<typename Vertex>
+    void uploadVertices(const Vertex *vertices, size_t count);
 
     // This model's VAO, vertex VBO and index EAB
-    GLuint vao, vbo, eab;
+    GLuint vao = 0, vbo = 0, eab = 0;
 
     // the amount of vertices in this model
-    GLsizei vertexCount;
+    GLsizei vertexCount = 0;
+
+    // grids use a shared index buffer instead of their own EAB
+    GridTopologyPtr topology;
+
+    // the format of the vertex buffer, and the uv range of compact vertices
+    VertexFormat format;
+    QVector2D uvScale;
+    QVector2D uvBias;
+
+    // the textures of height texture grids, which have no vertex buffer
+    TexturePtr heightTexture;
+    TexturePtr normalTexture;
+    QVector2D uvOffset;
+
+    // the bounds of the whole grid and of its blocks
+    BoundingBox bounds;
+    std::vector<BoundingBox> blockBounds;
 
 };
 
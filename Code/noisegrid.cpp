@@ -1,8 +1,9 @@
 #include "noisegrid.h"
+#include "threadpool.h"
+#include "normals.h"
+#include "heightpyramid.h"
 
-#include <random>
-#include <chrono>
-
+#include <algorithm>
 #include <cmath>
 
 // on windows, cmath doesn't define M_PI
@@ -10,231 +11,240 @@
 #define M_PI 3.14159265358979323846
 #endif
 
-NoiseGrid::NoiseGrid(unsigned N) : n(N) {
-    size = (1 << N) + 1;
-    grid = new float*[size];
-
-    for (unsigned i = 0; i < size; i++) {
-        grid[i] = new float[size];
-    }
+NoiseGrid::NoiseGrid(unsigned N) :
+        size((1 << N) + 1), n(N), grid(size, size),
+        originX(0), originZ(0), hasApron(false), apron(0, 0), stageArena(1024) {
 
-    makeZero(grid);
+    // the mesh vertices are centered around the origin
+    placement.offsetX = -(size / 2.0f);
+    placement.offsetZ = -(size / 2.0f);
 }
 
-NoiseGrid::~NoiseGrid() {
-    for (unsigned i = 0; i < size; i++) {
-        delete[] grid[i];
-    }
+NoiseGrid::NoiseGrid(unsigned N, int32_t tileX, int32_t tileZ) :
+        size((1 << N) + 1), n(N), grid(size, size),
+        originX(int64_t(tileX) << N), originZ(int64_t(tileZ) << N),
+        hasApron(true), apron(4, size), stageArena(1024) {
 
-    delete[] grid;
+    placement.offsetX = static_cast<float>(originX);
+    placement.offsetZ = static_cast<float>(originZ);
 }
 
-ModelDataPtr NoiseGrid::createModelData() const {
-    std::vector<vertex> vertices;
-    std::vector<GLuint> indices;
+NoiseGrid::~NoiseGrid() {
+    clearStages();
+}
 
-    // add the vertices to the vector
-    for (unsigned x = 0; x < size; x++) {
-        for (unsigned z = 0; z < size; z++) {
-            vertices.push_back(createVertex(x, z));
-        }
-    }
+void NoiseGrid::reset() {
+    grid.fill(0);
+    apron.fill(0);
+    clearStages();
+}
 
-    // add the indices to the vector
-    for (unsigned x = 0; x < size - 1; x++) {
-        for (unsigned z = 0; z < size - 1; z++) {
-            // first triangle
-            indices.push_back(x * size + z);
-            indices.push_back(x * size + (z + 1));
-            indices.push_back((x + 1) * size + z);
-
-            // second triangle
-            indices.push_back((x + 1) * size + z);
-            indices.push_back(x * size + (z + 1));
-            indices.push_back((x + 1) * size + (z + 1));
-        }
+void NoiseGrid::clearStages() {
+    for (StoredStage& stage : stages) {
+        stage.destroy(stage.stage);
     }
 
-    return ModelDataPtr(new ModelData(vertices, indices, true));
+    stages.clear();
+    stageArena.reset();
 }
 
-vertex NoiseGrid::createVertex(unsigned x, unsigned z) const {
-    // position of this vertex
-    QVector3D position(static_cast<GLfloat>(x), grid[x][z], static_cast<GLfloat>(z));
+MeshData NoiseGrid::createMeshData() const {
+    MeshData mesh;
+    createMeshData(mesh);
+    return mesh;
+}
 
-    // calculate the normal at this vertex
-    QVector3D normal(0, 0, 0);
-    int count = 0;
+void NoiseGrid::createMeshData(MeshData& mesh) const {
+    std::vector<vertex>& vertices = mesh.vertices;
+
+    // the indices only depend on the size, they are shared between all grids
+    mesh.gridSize = size;
+    mesh.indices.clear();
+    mesh.heights.clear();
+    mesh.normals.clear();
+    mesh.compact.vertices.clear();
+    mesh.uvOffset = QVector2D();
+    computeBlockBounds(mesh.blockBounds);
+    vertices.resize(size_t(size) * size);
+
+    ThreadPool& pool = ThreadPool::global();
+
+    // the textures repeat every 10 grid points, so only the origin
+    // modulo 10 matters. This keeps the uvs small and tiles seamless.
+    float uvOffsetX = static_cast<float>((originX % 10 + 10) % 10);
+    float uvOffsetZ = static_cast<float>((originZ % 10 + 10) % 10);
+
+    // add the vertices to the vector, one band of rows per thread
+    pool.parallelFor(0, size, [&](unsigned begin, unsigned end) {
+        for (unsigned x = begin; x < end; x++) {
+            const float *heights = grid.row(x);
+            vertex *v = &vertices[size_t(x) * size];
+
+            for (unsigned z = 0; z < size; z++, v++) {
+                v->x = static_cast<GLfloat>(x) - size / 2.0f;
+                v->y = heights[z];
+                v->z = static_cast<GLfloat>(z) - size / 2.0f;
+
+                v->u = (uvOffsetX + static_cast<GLfloat>(x)) / 10.0f;
+                v->v = (uvOffsetZ + static_cast<GLfloat>(z)) / 10.0f;
+            }
+        }
+    }, 16);
 
-    if (x > 0 && z > 0) {
-        QVector3D xneg(static_cast<GLfloat>(x - 1), grid[x - 1][z], static_cast<GLfloat>(z));
-        QVector3D zneg(static_cast<GLfloat>(x), grid[x][z - 1], static_cast<GLfloat>(z - 1));
-        normal += QVector3D::crossProduct(xneg - position, zneg - position).normalized();
-        count++;
-    }
+    // fill in the normals and tangents in one sweep over the heights. Tiles
+    // know the heights around their border, so their border normals match
+    // those of the neighbouring tiles.
+    computeGridNormals(grid, hasApron ? &apron : nullptr, &vertices[0].nx, &vertices[0].tx,
+                       sizeof(vertex) / sizeof(GLfloat));
+}
 
-    if (x > 0 && z < size - 1) {
-        QVector3D xneg(static_cast<GLfloat>(x - 1), grid[x - 1][z], static_cast<GLfloat>(z));
-        QVector3D zpos(static_cast<GLfloat>(x), grid[x][z + 1], static_cast<GLfloat>(z + 1));
-        normal += QVector3D::crossProduct(zpos - position, xneg - position).normalized();
-        count++;
-    }
+MeshData NoiseGrid::createHeightmapData(bool withNormals) const {
+    MeshData mesh;
+    createHeightmapData(mesh, withNormals);
+    return mesh;
+}
 
-    if (x < size - 1 && z < size - 1) {
-        QVector3D xpos(static_cast<GLfloat>(x + 1), grid[x + 1][z], static_cast<GLfloat>(z));
-        QVector3D zpos(static_cast<GLfloat>(x), grid[x][z + 1], static_cast<GLfloat>(z + 1));
-        normal += QVector3D::crossProduct(xpos - position, zpos - position).normalized();
-        count++;
-    }
+void NoiseGrid::createHeightmapData(MeshData& mesh, bool withNormals) const {
+    mesh.gridSize = size;
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.compact.vertices.clear();
+    computeBlockBounds(mesh.blockBounds);
+    mesh.uvOffset = QVector2D(static_cast<float>((originX % 10 + 10) % 10), static_cast<float>((originZ % 10 + 10) % 10));
 
-    if (x < size - 1 && z > 0) {
-        QVector3D xpos(static_cast<GLfloat>(x + 1), grid[x + 1][z], static_cast<GLfloat>(z));
-        QVector3D zneg(static_cast<GLfloat>(x), grid[x][z - 1], static_cast<GLfloat>(z - 1));
-        normal += QVector3D::crossProduct(zneg - position, xpos - position).normalized();
-        count++;
-    }
+    mesh.heights.resize(size_t(size) * size);
+    mesh.normals.resize(withNormals ? 2 * size_t(size) * size : 0);
 
-    if (count > 0) {
-        normal /= -count;
+    // the normals are packed to signed 16-bit x and z components,
+    // y follows from the unit length since it is always positive
+    std::vector<float> normals;
+    if (withNormals) {
+        normals.resize(3 * size_t(size) * size);
+        computeGridNormals(grid, hasApron ? &apron : nullptr, normals.data(), nullptr, 3);
     }
 
-    return {
-        // position
-        position.x() - size / 2.0f, position.y(), position.z() - size / 2.0f,
-
-        // normal
-        normal.x(), normal.y(), normal.z(),
+    ThreadPool::global().parallelFor(0, size, [&](unsigned begin, unsigned end) {
+        for (unsigned x = begin; x < end; x++) {
+            std::copy(grid.row(x), grid.row(x) + size, &mesh.heights[size_t(x) * size]);
 
-        // tangent
-        0, 0, 0,
+            if (!withNormals) {
+                continue;
+            }
 
-        // uv
-        position.x() / 10.0f, position.z() / 10.0f
-    };
+            for (unsigned z = 0; z < size; z++) {
+                size_t i = size_t(x) * size + z;
+                const float *normal = &normals[3 * i];
+                mesh.normals[2 * i + 0] = static_cast<GLshort>(std::lround(normal[0] * 32767.0f));
+                mesh.normals[2 * i + 1] = static_cast<GLshort>(std::lround(normal[2] * 32767.0f));
+            }
+        }
+    }, 16);
 }
 
-void NoiseGrid::addSpike(float min, float max, unsigned n) {
-    unsigned quadSize = (size - 1) >> n;
+bool NoiseGrid::writeTerrainFile(const QString& path, uint64_t seed, HeightEncoding encoding, bool withNormals) const {
+    TerrainFileInfo info;
+    info.detail = n;
+    info.seed = seed;
+    info.placement = placement;
+    info.tileQuads = getGridBlockQuads(size);
+    info.encoding = encoding;
 
-    // initialize the temporary grid
-    float ** temporaryGrid = new float*[size];
-    for (unsigned i = 0; i < size; i++) {
-        temporaryGrid[i] = new float[size];
+    std::vector<float> normals;
+    if (withNormals) {
+        normals.resize(3 * size_t(size) * size);
+        computeGridNormals(grid, hasApron ? &apron : nullptr, normals.data(), nullptr, 3);
     }
 
-    makeZero(temporaryGrid);
-
-    // initialize spike
-    for (unsigned x = 0; x < size; x += quadSize) {
-        for (unsigned z = 0; z < size; z += quadSize) {
-            if (x == size / 2 && z == size / 2) {
-                temporaryGrid[x][z] = max;
-            } else {
-                temporaryGrid[x][z] = min;
-            }
-        }
-    }
-
-    // add the spike
-    addInterpolatedGrid(temporaryGrid, quadSize);
+    return TerrainFile::write(path, grid, withNormals ? normals.data() : nullptr, info);
+}
 
-    // delete temporary grid
-    for (unsigned i = 0; i < size; i++) {
-        delete[] temporaryGrid[i];
-    }
-    delete[] temporaryGrid;
+void NoiseGrid::addSpike(float min, float max, unsigned n) {
+    add(SpikeStage(min, max, n));
 }
 
-void NoiseGrid::addOctaves(unsigned octaves, float amplitude, unsigned n) {
-    // initialize the random number generator
-    std::mt19937_64 engine;
+void NoiseGrid::addOctaves(unsigned octaves, float amplitude, unsigned n, uint64_t seed) {
+    add(OctavesStage(octaves, amplitude, n, seed));
+}
 
-    auto start = std::chrono::high_resolution_clock::now();
-    auto tm = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
-    tm *= tm;
-    engine.seed(static_cast<std::mt19937_64::result_type>(tm));
+float NoiseGrid::heightAt(float x, float z, GridSampling sampling) const {
+    float height;
+    sample(&x, &z, 1, &height, nullptr, sampling, SimdLevel::Scalar);
+    return height;
+}
 
-    std::uniform_real_distribution<float> dist(0, 1);
+QVector3D NoiseGrid::normalAt(float x, float z, GridSampling sampling) const {
+    float normal[3];
+    sample(&x, &z, 1, nullptr, normal, sampling, SimdLevel::Scalar);
+    return QVector3D(normal[0], normal[1], normal[2]);
+}
 
-    auto rng = [&engine, &dist]() -> float {
-            return dist(engine);
-    };
+void NoiseGrid::sample(const float *x, const float *z, size_t count, float *heights, float *normals,
+                       GridSampling sampling, SimdLevel level) const {
+    if (sampling == GridSampling::Bilinear) {
+        sampleGridBilinear(grid, placement, x, z, count, heights, normals, level);
+        return;
+    }
 
-    // initialize the temporary grid
-    float ** temporaryGrid = new float*[size];
-    for (unsigned i = 0; i < size; i++) {
-        temporaryGrid[i] = new float[size];
+    for (size_t i = 0; i < count; i++) {
+        sampleSmooth(x[i], z[i], heights != nullptr ? &heights[i] : nullptr,
+                     normals != nullptr ? &normals[3 * i] : nullptr);
     }
+}
 
-    // add octaves
-    for (unsigned i = 0; i < octaves; i++) {
-        unsigned quadSize = (size - 1) >> n;
-        makeZero(temporaryGrid);
+/**
+ * @brief NoiseGrid::sampleSmooth
+ *
+ * Evaluates the stages at a world position, in the order they were
+ * added, so grid points give the grid values bit for bit. The normal
+ * follows from the derivatives of the smoothstep weights instead of from
+ * differences between samples.
+ */
+void NoiseGrid::sampleSmooth(float x, float z, float *height, float *normal) const {
+    float last = static_cast<float>(size - 1);
+    float gx = std::min(std::max(x - placement.offsetX, 0.0f), last);
+    float gz = std::min(std::max(z - placement.offsetZ, 0.0f), last);
 
-        // randomize
-        for (unsigned x = 0; x < size; x += quadSize) {
-            for (unsigned y = 0; y < size; y += quadSize) {
-                temporaryGrid[x][y] = rng() * amplitude;
-            }
-        }
+    PipelineSample sample = { 0, 0, 0 };
+    for (const StoredStage& stage : stages) {
+        stage.addSample(stage.stage, gx, gz, sample);
+    }
 
-        addInterpolatedGrid(temporaryGrid, quadSize);
+    float h = sample.value;
+    float dhdx = sample.dx;
+    float dhdz = sample.dz;
 
-        amplitude /= 2.0f;
-        n++;
+    if (height != nullptr) {
+        *height = h * placement.heightScale + placement.heightOffset;
     }
 
-    // delete temporary grid
-    for (unsigned i = 0; i < size; i++) {
-        delete[] temporaryGrid[i];
-    }
-    delete[] temporaryGrid;
-}
+    if (normal != nullptr) {
+        float nx = -dhdx * placement.heightScale;
+        float nz = -dhdz * placement.heightScale;
+        float inverseLength = 1.0f / std::sqrt(nx * nx + nz * nz + 1.0f);
 
-void NoiseGrid::makeZero(float **grid) const {
-    for (unsigned i = 0; i < size; i++) {
-        for (unsigned j = 0; j < size; j++) {
-            grid[i][j] = 0;
-        }
+        normal[0] = nx * inverseLength;
+        normal[1] = inverseLength;
+        normal[2] = nz * inverseLength;
     }
 }
 
-void NoiseGrid::addInterpolatedGrid(float **temporaryGrid, unsigned quadSize) {
-    auto interpolate = [](float left, float right, float x) -> float {
-        x = x * x * (3 - 2 * x);
-        return right * x + left * (1 - x);
-    };
-
-    for (unsigned x = 0; x < size; x++) {
-        for (unsigned z = 0; z < size; z++) {
-            unsigned xneg = (x / quadSize) * quadSize;
-            unsigned zneg = (z / quadSize) * quadSize;
-
-            unsigned xpos = xneg + quadSize;
-            unsigned zpos = zneg + quadSize;
-
-            float xt = (x - xneg) / float(quadSize);
-            float zt = (z - zneg) / float(quadSize);
-
-            // edge case
-            if (x >= size - 1) {
-                if (z >= size - 1) {
-                    grid[x][z] += temporaryGrid[x][z];
-                    continue;
-                }
-
-                grid[x][z] += interpolate(temporaryGrid[x][zneg], temporaryGrid[x][zpos], zt);
-                continue;
-            } else if (z >= size - 1) {
-                grid[x][z] += interpolate(temporaryGrid[xneg][z], temporaryGrid[xpos][z], xt);
-                continue;
-            }
-
-            // normal case
-            float height1 = interpolate(temporaryGrid[xneg][zneg], temporaryGrid[xpos][zneg], xt);
-            float height2 = interpolate(temporaryGrid[xneg][zpos], temporaryGrid[xpos][zpos], xt);
-
-            grid[x][z] += interpolate(height1, height2, zt);
-        }
-    }
+/**
+ * @brief NoiseGrid::computeBlockBounds
+ *
+ * The model space bounds of the blocks the GridTopology of this grid
+ * draws, so they can be culled one by one
+ */
+void NoiseGrid::computeBlockBounds(std::vector<BoundingBox>& bounds) const {
+    unsigned blockQuads = getGridBlockQuads(size);
+    unsigned blocks = (size - 1) / blockQuads;
+    float quads = static_cast<float>(blockQuads);
+
+    bounds.resize(size_t(blocks) * blocks);
+
+    HeightPyramid::computeBlockRanges(grid, blockQuads, [&](unsigned bx, unsigned bz, const HeightRange& heights) {
+        QVector3D min(bx * quads - size / 2.0f, heights.min, bz * quads - size / 2.0f);
+        QVector3D max(min.x() + quads, heights.max, min.z() + quads);
+
+        bounds[size_t(bx) * blocks + bz] = { min, max };
+    });
 }
@@ -1,7 +1,16 @@
 #ifndef NOISEGRID_H
 #define NOISEGRID_H
 
-#include "modeldata.h"
+#include "meshdata.h"
+#include "arena.h"
+#include "heightfield.h"
+#include "gridsampling.h"
+#include "terrainfile.h"
+#include "terrainpipeline.h"
+
+#include <cstdint>
+#include <new>
+#include <vector>
 
 class NoiseGrid {
 
@@ -15,22 +24,227 @@ public:
      * @param N
      */
     NoiseGrid(unsigned N);
+
+    /**
+     * @brief NoiseGrid
+     *
+     * A tile of an unbounded grid. Tile (tileX, tileZ) starts at grid
+     * point (tileX * 2^N, tileZ * 2^N), so neighbouring tiles share their
+     * border vertices. Tiles also keep the heights just outside their
+     * border, so border normals match those of the neighbouring tile.
+     *
+     * @param N
+     * @param tileX
+     * @param tileZ
+     */
+    NoiseGrid(unsigned N, int32_t tileX, int32_t tileZ);
     ~NoiseGrid();
 
+    NoiseGrid(const NoiseGrid&) = delete;
+    NoiseGrid& operator=(const NoiseGrid&) = delete;
+
+    /**
+     * @brief reset
+     *
+     * Sets all heights back to 0 and forgets the stages, like a new grid,
+     * but in the memory of this one. The placement is kept.
+     */
+    void reset();
+
+    /**
+     * @brief add
+     *
+     * Adds a pipeline of stages (see terrainpipeline.h) in a single pass
+     * over the grid. Composing the stages first, e.g. with sumStages,
+     * keeps every grid row in the cache while all of them are added.
+     * The stage is kept for smooth sampling.
+     */
+    template<typename Stage>
+    void add(const Stage& stage);
+
+    /**
+     * @brief addSpike
+     *
+     * Adds a spike in the middle of the grid. This is not continued
+     * outside the grid, so tiles with a spike are not seamless.
+     */
     void addSpike(float min, float max, unsigned n);
-    void addOctaves(unsigned octaves, float amplitude, unsigned n);
-    ModelDataPtr createModelData() const;
+
+    /**
+     * @brief addOctaves
+     *
+     * Adds value noise octaves. Octave i has a lattice of 2^(n + i) quads
+     * and an amplitude of amplitude / 2^i. The lattice values are a pure
+     * function of (seed, n + i, lattice x, lattice z), so the same seed
+     * always gives the same terrain.
+     *
+     * @param octaves
+     * @param amplitude
+     * @param n
+     * @param seed
+     */
+    void addOctaves(unsigned octaves, float amplitude, unsigned n, uint64_t seed);
+
+    /**
+     * @brief createMeshData
+     *
+     * Builds the vertices (with normals and tangents) of the grid. Like
+     * everything in NoiseGrid, this doesn't touch OpenGL, so it can be
+     * called from any thread, and without a GL context. The indices are
+     * not built, grids are drawn with the GridTopology of their size.
+     */
+    MeshData createMeshData() const;
+
+    /**
+     * @brief createMeshData
+     *
+     * Like createMeshData(), but builds into an existing mesh, reusing
+     * the memory of its vectors
+     */
+    void createMeshData(MeshData& mesh) const;
+
+    /**
+     * @brief createHeightmapData
+     *
+     * Like createMeshData, but only stores the heights and optionally the
+     * packed normals, to be drawn from textures by the terrain shader.
+     * Tiles need the normals for their borders to match.
+     */
+    MeshData createHeightmapData(bool withNormals) const;
+    void createHeightmapData(MeshData& mesh, bool withNormals) const;
+
+    /**
+     * @brief setPlacement
+     *
+     * Where the grid is drawn, for the height and normal queries below.
+     * Defaults to the placement of the mesh with a scale of 1: islands
+     * centered around the origin, tiles at their grid point.
+     */
+    inline void setPlacement(const GridPlacement& placement) { this->placement = placement; }
+    inline const GridPlacement& getPlacement() const { return placement; }
+
+    /**
+     * @brief heightAt
+     *
+     * The world height at world position (x, z). Positions outside of the
+     * grid are clamped to its edges. Like the other queries, this only
+     * reads the grid, so it can be called from any thread.
+     */
+    float heightAt(float x, float z, GridSampling sampling = GridSampling::Bilinear) const;
+
+    /**
+     * @brief normalAt
+     *
+     * The world normal at world position (x, z), of the same surface heightAt samples
+     */
+    QVector3D normalAt(float x, float z, GridSampling sampling = GridSampling::Bilinear) const;
+
+    /**
+     * @brief sample
+     *
+     * heightAt and normalAt for count positions at once. Bilinear sampling
+     * is vectorized, see sampleGridBilinear. Smooth sampling hashes four
+     * lattice points per octave, which dominates its cost, so it is
+     * evaluated point by point.
+     *
+     * @param x the world x of every position
+     * @param z the world z of every position
+     * @param count the number of positions
+     * @param heights count world heights, or nullptr
+     * @param normals count world normals of three floats each, or nullptr
+     */
+    void sample(const float *x, const float *z, size_t count, float *heights, float *normals,
+                GridSampling sampling = GridSampling::Bilinear, SimdLevel level = getSimdLevel()) const;
+
+    /**
+     * @brief writeTerrainFile
+     *
+     * Stores the grid and its placement in a TerrainFile, in tiles of the
+     * block size of its GridTopology, so the tile directory doubles as the
+     * culling bounds when the file is drawn
+     *
+     * @param path the file to write
+     * @param seed the seed the grid was generated with
+     * @param encoding how to store the heights
+     * @param withNormals whether to store the normals as well
+     * @return whether the file was written
+     */
+    bool writeTerrainFile(const QString& path, uint64_t seed, HeightEncoding encoding, bool withNormals) const;
+
+    inline unsigned getSize() const { return size; }
+    inline const Heightfield& getHeights() const { return grid; }
 
 private:
-    vertex createVertex(unsigned x, unsigned z) const;
+    void sampleSmooth(float x, float z, float *height, float *normal) const;
 
-    void makeZero(float **grid) const;
-    void addInterpolatedGrid(float **temporaryGrid, unsigned quadSize);
+    void computeBlockBounds(std::vector<BoundingBox>& bounds) const;
+    void clearStages();
 
     unsigned size;
-    float **grid;
     unsigned n;
 
+    Heightfield grid;
+
+    // the first grid point of this grid in the unbounded grid
+    int64_t originX;
+    int64_t originZ;
+
+    // Tiles store one extra row or column of heights on every side:
+    // x = -1, x = size, z = -1 and z = size, in that order.
+    bool hasApron;
+    Heightfield apron;
+
+    // the stages that were added, to evaluate them between grid points.
+    // They are copied to stageArena, so a grid that is reset reuses their memory.
+    struct StoredStage {
+        void *stage;
+        void (*addSample)(const void *stage, float x, float z, PipelineSample& sample);
+        void (*destroy)(void *stage);
+    };
+
+    Arena stageArena;
+    std::vector<StoredStage> stages;
+    GridPlacement placement;
+
 };
 
+template<typename Stage>
+void NoiseGrid::add(const Stage& stage) {
+    PipelineGrid pipelineGrid = { size, originX, originZ };
+    addPipeline(grid, pipelineGrid, stage);
+
+    // the apron lies outside of the grid, so it is sampled point by point
+    if (hasApron) {
+        float last = static_cast<float>(size);
+
+        auto addApron = [&](unsigned side, unsigned k, float x, float z) {
+            PipelineSample sample = { apron.at(side, k), 0, 0 };
+            stage.addSample(pipelineGrid, x, z, sample);
+            apron.at(side, k) = sample.value;
+        };
+
+        for (unsigned k = 0; k < size; k++) {
+            addApron(0, k, -1.0f, static_cast<float>(k));
+            addApron(1, k, last, static_cast<float>(k));
+            addApron(2, k, static_cast<float>(k), -1.0f);
+            addApron(3, k, static_cast<float>(k), last);
+        }
+    }
+
+    struct Sampler {
+        Stage stage;
+        PipelineGrid grid;
+    };
+
+    void *memory = stageArena.allocate(sizeof(Sampler), alignof(Sampler));
+    Sampler *sampler = new (memory) Sampler{ stage, pipelineGrid };
+
+    stages.push_back({ sampler, [](const void *stage, float x, float z, PipelineSample& sample) {
+        const Sampler *sampler = static_cast<const Sampler *>(stage);
+        sampler->stage.addSample(sampler->grid, x, z, sample);
+    }, [](void *stage) {
+        static_cast<Sampler *>(stage)->~Sampler();
+    } });
+}
+
 #endif // NOISEGRID_H
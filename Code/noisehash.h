@@ -0,0 +1,78 @@
+#ifndef NOISEHASH_H
+#define NOISEHASH_H
+
+#include <cstdint>
+
+/**
+ * @brief mixBits
+ *
+ * The splitmix64 finalizer: every input bit affects every output bit
+ */
+inline uint64_t mixBits(uint64_t h) {
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBull;
+    h ^= h >> 31;
+    return h;
+}
+
+/**
+ * @brief latticeKey
+ *
+ * The part of hashLattice that only depends on the lattice, so it can be
+ * computed once per lattice when many of its points are hashed
+ */
+inline uint64_t latticeKey(uint64_t seed, uint32_t octave) {
+    return mixBits(seed ^ mixBits(octave + 0x9E3779B97F4A7C15ull));
+}
+
+/**
+ * @brief hashLatticePoint
+ *
+ * hashLattice for a key from latticeKey
+ */
+inline uint64_t hashLatticePoint(uint64_t key, int32_t x, int32_t z) {
+    uint64_t position = (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(z);
+    return mixBits(key ^ mixBits(position));
+}
+
+/**
+ * @brief hashLattice
+ *
+ * Stateless hash of a lattice point. The same (seed, octave, x, z) always
+ * gives the same value, so lattice points can be computed in any order,
+ * on any thread, and for any region of an unbounded lattice.
+ *
+ * @param seed the terrain seed
+ * @param octave identifies the lattice, e.g. its frequency level
+ * @param x lattice coordinate
+ * @param z lattice coordinate
+ */
+inline uint64_t hashLattice(uint64_t seed, uint32_t octave, int32_t x, int32_t z) {
+    // The key and the position are scrambled separately before combining them.
+    // Combining the raw values would make different seeds give (xor-)shifted
+    // copies of the same lattice.
+    return hashLatticePoint(latticeKey(seed, octave), x, z);
+}
+
+/**
+ * @brief latticeValue
+ *
+ * A uniformly distributed value in [0, 1) for a lattice point
+ */
+inline float latticeValue(uint64_t seed, uint32_t octave, int32_t x, int32_t z) {
+    // the top 24 bits fill a float mantissa exactly
+    return static_cast<float>(hashLattice(seed, octave, x, z) >> 40) * (1.0f / 16777216.0f);
+}
+
+/**
+ * @brief latticePointValue
+ *
+ * latticeValue for a key from latticeKey
+ */
+inline float latticePointValue(uint64_t key, int32_t x, int32_t z) {
+    return static_cast<float>(hashLatticePoint(key, x, z) >> 40) * (1.0f / 16777216.0f);
+}
+
+#endif // NOISEHASH_H
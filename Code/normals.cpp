@@ -0,0 +1,254 @@
+#include "normals.h"
+#include "threadpool.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define NORMALS_X86
+#include <immintrin.h>
+#endif
+
+// GCC and clang need AVX2 functions to be marked, MSVC always allows the intrinsics
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace {
+
+// writes normalize(dx, 1, dz) to out, and normalize(1, -dx, 0) to tangent
+inline void storeNormal(float *out, float *tangent, float dx, float dz) {
+    float inverseLength = 1.0f / std::sqrt(dx * dx + dz * dz + 1.0f);
+
+    out[0] = dx * inverseLength;
+    out[1] = inverseLength;
+    out[2] = dz * inverseLength;
+
+    if (tangent != nullptr) {
+        float inverseTangentLength = 1.0f / std::sqrt(dx * dx + 1.0f);
+
+        tangent[0] = inverseTangentLength;
+        tangent[1] = -dx * inverseTangentLength;
+        tangent[2] = 0;
+    }
+}
+
+// Normals of points begin to end of a row, which must all have a neighbour
+// on both sides within the row. above and below are rows x - 1 and x + 1,
+// scaleX is one over their distance. tangent may be nullptr.
+typedef void (*NormalRowKernel)(float *out, float *tangent, size_t stride,
+                                const float *above, const float *row, const float *below,
+                                float scaleX, unsigned begin, unsigned end);
+
+// --- scalar kernel
+
+void normalRowScalar(float *out, float *tangent, size_t stride,
+                     const float *above, const float *row, const float *below,
+                     float scaleX, unsigned begin, unsigned end) {
+    for (unsigned z = begin; z < end; z++) {
+        float dx = (above[z] - below[z]) * scaleX;
+        float dz = (row[z - 1] - row[z + 1]) * 0.5f;
+        storeNormal(out + z * stride, tangent != nullptr ? tangent + z * stride : nullptr, dx, dz);
+    }
+}
+
+#ifdef NORMALS_X86
+
+// --- SSE2 kernel
+
+void normalRowSSE2(float *out, float *tangent, size_t stride,
+                   const float *above, const float *row, const float *below,
+                   float scaleX, unsigned begin, unsigned end) {
+    __m128 sx = _mm_set1_ps(scaleX);
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 one = _mm_set1_ps(1.0f);
+
+    alignas(16) float nx[4], ny[4], nz[4], tx[4], ty[4];
+
+    unsigned z = begin;
+    for (; z + 4 <= end; z += 4) {
+        __m128 dx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(above + z), _mm_loadu_ps(below + z)), sx);
+        __m128 dz = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(row + z - 1), _mm_loadu_ps(row + z + 1)), half);
+
+        __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)), one);
+        __m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+
+        _mm_store_ps(nx, _mm_mul_ps(dx, inverseLength));
+        _mm_store_ps(ny, inverseLength);
+        _mm_store_ps(nz, _mm_mul_ps(dz, inverseLength));
+
+        // the normals are interleaved with the other vertex attributes
+        float *target = out + z * stride;
+        for (unsigned k = 0; k < 4; k++, target += stride) {
+            target[0] = nx[k];
+            target[1] = ny[k];
+            target[2] = nz[k];
+        }
+
+        if (tangent != nullptr) {
+            __m128 inverseTangentLength = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), one)));
+
+            _mm_store_ps(tx, inverseTangentLength);
+            _mm_store_ps(ty, _mm_mul_ps(_mm_xor_ps(dx, _mm_set1_ps(-0.0f)), inverseTangentLength));
+
+            target = tangent + z * stride;
+            for (unsigned k = 0; k < 4; k++, target += stride) {
+                target[0] = tx[k];
+                target[1] = ty[k];
+                target[2] = 0;
+            }
+        }
+    }
+
+    normalRowScalar(out, tangent, stride, above, row, below, scaleX, z, end);
+}
+
+// --- AVX2 kernel
+
+TARGET_AVX2 void normalRowAVX2(float *out, float *tangent, size_t stride,
+                               const float *above, const float *row, const float *below,
+                               float scaleX, unsigned begin, unsigned end) {
+    __m256 sx = _mm256_set1_ps(scaleX);
+    __m256 half = _mm256_set1_ps(0.5f);
+    __m256 one = _mm256_set1_ps(1.0f);
+
+    alignas(32) float nx[8], ny[8], nz[8], tx[8], ty[8];
+
+    unsigned z = begin;
+    for (; z + 8 <= end; z += 8) {
+        __m256 dx = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(above + z), _mm256_loadu_ps(below + z)), sx);
+        __m256 dz = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(row + z - 1), _mm256_loadu_ps(row + z + 1)), half);
+
+        __m256 lengthSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz)), one);
+        __m256 inverseLength = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSquared));
+
+        _mm256_store_ps(nx, _mm256_mul_ps(dx, inverseLength));
+        _mm256_store_ps(ny, inverseLength);
+        _mm256_store_ps(nz, _mm256_mul_ps(dz, inverseLength));
+
+        float *target = out + z * stride;
+        for (unsigned k = 0; k < 8; k++, target += stride) {
+            target[0] = nx[k];
+            target[1] = ny[k];
+            target[2] = nz[k];
+        }
+
+        if (tangent != nullptr) {
+            __m256 inverseTangentLength = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), one)));
+
+            _mm256_store_ps(tx, inverseTangentLength);
+            _mm256_store_ps(ty, _mm256_mul_ps(_mm256_xor_ps(dx, _mm256_set1_ps(-0.0f)), inverseTangentLength));
+
+            target = tangent + z * stride;
+            for (unsigned k = 0; k < 8; k++, target += stride) {
+                target[0] = tx[k];
+                target[1] = ty[k];
+                target[2] = 0;
+            }
+        }
+    }
+
+    normalRowSSE2(out, tangent, stride, above, row, below, scaleX, z, end);
+}
+
+#endif // NORMALS_X86
+
+NormalRowKernel getKernel(SimdLevel level) {
+#ifdef NORMALS_X86
+    switch (level) {
+    case SimdLevel::AVX2: return normalRowAVX2;
+    case SimdLevel::SSE2: return normalRowSSE2;
+    default:              break;
+    }
+#else
+    (void) level;
+#endif
+
+    return normalRowScalar;
+}
+
+} // namespace
+
+void computeGridNormals(const Heightfield& heights, const Heightfield *border, float *normals, float *tangents,
+                        size_t stride, SimdLevel level) {
+    NormalRowKernel kernel = getKernel(level);
+
+    unsigned rows = heights.getRows();
+    unsigned columns = heights.getColumns();
+
+    if (rows == 0 || columns == 0) {
+        return;
+    }
+
+    // the step between two neighbours: 2 for central differences, 1 on edges without a border
+    auto inverseDistance = [](unsigned distance) -> float {
+        return distance > 0 ? 1.0f / distance : 0.0f;
+    };
+
+    ThreadPool::global().parallelFor(0, rows, [&](unsigned begin, unsigned end) {
+        for (unsigned x = begin; x < end; x++) {
+            const float *row = heights.row(x);
+            size_t offset = static_cast<size_t>(x) * columns * stride;
+            float *out = normals + offset;
+            float *tangent = tangents != nullptr ? tangents + offset : nullptr;
+
+            // neighbouring rows along x
+            const float *above = row;
+            const float *below = row;
+            unsigned distance = 0;
+
+            if (x > 0) {
+                above = heights.row(x - 1);
+                distance++;
+            } else if (border != nullptr) {
+                above = border->row(0);
+                distance++;
+            }
+
+            if (x + 1 < rows) {
+                below = heights.row(x + 1);
+                distance++;
+            } else if (border != nullptr) {
+                below = border->row(1);
+                distance++;
+            }
+
+            float scaleX = inverseDistance(distance);
+
+            // the first and last point of the row may lie on the edge along z
+            auto edgeNormal = [&](unsigned z) {
+                float before = row[z];
+                float after = row[z];
+                unsigned distanceZ = 0;
+
+                if (z > 0) {
+                    before = row[z - 1];
+                    distanceZ++;
+                } else if (border != nullptr) {
+                    before = border->at(2, x);
+                    distanceZ++;
+                }
+
+                if (z + 1 < columns) {
+                    after = row[z + 1];
+                    distanceZ++;
+                } else if (border != nullptr) {
+                    after = border->at(3, x);
+                    distanceZ++;
+                }
+
+                float dx = (above[z] - below[z]) * scaleX;
+                float dz = (before - after) * inverseDistance(distanceZ);
+                storeNormal(out + z * stride, tangent != nullptr ? tangent + z * stride : nullptr, dx, dz);
+            };
+
+            edgeNormal(0);
+
+            if (columns > 1) {
+                kernel(out, tangent, stride, above, row, below, scaleX, 1, columns - 1);
+                edgeNormal(columns - 1);
+            }
+        }
+    }, 16);
+}
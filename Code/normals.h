@@ -0,0 +1,36 @@
+#ifndef NORMALS_H
+#define NORMALS_H
+
+#include "heightfield.h"
+#include "simd.h"
+
+#include <cstddef>
+
+/**
+ * @brief computeGridNormals
+ *
+ * Computes the unit normal of every point of a heightfield with grid
+ * spacing 1 from central differences, in one streaming sweep over the
+ * rows. The normal at (x, z) is normalize(h(x - 1) - h(x + 1), 2,
+ * h(z - 1) - h(z + 1)), scaled to unit length. The tangents, if requested,
+ * point along x and are perpendicular to the normals.
+ *
+ * The heights just outside the field can be passed as a border of four
+ * rows: x = -1, x = rows, z = -1 and z = columns, in that order. Without
+ * a border, the points on the edges use one-sided differences.
+ *
+ * All SIMD levels produce bit-identical results.
+ *
+ * @param heights the heightfield
+ * @param border the heights around the heightfield, or nullptr
+ * @param normals where the normal of point (x, z) is written to, as three
+ *        floats at normals + (x * columns + z) * stride
+ * @param tangents where the tangents are written to, in the same layout as
+ *        the normals, or nullptr
+ * @param stride the distance between two normals, in floats
+ * @param level the instruction set to use
+ */
+void computeGridNormals(const Heightfield& heights, const Heightfield *border, float *normals, float *tangents,
+                        size_t stride, SimdLevel level = getSimdLevel());
+
+#endif // NORMALS_H
@@ -0,0 +1,594 @@
+#include "objparser.h"
+#include "threadpool.h"
+
+#include <QByteArray>
+#include <QDebug>
+#include <QFile>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace {
+
+// files are only split when every chunk gets at least this much text
+const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+// the numbers of v, vn and vt lines before a chunk, which relative indices count back from
+struct ObjCounts {
+    size_t positions;
+    size_t normals;
+    size_t textureCoords;
+};
+
+// the powers of ten a double holds exactly
+const double POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline const char *skipSpaces(const char *p, const char *end) {
+    while (p < end && isSpace(*p)) {
+        p++;
+    }
+
+    return p;
+}
+
+/**
+ * @brief parseDouble
+ *
+ * Parses the number at p like std::from_chars, without allocating: most
+ * numbers in OBJ files have few enough digits to be converted exactly with
+ * a single multiplication or division. Others, and nan and inf, are
+ * converted by Qt, so every number comes out as QString::toDouble gives it.
+ * Text that is no number gives 0, like it does for toDouble.
+ *
+ * @return the end of the number
+ */
+const char *parseDouble(const char *p, const char *end, double& value) {
+    const char *start = p;
+    bool negative = false;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool anyDigits = false;
+
+    for (; p < end && isDigit(*p); p++) {
+        anyDigits = true;
+        if (mantissa != 0 || *p != '0') {
+            mantissa = mantissa * 10 + uint64_t(*p - '0');
+            digits++;
+        }
+    }
+
+    if (p < end && *p == '.') {
+        for (p++; p < end && isDigit(*p); p++) {
+            anyDigits = true;
+            if (mantissa != 0 || *p != '0') {
+                mantissa = mantissa * 10 + uint64_t(*p - '0');
+                digits++;
+            }
+
+            exponent--;
+        }
+    }
+
+    if (anyDigits && p < end && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        bool negativeExponent = false;
+
+        if (q < end && (*q == '-' || *q == '+')) {
+            negativeExponent = *q == '-';
+            q++;
+        }
+
+        if (q < end && isDigit(*q)) {
+            int written = 0;
+            for (; q < end && isDigit(*q); q++) {
+                written = std::min(written * 10 + (*q - '0'), 100000);
+            }
+
+            exponent += negativeExponent ? -written : written;
+            p = q;
+        }
+    }
+
+    // exact: the mantissa fits in the 53 bits of a double, and so does the power of ten
+    if (anyDigits && digits <= 19 && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+        double magnitude = double(mantissa);
+        magnitude = exponent < 0 ? magnitude / POWERS_OF_TEN[-exponent] : magnitude * POWERS_OF_TEN[exponent];
+        value = negative ? -magnitude : magnitude;
+        return p;
+    }
+
+    // everything up to the next separator
+    if (!anyDigits) {
+        while (p < end && !isSpace(*p) && *p != '/' && *p != '\n') {
+            p++;
+        }
+    }
+
+    value = QByteArray::fromRawData(start, int(p - start)).toDouble();
+    return p;
+}
+
+// QString::toFloat parses a double and rounds that to a float
+inline const char *parseFloat(const char *p, const char *end, float& value) {
+    double parsed;
+    p = parseDouble(skipSpaces(p, end), end, parsed);
+    value = float(parsed);
+    return p;
+}
+
+/**
+ * @brief parseIndex
+ *
+ * The 0-based index of a 1-based OBJ index at p. Negative indices count
+ * back from the last of the count values defined before the face, so -1
+ * is the last one. Index 0, and relative indices before the first value,
+ * give INVALID_OBJ_INDEX.
+ *
+ * @return the end of the index
+ */
+inline const char *parseIndex(const char *p, const char *end, size_t count, GLuint& index) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    // capped, anything beyond 32 bits is out of range anyway
+    uint64_t value = 0;
+    for (; p < end && isDigit(*p); p++) {
+        value = std::min<uint64_t>(value * 10 + uint64_t(*p - '0'), uint64_t(1) << 40);
+    }
+
+    if (value == 0 || (negative && value > count) || (!negative && value > INVALID_OBJ_INDEX)) {
+        index = INVALID_OBJ_INDEX;
+    } else {
+        index = static_cast<GLuint>(negative ? count - value : value - 1);
+    }
+
+    return p;
+}
+
+// the keyword of a line, when it is followed by a separator
+inline bool isKeyword(const char *p, const char *end, const char *keyword, size_t length) {
+    return size_t(end - p) > length && std::memcmp(p, keyword, length) == 0 && isSpace(p[length]);
+}
+
+// whether the face has relative indices
+bool parseFace(const char *p, const char *end, const ObjCounts& base, ObjData& data) {
+    bool relative = false;
+
+    while (true) {
+        p = skipSpaces(p, end);
+        if (p == end || !(isDigit(*p) || *p == '-' || *p == '+')) {
+            return relative;
+        }
+
+        GLuint index;
+        relative |= *p == '-';
+        p = parseIndex(p, end, base.positions + data.positions.size(), index);
+        data.positionIndices.push_back(index);
+
+        // v/vt/vn, v//vn or v/vt
+        if (p < end && *p == '/') {
+            p++;
+            if (p < end && *p != '/' && !isSpace(*p)) {
+                relative |= *p == '-';
+                p = parseIndex(p, end, base.textureCoords + data.textureCoords.size(), index);
+                data.textureCoordIndices.push_back(index);
+            }
+
+            if (p < end && *p == '/') {
+                p++;
+                if (p < end && !isSpace(*p)) {
+                    relative |= *p == '-';
+                    p = parseIndex(p, end, base.normals + data.normals.size(), index);
+                    data.normalIndices.push_back(index);
+                }
+            }
+        }
+
+        // skip anything else in the corner
+        while (p < end && !isSpace(*p)) {
+            p++;
+        }
+    }
+}
+
+/**
+ * @brief parseLines
+ *
+ * Parses the lines from p to end into data. base is what was defined
+ * before p, not counting what data already holds.
+ *
+ * @return whether any face has relative indices
+ */
+bool parseLines(const char *p, const char *end, const ObjCounts& base, ObjData& data) {
+    bool relative = false;
+
+    while (p < end) {
+        const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', size_t(end - p)));
+        lineEnd = lineEnd != nullptr ? lineEnd : end;
+
+        const char *line = skipSpaces(p, lineEnd);
+
+        if (isKeyword(line, lineEnd, "v", 1)) {
+            float x, y, z;
+            const char *q = parseFloat(line + 1, lineEnd, x);
+            q = parseFloat(q, lineEnd, y);
+            parseFloat(q, lineEnd, z);
+            data.positions.push_back(QVector3D(x, y, z));
+        } else if (isKeyword(line, lineEnd, "vn", 2)) {
+            float x, y, z;
+            const char *q = parseFloat(line + 2, lineEnd, x);
+            q = parseFloat(q, lineEnd, y);
+            parseFloat(q, lineEnd, z);
+            data.normals.push_back(QVector3D(x, y, z));
+        } else if (isKeyword(line, lineEnd, "vt", 2)) {
+            float u, v;
+            const char *q = parseFloat(line + 2, lineEnd, u);
+            parseFloat(q, lineEnd, v);
+            data.textureCoords.push_back(QVector2D(u, v));
+        } else if (isKeyword(line, lineEnd, "f", 1)) {
+            relative |= parseFace(line + 1, lineEnd, base, data);
+        }
+
+        p = lineEnd < end ? lineEnd + 1 : end;
+    }
+
+    return relative;
+}
+
+// appends a chunk, and frees it
+template<typename T>
+void append(std::vector<T>& target, std::vector<T>& chunk) {
+    target.insert(target.end(), chunk.begin(), chunk.end());
+    std::vector<T>().swap(chunk);
+}
+
+// the bits of a value to weld, equal for values that compare equal
+inline uint32_t weldBits(float value, float inverseEpsilon) {
+    if (inverseEpsilon != 0.0f) {
+        value = std::round(value * inverseEpsilon);
+    }
+
+    // adding zero turns -0 into 0, which compare equal as floats
+    value += 0.0f;
+
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline std::array<uint32_t, 3> weldKey(const QVector3D& value, float inverseEpsilon) {
+    return { { weldBits(value.x(), inverseEpsilon), weldBits(value.y(), inverseEpsilon), weldBits(value.z(), inverseEpsilon) } };
+}
+
+inline std::array<uint32_t, 2> weldKey(const QVector2D& value, float inverseEpsilon) {
+    return { { weldBits(value.x(), inverseEpsilon), weldBits(value.y(), inverseEpsilon) } };
+}
+
+// FNV-1a over the words, with a final mix so the low bits the
+// slots are picked with depend on all of them
+template<size_t N>
+inline uint32_t hashKey(const std::array<uint32_t, N>& key) {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t word : key) {
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+
+    hash ^= hash >> 32;
+    return static_cast<uint32_t>((hash * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+/**
+ * @brief findFirstEqual
+ *
+ * For every value, the index of the first value that is equal to it (or
+ * that rounds to the same multiples of the epsilon). Uses an open
+ * addressing table of value numbers, at most half full, that compares
+ * with the values themselves, so there is no node or key per value.
+ */
+template<typename Value>
+std::vector<GLuint> findFirstEqual(const std::vector<Value>& values, float inverseEpsilon) {
+    // a value and the hash of its key, value 0 is an empty slot
+    struct Slot {
+        uint32_t hash;
+        uint32_t value;
+    };
+
+    size_t slotCount = 16;
+    while (slotCount < 2 * values.size()) {
+        slotCount *= 2;
+    }
+
+    std::vector<Slot> slots(slotCount, Slot{ 0, 0 });
+    std::vector<GLuint> first(values.size());
+    size_t mask = slotCount - 1;
+
+    for (size_t i = 0; i < values.size(); i++) {
+        auto key = weldKey(values[i], inverseEpsilon);
+        uint32_t hash = hashKey(key);
+        size_t slot = hash & mask;
+
+        while (slots[slot].value != 0 &&
+               (slots[slot].hash != hash || weldKey(values[slots[slot].value - 1], inverseEpsilon) != key)) {
+            slot = (slot + 1) & mask;
+        }
+
+        if (slots[slot].value == 0) {
+            slots[slot] = { hash, static_cast<uint32_t>(i + 1) };
+        }
+
+        first[i] = slots[slot].value - 1;
+    }
+
+    return first;
+}
+
+} // namespace
+
+void parseObj(const char *begin, const char *end, ObjData& data) {
+    size_t bytes = size_t(end - begin);
+    unsigned chunkCount = unsigned(std::min<size_t>(ThreadPool::global().getThreadCount(), bytes / MIN_CHUNK_BYTES));
+
+    if (chunkCount <= 1) {
+        parseLines(begin, end, ObjCounts{ 0, 0, 0 }, data);
+        return;
+    }
+
+    // the chunks start after the first line break past an even split
+    std::vector<const char *> starts(chunkCount + 1, end);
+    starts[0] = begin;
+
+    for (unsigned i = 1; i < chunkCount; i++) {
+        const char *split = std::max(starts[i - 1], begin + bytes * i / chunkCount);
+        const char *lineBreak = static_cast<const char *>(std::memchr(split, '\n', size_t(end - split)));
+        starts[i] = lineBreak != nullptr ? lineBreak + 1 : end;
+    }
+
+    std::vector<ObjData> chunks(chunkCount);
+    std::vector<ObjCounts> bases(chunkCount, ObjCounts{ data.positions.size(), data.normals.size(), data.textureCoords.size() });
+    std::vector<char> relative(chunkCount, 0);
+
+    ThreadPool::global().parallelFor(0, chunkCount, [&](unsigned first, unsigned last) {
+        for (unsigned i = first; i < last; i++) {
+            relative[i] = parseLines(starts[i], starts[i + 1], bases[i], chunks[i]);
+        }
+    });
+
+    // relative indices count back from the values before them, which are
+    // only known for the later chunks now. The few files that use them have
+    // those chunks parsed again, knowing what came before.
+    bool reparse = false;
+    for (unsigned i = 1; i < chunkCount; i++) {
+        bases[i] = { bases[i - 1].positions + chunks[i - 1].positions.size(),
+                     bases[i - 1].normals + chunks[i - 1].normals.size(),
+                     bases[i - 1].textureCoords + chunks[i - 1].textureCoords.size() };
+        reparse |= relative[i] != 0;
+    }
+
+    if (reparse) {
+        ThreadPool::global().parallelFor(1, chunkCount, [&](unsigned first, unsigned last) {
+            for (unsigned i = first; i < last; i++) {
+                if (relative[i] != 0) {
+                    chunks[i] = ObjData();
+                    parseLines(starts[i], starts[i + 1], bases[i], chunks[i]);
+                }
+            }
+        });
+    }
+
+    // the indices now all count from the start of the file, so the chunks
+    // are simply appended, and freed once they are
+    size_t positions = 0, normals = 0, textureCoords = 0, positionIndices = 0, normalIndices = 0, textureCoordIndices = 0;
+    for (const ObjData& chunk : chunks) {
+        positions += chunk.positions.size();
+        normals += chunk.normals.size();
+        textureCoords += chunk.textureCoords.size();
+        positionIndices += chunk.positionIndices.size();
+        normalIndices += chunk.normalIndices.size();
+        textureCoordIndices += chunk.textureCoordIndices.size();
+    }
+
+    data.positions.reserve(data.positions.size() + positions);
+    data.normals.reserve(data.normals.size() + normals);
+    data.textureCoords.reserve(data.textureCoords.size() + textureCoords);
+    data.positionIndices.reserve(data.positionIndices.size() + positionIndices);
+    data.normalIndices.reserve(data.normalIndices.size() + normalIndices);
+    data.textureCoordIndices.reserve(data.textureCoordIndices.size() + textureCoordIndices);
+
+    for (ObjData& chunk : chunks) {
+        append(data.positions, chunk.positions);
+        append(data.normals, chunk.normals);
+        append(data.textureCoords, chunk.textureCoords);
+        append(data.positionIndices, chunk.positionIndices);
+        append(data.normalIndices, chunk.normalIndices);
+        append(data.textureCoordIndices, chunk.textureCoordIndices);
+    }
+}
+
+bool parseObj(const QString& path, ObjData& data) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << ":: Can't open model" << path << ":" << file.errorString();
+        return false;
+    }
+
+    qint64 size = file.size();
+    if (size == 0) {
+        return true;
+    }
+
+    uchar *mapping = file.map(0, size);
+    if (mapping == nullptr) {
+        qWarning() << ":: Can't map model" << path << ":" << file.errorString();
+        return false;
+    }
+
+    const char *text = reinterpret_cast<const char *>(mapping);
+    parseObj(text, text + size, data);
+
+    file.unmap(mapping);
+    return true;
+}
+
+namespace {
+
+// the first index that is not below count, or indices.size()
+size_t findInvalidIndex(const std::vector<GLuint>& indices, size_t count) {
+    for (size_t i = 0; i < indices.size(); i++) {
+        if (indices[i] >= count) {
+            return i;
+        }
+    }
+
+    return indices.size();
+}
+
+} // namespace
+
+bool checkObjIndices(const ObjData& data) {
+    size_t corners = data.positionIndices.size();
+
+    struct Attribute {
+        const char *name;
+        const std::vector<GLuint>& indices;
+        size_t count;
+        bool used;
+    };
+
+    const Attribute attributes[] = {
+        { "position", data.positionIndices, data.positions.size(), true },
+        { "normal", data.normalIndices, data.normals.size(), !data.normals.empty() && data.normalIndices.size() == corners },
+        { "texture coordinate", data.textureCoordIndices, data.textureCoords.size(),
+          !data.textureCoords.empty() && data.textureCoordIndices.size() == corners }
+    };
+
+    for (const Attribute& attribute : attributes) {
+        size_t invalid = attribute.used ? findInvalidIndex(attribute.indices, attribute.count) : attribute.indices.size();
+        if (invalid < attribute.indices.size()) {
+            qWarning() << ":: Face corner" << invalid << "refers to a missing" << attribute.name << "of" << attribute.count;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief weldObj
+ *
+ * Two corners have equal vertices exactly when their positions, normals
+ * and texture coordinates are equal, so those are deduplicated on their
+ * own first, with a lookup per value instead of per corner. The corners
+ * are then welded on the triple of the first equal values: every position
+ * keeps a chain of the vertices that use it, which is usually one long and
+ * is visited in about the order of the file.
+ */
+bool weldObj(ObjData& data, float weldEpsilon, std::vector<vertex>& vertices) {
+    const uint32_t noVertex = std::numeric_limits<uint32_t>::max();
+
+    // the indices address the tables below, so they are all checked up front
+    vertices.clear();
+    if (!checkObjIndices(data)) {
+        return false;
+    }
+
+    size_t corners = data.positionIndices.size();
+    bool withNormals = !data.normals.empty() && data.normalIndices.size() == corners;
+    bool withTextureCoords = !data.textureCoords.empty() && data.textureCoordIndices.size() == corners;
+    float inverseEpsilon = weldEpsilon > 0.0f ? 1.0f / weldEpsilon : 0.0f;
+
+    std::vector<GLuint> firstPosition = findFirstEqual(data.positions, inverseEpsilon);
+    std::vector<GLuint> firstNormal = withNormals ? findFirstEqual(data.normals, inverseEpsilon) : std::vector<GLuint>();
+    std::vector<GLuint> firstTextureCoord = withTextureCoords ? findFirstEqual(data.textureCoords, inverseEpsilon) : std::vector<GLuint>();
+
+    // there are at least as many vertices as positions, normals or texture coordinates that are used
+    size_t expected = std::min(std::max(std::max(data.positions.size(), data.normals.size()), data.textureCoords.size()), corners);
+    vertices.reserve(expected);
+
+    // the vertices of every position, and the normal and texture coordinates they were welded on
+    std::vector<uint32_t> firstVertex(data.positions.size(), noVertex);
+    std::vector<uint32_t> nextVertex;
+    std::vector<uint32_t> vertexNormal;
+    std::vector<uint32_t> vertexTextureCoord;
+    nextVertex.reserve(expected);
+    vertexNormal.reserve(expected);
+    vertexTextureCoord.reserve(expected);
+
+    for (size_t i = 0; i < corners; i++) {
+        GLuint position = data.positionIndices[i];
+        uint32_t welded = firstPosition[position];
+        uint32_t normal = withNormals ? firstNormal[data.normalIndices[i]] : 0;
+        uint32_t textureCoord = withTextureCoords ? firstTextureCoord[data.textureCoordIndices[i]] : 0;
+
+        uint32_t found = firstVertex[welded];
+        while (found != noVertex && (vertexNormal[found] != normal || vertexTextureCoord[found] != textureCoord)) {
+            found = nextVertex[found];
+        }
+
+        if (found == noVertex) {
+            // a new vertex, with the values of this corner
+            const QVector3D& p = data.positions[position];
+            QVector3D n = withNormals ? data.normals[data.normalIndices[i]] : QVector3D(0, 0, 0);
+            QVector2D t = withTextureCoords ? data.textureCoords[data.textureCoordIndices[i]] : QVector2D(0, 0);
+
+            found = static_cast<uint32_t>(vertices.size());
+            vertices.push_back({ p.x(), p.y(), p.z(), n.x(), n.y(), n.z(), 0, 0, 0, t.x(), t.y() });
+
+            nextVertex.push_back(firstVertex[welded]);
+            vertexNormal.push_back(normal);
+            vertexTextureCoord.push_back(textureCoord);
+            firstVertex[welded] = found;
+        }
+
+        // the corner has been read, so its position index can hold its vertex
+        data.positionIndices[i] = found;
+    }
+
+    return true;
+}
+
+MeshData loadObjMesh(const QString& path, float weldEpsilon) {
+    MeshData mesh;
+
+    ObjData data;
+    if (!parseObj(path, data)) {
+        return mesh;
+    }
+
+    if (!weldObj(data, weldEpsilon, mesh.vertices)) {
+        qWarning() << ":: Can't load model" << path;
+        return mesh;
+    }
+
+    // the indices are the vectors the position indices were parsed into,
+    // everything else that was parsed is freed before the mesh is used
+    mesh.indices.swap(data.positionIndices);
+    data = ObjData();
+
+    return mesh;
+}
@@ -0,0 +1,92 @@
+#ifndef OBJPARSER_H
+#define OBJPARSER_H
+
+#include "meshdata.h"
+
+#include <QString>
+#include <QVector2D>
+#include <QVector3D>
+
+#include <vector>
+
+// what parseObj gives indices that don't refer to any value, such as 0
+const GLuint INVALID_OBJ_INDEX = 0xffffffffu;
+
+/**
+ * The geometry of a Wavefront .obj file: the positions, normals and texture
+ * coordinates, and for every face corner the 0-based indices into them
+ */
+struct ObjData {
+    std::vector<QVector3D> positions;
+    std::vector<QVector3D> normals;
+    std::vector<QVector2D> textureCoords;
+
+    std::vector<GLuint> positionIndices;
+    std::vector<GLuint> normalIndices;
+    std::vector<GLuint> textureCoordIndices;
+};
+
+/**
+ * @brief parseObj
+ *
+ * Reads the v, vn, vt and f lines of an OBJ file. The file is memory-mapped
+ * and parsed straight from the mapping, and large files are split into
+ * chunks of whole lines that are parsed in parallel on the global thread
+ * pool, and merged in order afterwards.
+ *
+ * Numbers are parsed the way QString::toFloat does, so the result is the
+ * same as that of reading the file line by line. Relative (negative)
+ * indices are resolved against the values defined before their face, and
+ * index 0 gives INVALID_OBJ_INDEX. Indices are not checked against the
+ * numbers of values. The faces are not triangulated, every corner is added.
+ *
+ * @return false if the file can't be read
+ */
+bool parseObj(const QString& path, ObjData& data);
+
+/**
+ * @brief parseObj
+ *
+ * Parses OBJ text that is already in memory, as above
+ */
+void parseObj(const char *begin, const char *end, ObjData& data);
+
+/**
+ * @brief checkObjIndices
+ *
+ * Whether every index of the corners refers to a value of data, for the
+ * normals and texture coordinates only if every corner has one, like
+ * weldObj uses them. Warns about the first index that doesn't.
+ */
+bool checkObjIndices(const ObjData& data);
+
+/**
+ * @brief weldObj
+ *
+ * Gives every distinct combination of position, normal and texture
+ * coordinates among the face corners one vertex, in the order in which
+ * they are first used, and writes the vertices straight into the
+ * interleaved vertex array. Corners without normals or texture
+ * coordinates get zeros, and all tangents are zero. Takes linear time.
+ *
+ * @param data the parsed file. Its positionIndices are replaced by the
+ * index of the vertex of every corner, the triangle list of the mesh.
+ * @param weldEpsilon 0 only welds exactly equal corners, otherwise corners
+ * whose values round to the same multiples of it. The first corner's
+ * values are kept.
+ * @return false, with no vertices, if checkObjIndices fails
+ */
+bool weldObj(ObjData& data, float weldEpsilon, std::vector<vertex>& vertices);
+
+/**
+ * @brief loadObjMesh
+ *
+ * Parses and welds an OBJ file into the vertices and indices of a mesh,
+ * without building any other copy of them. The parsed values are freed
+ * before it returns, and the mesh is moved out.
+ *
+ * @return the mesh, empty if the file can't be read or has indices out of range
+ */
+MeshData loadObjMesh(const QString& path, float weldEpsilon = 0.0f);
+
+#endif // OBJPARSER_H
@@ -22,9 +22,116 @@ out vec2 vertTexture;
 uniform float waterHeight;
 uniform int clipSign;
 
+// height texture terrains: 0 = vertex attributes, 1 = heights,
+// 2 = heights and packed normals, 3 = level of detail patches
+uniform int heightmapMode;
+uniform sampler2D heightTexture;
+uniform sampler2D heightNormalTexture;
+uniform vec2 uvOffset;
+
+// level of detail patches: the first grid point and the vertex spacing of
+// the node, the vertices per side of the patch, and the distances between
+// which the vertices morph to the next level
+uniform vec3 lodNode;
+uniform int lodPatchSize;
+uniform vec2 lodMorph;
+uniform vec3 lodCameraPosition;
+
+// compact vertices: 0 = full floats, 1 = octahedral directions and
+// uvs normalized to the uv range of the mesh
+uniform int vertexFormat;
+uniform vec2 uvScale;
+uniform vec2 uvBias;
+
+float heightAt(int x, int z) {
+    return texelFetch(heightTexture, ivec2(z, x), 0).r;
+}
+
+// bilinear height between grid points, clamped to the grid
+float heightBetween(vec2 grid) {
+    int size = textureSize(heightTexture, 0).x;
+    vec2 clamped = clamp(grid, vec2(0.0), vec2(size - 1));
+
+    ivec2 first = ivec2(floor(clamped));
+    ivec2 last = min(first + 1, ivec2(size - 1));
+    vec2 f = clamped - vec2(first);
+
+    float low = mix(heightAt(first.x, first.y), heightAt(first.x, last.y), f.y);
+    float high = mix(heightAt(last.x, first.y), heightAt(last.x, last.y), f.y);
+    return mix(low, high, f.x);
+}
+
+vec3 gridCoordinates(vec2 grid) {
+    float halfSize = textureSize(heightTexture, 0).x / 2.0;
+    return vec3(grid.x - halfSize, heightBetween(grid), grid.y - halfSize);
+}
+
+vec3 octDecode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0) {
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
 void main() {
+    vec3 coordinates = vertCoordinates_in;
+    vec3 normal = vertNormal_in;
+    vec3 tangent = vertTangent_in;
+    vec2 uv = vertTexture_in * uvScale + uvBias;
+
+    if (vertexFormat == 1) {
+        normal = octDecode(vertNormal_in.xy);
+        tangent = octDecode(vertTangent_in.xy);
+    }
+
+    if (heightmapMode == 3) {
+        int px = gl_VertexID / lodPatchSize;
+        int pz = gl_VertexID - px * lodPatchSize;
+        float spacing = lodNode.z;
+        vec2 grid = lodNode.xy + vec2(px, pz) * spacing;
+
+        // the odd vertices of the level slide onto their even neighbours
+        // near the end of its range, where the next level takes over
+        vec3 unmorphed = (modelMatrix * vec4(gridCoordinates(grid), 1.0)).xyz;
+        float morph = clamp((distance(unmorphed, lodCameraPosition) - lodMorph.x) / (lodMorph.y - lodMorph.x), 0.0, 1.0);
+        grid -= mod(grid / spacing, 2.0) * spacing * morph;
+
+        coordinates = gridCoordinates(grid);
+        uv = (uvOffset + grid) / 10.0;
+
+        // central differences over the vertex spacing of the level
+        float dx = (heightBetween(grid - vec2(spacing, 0.0)) - heightBetween(grid + vec2(spacing, 0.0))) / (2.0 * spacing);
+        float dz = (heightBetween(grid - vec2(0.0, spacing)) - heightBetween(grid + vec2(0.0, spacing))) / (2.0 * spacing);
+        normal = normalize(vec3(dx, 1.0, dz));
+        tangent = normalize(vec3(normal.y, -normal.x, 0.0));
+    } else if (heightmapMode != 0) {
+        // the vertices of a grid are numbered row by row
+        int size = textureSize(heightTexture, 0).x;
+        int x = gl_VertexID / size;
+        int z = gl_VertexID - x * size;
 
-    vec4 worldSpaceCoordinates = modelMatrix * vec4(vertCoordinates_in, 1.0);
+        coordinates = vec3(float(x) - size / 2.0, heightAt(x, z), float(z) - size / 2.0);
+        uv = (uvOffset + vec2(x, z)) / 10.0;
+
+        if (heightmapMode == 2) {
+            vec2 packedNormal = texelFetch(heightNormalTexture, ivec2(z, x), 0).rg;
+            normal = vec3(packedNormal.x, sqrt(max(0.0, 1.0 - dot(packedNormal, packedNormal))), packedNormal.y);
+        } else {
+            // central differences, one-sided on the edges
+            int xneg = max(x - 1, 0), xpos = min(x + 1, size - 1);
+            int zneg = max(z - 1, 0), zpos = min(z + 1, size - 1);
+
+            float dx = (heightAt(xneg, z) - heightAt(xpos, z)) / float(max(xpos - xneg, 1));
+            float dz = (heightAt(x, zneg) - heightAt(x, zpos)) / float(max(zpos - zneg, 1));
+            normal = normalize(vec3(dx, 1.0, dz));
+        }
+
+        // the tangent points along x, like the one computed on the CPU
+        tangent = normalize(vec3(normal.y, -normal.x, 0.0));
+    }
+
+    vec4 worldSpaceCoordinates = modelMatrix * vec4(coordinates, 1.0);
     gl_Position = projMatrix * viewMatrix * worldSpaceCoordinates;
 
     // set the clip distance
@@ -34,12 +141,9 @@ void main() {
         gl_ClipDistance[0] = clipSign * (worldSpaceCoordinates.y - waterHeight);
     }
 
-    // calculate the tangent vector
-    vec4 tangent = modelMatrix * vec4(vertTangent_in, 0.0);
-
     // send the attributes to the fragment shader
     vertCoordinates = worldSpaceCoordinates.xyz;
-    vertNormal = normalModelMatrix * vertNormal_in;
-    vertTangent = tangent.xyz;
-    vertTexture = vertTexture_in;
+    vertNormal = normalModelMatrix * normal;
+    vertTangent = (modelMatrix * vec4(tangent, 0.0)).xyz;
+    vertTexture = uv;
 }
@@ -17,6 +17,10 @@ out vec3 vertCoordinates;
 out vec2 vertTexture;
 out vec4 position;
 
+// compact vertices store their uvs normalized to the uv range of the mesh
+uniform vec2 uvScale;
+uniform vec2 uvBias;
+
 void main() {
     vec4 worldSpaceCoordinates = modelMatrix * vec4(vertCoordinates_in, 1.0);
 
@@ -25,5 +29,5 @@ void main() {
 
     // send the attributes to the fragment shader
     vertCoordinates = worldSpaceCoordinates.xyz;
-    vertTexture = vertTexture_in;
+    vertTexture = vertTexture_in * uvScale + uvBias;
 }
@@ -0,0 +1,72 @@
+#include "simd.h"
+
+#include <atomic>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+SimdLevel detectSimdLevel() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        return SimdLevel::AVX2;
+    }
+
+    if (__builtin_cpu_supports("sse2")) {
+        return SimdLevel::SSE2;
+    }
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    bool sse2 = (info[3] & (1 << 26)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+
+    // the OS has to save the YMM registers for AVX to be usable
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+
+        if (info[1] & (1 << 5)) {
+            return SimdLevel::AVX2;
+        }
+    }
+
+    if (sse2) {
+        return SimdLevel::SSE2;
+    }
+#endif
+
+    return SimdLevel::Scalar;
+}
+
+static std::atomic<SimdLevel>& activeLevel() {
+    static std::atomic<SimdLevel> level(detectSimdLevel());
+    return level;
+}
+
+SimdLevel getSimdLevel() {
+    return activeLevel().load(std::memory_order_relaxed);
+}
+
+void setSimdLevel(SimdLevel level) {
+    SimdLevel supported = detectSimdLevel();
+
+    if (static_cast<int>(level) > static_cast<int>(supported)) {
+        level = supported;
+    }
+
+    activeLevel().store(level, std::memory_order_relaxed);
+}
+
+const char *getSimdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::AVX2: return "avx2";
+    case SimdLevel::SSE2: return "sse2";
+    default:              return "scalar";
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/**
+ * The instruction sets the vectorized kernels can be dispatched to,
+ * from least to most capable.
+ */
+enum class SimdLevel {
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+/**
+ * @brief detectSimdLevel
+ *
+ * Queries the CPU for the best instruction set it supports
+ */
+SimdLevel detectSimdLevel();
+
+/**
+ * @brief getSimdLevel
+ *
+ * The instruction set the kernels currently dispatch to. Defaults
+ * to detectSimdLevel().
+ */
+SimdLevel getSimdLevel();
+
+/**
+ * @brief setSimdLevel
+ *
+ * Overrides the dispatched instruction set, e.g. to compare kernels.
+ * Levels the CPU does not support are clamped to the detected level.
+ */
+void setSimdLevel(SimdLevel level);
+
+const char *getSimdLevelName(SimdLevel level);
+
+#endif // SIMD_H
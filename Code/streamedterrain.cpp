@@ -0,0 +1,46 @@
+#include "streamedterrain.h"
+#include "threadpool.h"
+
+unsigned getStreamedBlockTiles(const TerrainFileWriter& writer, size_t memoryBudget,
+                               const std::function<size_t(unsigned columns)>& cursorBytes) {
+    uint64_t tileQuads = writer.getTileQuads();
+    uint64_t threads = ThreadPool::global().getThreadCount();
+
+    // the working set of a block of blockTiles by blockTiles tiles
+    auto blockBytes = [&](uint64_t blockTiles) -> uint64_t {
+        uint64_t points = blockTiles * tileQuads + 3;
+        uint64_t bytes = points * (points + Heightfield::ALIGNMENT / sizeof(float)) * sizeof(float);
+
+        if (writer.hasNormals()) {
+            bytes += points * points * 3 * sizeof(float);
+        }
+
+        // the mapped tile row, and the cursors every thread keeps while walking the stages.
+        // The scratch arenas hold at least a block of 64 KB and keep blocks that are only
+        // partly used, so the cursors are counted twice on top of that.
+        unsigned columns = static_cast<unsigned>(std::min<uint64_t>(points, writer.getGridSize()));
+        bytes += blockTiles * writer.getTileBytes();
+        bytes += threads * (2 * cursorBytes(columns) + 64 * 1024);
+
+        // the program itself, and the pages the kernel maps around the ones that are written
+        bytes += 16 * 1024 * 1024;
+
+        return bytes;
+    };
+
+    if (blockBytes(1) > memoryBudget) {
+        qWarning() << ":: A memory budget of" << memoryBudget / (1024 * 1024) << "MB is too small, generating"
+                   << "single tiles needs" << blockBytes(1) / (1024 * 1024) << "MB";
+        return 0;
+    }
+
+    unsigned blockTiles = 1;
+    while (blockTiles < writer.getTiles() && blockBytes(blockTiles + 1) <= memoryBudget) {
+        blockTiles++;
+    }
+
+    // blocks of about the same size, so the memory of a small last block isn't kept by
+    // the allocator while the next large block is allocated beside it
+    unsigned blocks = (writer.getTiles() + blockTiles - 1) / blockTiles;
+    return (writer.getTiles() + blocks - 1) / blocks;
+}
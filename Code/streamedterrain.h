@@ -0,0 +1,107 @@
+#ifndef STREAMEDTERRAIN_H
+#define STREAMEDTERRAIN_H
+
+#include "terrainfile.h"
+#include "terrainpipeline.h"
+#include "normals.h"
+
+#include <QDebug>
+#include <QString>
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/**
+ * @brief getStreamedBlockTiles
+ *
+ * The tiles per side of the blocks generateStreamedTerrain generates at
+ * once: the largest blocks whose heights, normals, mapped tile row and
+ * stage cursors fit in memoryBudget bytes. The tile directory is written
+ * through the file, so it takes no memory. Returns 0 if not even single
+ * tiles fit.
+ *
+ * @param cursorBytes the scratch memory the cursors of the stages take on
+ *        one thread for a block of that many columns, see getCursorBytes
+ *        of the stages
+ */
+unsigned getStreamedBlockTiles(const TerrainFileWriter& writer, size_t memoryBudget,
+                               const std::function<size_t(unsigned columns)>& cursorBytes);
+
+/**
+ * @brief generateStreamedTerrain
+ *
+ * Generates a terrain straight into a terrain file, one square block of
+ * tiles at a time, so terrains far larger than memory can be generated.
+ * Each block is generated with a border of one point, so the normals on
+ * its edges are central differences like everywhere else. The file is
+ * bit for bit the file NoiseGrid::writeTerrainFile writes for the same
+ * stages and grid.
+ *
+ * @param path the file to write
+ * @param stage the pipeline to generate the terrain with
+ * @param info what to record about the terrain, its grid is 2^info.detail + 1 vertices wide
+ * @param withNormals whether to store normals
+ * @param memoryBudget the memory the generation may use, in bytes
+ * @return whether the file was written, false as well if single tiles
+ *         don't fit in the memory budget
+ */
+template<typename Stage>
+bool generateStreamedTerrain(const QString& path, const Stage& stage, const TerrainFileInfo& info, bool withNormals,
+                             size_t memoryBudget) {
+    TerrainFileWriter writer(path, info, withNormals);
+    if (!writer.isOpen()) {
+        return false;
+    }
+
+    unsigned size = writer.getGridSize();
+    unsigned tiles = writer.getTiles();
+    unsigned tileQuads = writer.getTileQuads();
+    PipelineGrid grid = { size, 0, 0 };
+
+    unsigned blockTiles = getStreamedBlockTiles(writer, memoryBudget, [&](unsigned columns) {
+        return stage.getCursorBytes(grid, columns);
+    });
+    if (blockTiles == 0) {
+        return false;
+    }
+
+    // allocated once for the largest block, so growing it never holds two copies
+    std::vector<float> normals;
+    if (withNormals) {
+        size_t points = std::min(size_t(blockTiles) * tileQuads + 3, size_t(size));
+        normals.reserve(3 * points * points);
+    }
+
+    for (unsigned tileX = 0; tileX < tiles; tileX += blockTiles) {
+        for (unsigned tileZ = 0; tileZ < tiles; tileZ += blockTiles) {
+            unsigned tileRows = std::min(blockTiles, tiles - tileX);
+            unsigned tileColumns = std::min(blockTiles, tiles - tileZ);
+
+            // the points of the tiles, and one more on the sides that have a neighbour
+            unsigned firstX = tileX > 0 ? tileX * tileQuads - 1 : 0;
+            unsigned firstZ = tileZ > 0 ? tileZ * tileQuads - 1 : 0;
+            unsigned lastX = std::min((tileX + tileRows) * tileQuads + 1, size - 1);
+            unsigned lastZ = std::min((tileZ + tileColumns) * tileQuads + 1, size - 1);
+
+            Heightfield heights(lastX - firstX + 1, lastZ - firstZ + 1);
+            addPipeline(heights, grid, stage, firstX, firstZ);
+
+            // the border points get one-sided normals, but only the tiles are written
+            if (withNormals) {
+                normals.resize(3 * size_t(heights.getRows()) * heights.getColumns());
+                computeGridNormals(heights, nullptr, normals.data(), nullptr, 3);
+            }
+
+            if (!writer.writeTiles(tileX, tileZ, tileRows, tileColumns, heights, firstX, firstZ,
+                                   withNormals ? normals.data() : nullptr)) {
+                return false;
+            }
+        }
+    }
+
+    return writer.commit();
+}
+
+#endif // STREAMEDTERRAIN_H
@@ -0,0 +1,426 @@
+#include "terrainfile.h"
+#include "threadpool.h"
+
+#include <QDebug>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const char MAGIC[8] = { 'T', 'E', 'R', 'R', 'A', 'I', 'N', 0 };
+
+inline uint64_t alignUp(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+TerrainFile::TerrainFile() :
+        data(nullptr), header(nullptr), directory(nullptr) {
+}
+
+TerrainFile::~TerrainFile() {
+    if (data != nullptr) {
+        file.unmap(const_cast<uchar *>(data));
+    }
+}
+
+std::shared_ptr<const TerrainFile> TerrainFile::open(const QString& path) {
+    std::shared_ptr<TerrainFile> terrain(new TerrainFile());
+    terrain->file.setFileName(path);
+
+    if (!terrain->file.open(QIODevice::ReadOnly)) {
+        qWarning() << ":: Can't open terrain file" << path << ":" << terrain->file.errorString();
+        return nullptr;
+    }
+
+    qint64 fileSize = terrain->file.size();
+    if (fileSize < qint64(sizeof(Header))) {
+        qWarning() << ":: Terrain file" << path << "is too small";
+        return nullptr;
+    }
+
+    terrain->data = terrain->file.map(0, fileSize);
+    if (terrain->data == nullptr) {
+        qWarning() << ":: Can't map terrain file" << path << ":" << terrain->file.errorString();
+        return nullptr;
+    }
+
+    // the header is checked completely before anything else is read, so
+    // a truncated or foreign file never leads outside of the mapping
+    const Header *header = reinterpret_cast<const Header *>(terrain->data);
+    uint64_t tiles = header->tiles;
+    uint64_t tileSize = uint64_t(header->tileQuads) + 1;
+    uint64_t heightSize = header->encoding == uint32_t(HeightEncoding::UInt16) ? sizeof(uint16_t) : sizeof(float);
+
+    // the sizes are compared by subtracting from the file size, so a corrupt header can't wrap them around
+    bool valid = std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) == 0 && header->version == VERSION &&
+            header->detail < 31 && header->gridSize == (1u << header->detail) + 1 &&
+            header->tileQuads > 0 && tiles * header->tileQuads + 1 == header->gridSize &&
+            header->encoding <= uint32_t(HeightEncoding::UInt16) &&
+            header->fileSize == uint64_t(fileSize) &&
+            tiles * tiles <= (uint64_t(fileSize) - sizeof(Header)) / sizeof(Tile);
+    uint64_t directoryEnd = sizeof(Header) + tiles * tiles * sizeof(Tile);
+
+    if (valid) {
+        terrain->header = header;
+        terrain->directory = reinterpret_cast<const Tile *>(terrain->data + sizeof(Header));
+
+        for (uint64_t i = 0; valid && i < tiles * tiles; i++) {
+            const Tile& tile = terrain->directory[i];
+            valid = tile.heightsOffset % TILE_ALIGNMENT == 0 && tile.heightsOffset >= directoryEnd &&
+                    tile.heightsOffset <= uint64_t(fileSize) &&
+                    tileSize * tileSize * heightSize <= uint64_t(fileSize) - tile.heightsOffset;
+
+            if (valid && terrain->hasNormals()) {
+                valid = tile.normalsOffset % TILE_ALIGNMENT == 0 && tile.normalsOffset >= directoryEnd &&
+                        tile.normalsOffset <= uint64_t(fileSize) &&
+                        tileSize * tileSize * 2 * sizeof(int16_t) <= uint64_t(fileSize) - tile.normalsOffset;
+            }
+        }
+    }
+
+    if (!valid) {
+        qWarning() << ":: File" << path << "is not a valid terrain file";
+        return nullptr;
+    }
+
+    TerrainFileInfo& info = terrain->info;
+    info.detail = header->detail;
+    info.seed = header->seed;
+    info.placement.offsetX = header->offsetX;
+    info.placement.offsetZ = header->offsetZ;
+    info.placement.heightScale = header->heightScale;
+    info.placement.heightOffset = header->heightOffset;
+    info.tileQuads = header->tileQuads;
+    info.encoding = static_cast<HeightEncoding>(header->encoding);
+
+    return terrain;
+}
+
+TerrainFile::Header TerrainFile::createHeader(const TerrainFileInfo& info, unsigned gridSize, bool withNormals) {
+    unsigned tiles = (gridSize - 1) / info.tileQuads;
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.detail = info.detail;
+    header.gridSize = gridSize;
+    header.tileQuads = info.tileQuads;
+    header.tiles = tiles;
+    header.encoding = static_cast<uint32_t>(info.encoding);
+    header.flags = withNormals ? FLAG_NORMALS : 0;
+    header.seed = info.seed;
+    header.offsetX = info.placement.offsetX;
+    header.offsetZ = info.placement.offsetZ;
+    header.heightScale = info.placement.heightScale;
+    header.heightOffset = info.placement.heightOffset;
+
+    uint64_t tileCount = uint64_t(tiles) * tiles;
+    header.fileSize = getTileLayout(header, 0).heightsOffset + tileCount * getTileBytes(header);
+
+    return header;
+}
+
+uint64_t TerrainFile::getTileBytes(const Header& header) {
+    uint64_t tileSize = uint64_t(header.tileQuads) + 1;
+    bool quantized = header.encoding == uint32_t(HeightEncoding::UInt16);
+
+    uint64_t heightBytes = tileSize * tileSize * (quantized ? sizeof(uint16_t) : sizeof(float));
+    uint64_t normalBytes = (header.flags & FLAG_NORMALS) != 0 ? tileSize * tileSize * 2 * sizeof(int16_t) : 0;
+
+    return alignUp(heightBytes, TILE_ALIGNMENT) + alignUp(normalBytes, TILE_ALIGNMENT);
+}
+
+TerrainFile::Tile TerrainFile::getTileLayout(const Header& header, uint64_t index) {
+    uint64_t tileCount = uint64_t(header.tiles) * header.tiles;
+    uint64_t tileSize = uint64_t(header.tileQuads) + 1;
+    bool quantized = header.encoding == uint32_t(HeightEncoding::UInt16);
+
+    // the tiles follow the directory, each followed by its normals
+    Tile tile;
+    tile.heightsOffset = alignUp(sizeof(Header) + tileCount * sizeof(Tile), TILE_ALIGNMENT) + index * getTileBytes(header);
+    tile.normalsOffset = (header.flags & FLAG_NORMALS) != 0 ?
+            alignUp(tile.heightsOffset + tileSize * tileSize * (quantized ? sizeof(uint16_t) : sizeof(float)),
+                    TILE_ALIGNMENT) : 0;
+    tile.min = 0.0f;
+    tile.max = 0.0f;
+
+    return tile;
+}
+
+void TerrainFile::encodeTile(const Tile& tile, unsigned tileSize, HeightEncoding encoding,
+                             const float *heights, size_t heightStride, const float *normals, size_t normalStride,
+                             char *heightsTarget, char *normalsTarget) {
+    float scale = tile.max > tile.min ? 65535.0f / (tile.max - tile.min) : 0.0f;
+
+    for (unsigned x = 0; x < tileSize; x++) {
+        const float *source = heights + x * heightStride;
+
+        if (encoding == HeightEncoding::Float32) {
+            std::memcpy(heightsTarget + x * tileSize * sizeof(float), source, tileSize * sizeof(float));
+            continue;
+        }
+
+        uint16_t *target = reinterpret_cast<uint16_t *>(heightsTarget) + x * tileSize;
+        for (unsigned z = 0; z < tileSize; z++) {
+            float value = (source[z] - tile.min) * scale + 0.5f;
+            target[z] = static_cast<uint16_t>(std::min(std::max(value, 0.0f), 65535.0f));
+        }
+    }
+
+    if (normals == nullptr) {
+        return;
+    }
+
+    // packed like the normal textures of height texture grids
+    int16_t *tileNormals = reinterpret_cast<int16_t *>(normalsTarget);
+    for (unsigned x = 0; x < tileSize; x++) {
+        for (unsigned z = 0; z < tileSize; z++) {
+            const float *normal = normals + x * normalStride + 3 * z;
+            tileNormals[2 * (x * tileSize + z) + 0] = static_cast<int16_t>(std::lround(normal[0] * 32767.0f));
+            tileNormals[2 * (x * tileSize + z) + 1] = static_cast<int16_t>(std::lround(normal[2] * 32767.0f));
+        }
+    }
+}
+
+bool TerrainFile::write(const QString& path, const Heightfield& heights, const float *normals, const TerrainFileInfo& info) {
+    unsigned gridSize = heights.getRows();
+    unsigned tiles = (gridSize - 1) / info.tileQuads;
+    unsigned tileSize = info.tileQuads + 1;
+
+    Header header = createHeader(info, gridSize, normals != nullptr);
+
+    // the ranges go in the directory, so they are known before any tile is encoded
+    HeightPyramid pyramid(heights, info.tileQuads);
+    std::vector<Tile> directory(size_t(tiles) * tiles);
+    for (unsigned tx = 0; tx < tiles; tx++) {
+        for (unsigned tz = 0; tz < tiles; tz++) {
+            const HeightRange& range = pyramid.getRange(0, tx, tz);
+            directory[tx * tiles + tz] = getTileLayout(header, size_t(tx) * tiles + tz);
+            directory[tx * tiles + tz].min = range.min;
+            directory[tx * tiles + tz].max = range.max;
+        }
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << ":: Can't write terrain file" << path << ":" << file.errorString();
+        return false;
+    }
+
+    std::vector<char> head(directory.front().heightsOffset, 0);
+    std::memcpy(head.data(), &header, sizeof(header));
+    std::memcpy(head.data() + sizeof(header), directory.data(), directory.size() * sizeof(Tile));
+    file.write(head.data(), qint64(head.size()));
+
+    // every row of tiles is encoded in parallel, and then written in one go
+    uint64_t rowStart = directory.front().heightsOffset;
+    std::vector<char> row;
+
+    for (unsigned tx = 0; tx < tiles; tx++) {
+        uint64_t rowEnd = tx + 1 < tiles ? directory[(tx + 1) * tiles].heightsOffset : header.fileSize;
+        row.assign(rowEnd - rowStart, 0);
+
+        ThreadPool::global().parallelFor(0, tiles, [&](unsigned begin, unsigned end) {
+            for (unsigned tz = begin; tz < end; tz++) {
+                const Tile& tile = directory[tx * tiles + tz];
+                size_t first = size_t(tx) * info.tileQuads * gridSize + size_t(tz) * info.tileQuads;
+
+                encodeTile(tile, tileSize, info.encoding, heights.row(tx * info.tileQuads) + tz * info.tileQuads,
+                           heights.getStride(), normals != nullptr ? normals + 3 * first : nullptr, 3 * size_t(gridSize),
+                           row.data() + (tile.heightsOffset - rowStart),
+                           normals != nullptr ? row.data() + (tile.normalsOffset - rowStart) : nullptr);
+            }
+        });
+
+        file.write(row.data(), qint64(row.size()));
+        rowStart = rowEnd;
+    }
+
+    if (!file.commit()) {
+        qWarning() << ":: Can't write terrain file" << path << ":" << file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+HeightRange TerrainFile::getTileRange(unsigned tx, unsigned tz) const {
+    const Tile& tile = getTile(tx, tz);
+    return { tile.min, tile.max };
+}
+
+const float *TerrainFile::getTileHeights(unsigned tx, unsigned tz) const {
+    if (info.encoding != HeightEncoding::Float32) {
+        return nullptr;
+    }
+
+    return reinterpret_cast<const float *>(data + getTile(tx, tz).heightsOffset);
+}
+
+void TerrainFile::readTileHeights(unsigned tx, unsigned tz, float *heights) const {
+    const Tile& tile = getTile(tx, tz);
+    size_t count = size_t(header->tileQuads + 1) * (header->tileQuads + 1);
+
+    if (info.encoding == HeightEncoding::Float32) {
+        std::memcpy(heights, data + tile.heightsOffset, count * sizeof(float));
+        return;
+    }
+
+    const uint16_t *values = reinterpret_cast<const uint16_t *>(data + tile.heightsOffset);
+    float step = (tile.max - tile.min) / 65535.0f;
+
+    for (size_t i = 0; i < count; i++) {
+        heights[i] = tile.min + static_cast<float>(values[i]) * step;
+    }
+}
+
+const int16_t *TerrainFile::getTileNormals(unsigned tx, unsigned tz) const {
+    if (!hasNormals()) {
+        return nullptr;
+    }
+
+    return reinterpret_cast<const int16_t *>(data + getTile(tx, tz).normalsOffset);
+}
+
+TerrainFileWriter::TerrainFileWriter(const QString& path, const TerrainFileInfo& info, bool withNormals) :
+        path(path), file(path + ".part"), open(false), info(info) {
+    unsigned gridSize = (1u << info.detail) + 1;
+    header = TerrainFile::createHeader(info, gridSize, withNormals);
+
+    // the whole file is allocated up front, the tiles are filled in later
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate) || !file.resize(qint64(header.fileSize))) {
+        qWarning() << ":: Can't write terrain file" << file.fileName() << ":" << file.errorString();
+        return;
+    }
+
+    open = true;
+}
+
+TerrainFileWriter::~TerrainFileWriter() {
+    // a file that wasn't committed is incomplete
+    if (file.isOpen()) {
+        file.close();
+        file.remove();
+    }
+}
+
+uint64_t TerrainFileWriter::getTileBytes() const {
+    return TerrainFile::getTileBytes(header);
+}
+
+bool TerrainFileWriter::writeTiles(unsigned tileX, unsigned tileZ, unsigned tileRows, unsigned tileColumns,
+                                   const Heightfield& heights, unsigned firstX, unsigned firstZ, const float *normals) {
+    if (!open) {
+        return false;
+    }
+
+    unsigned tiles = header.tiles;
+    unsigned tileQuads = header.tileQuads;
+    unsigned tileSize = tileQuads + 1;
+    bool withNormals = hasNormals();
+
+    size_t normalStride = 3 * size_t(heights.getColumns());
+
+    // the directory entries of one tile row, written to the file along with the tiles
+    std::vector<TerrainFile::Tile> rowTiles(tileColumns);
+
+    // map one tile row of the block at a time, so only its pages are in memory,
+    // even if the kernel maps more pages around the ones that are written
+    for (unsigned tx = tileX; tx < tileX + tileRows; tx++) {
+        size_t first = size_t(tx) * tiles + tileZ;
+        uint64_t rowBegin = TerrainFile::getTileLayout(header, first).heightsOffset;
+        uint64_t rowEnd = rowBegin + tileColumns * getTileBytes();
+
+        uchar *mapping = file.map(qint64(rowBegin), qint64(rowEnd - rowBegin));
+        if (mapping == nullptr) {
+            qWarning() << ":: Can't map terrain file" << file.fileName() << ":" << file.errorString();
+            return false;
+        }
+
+        char *data = reinterpret_cast<char *>(mapping);
+        unsigned x = tx * tileQuads - firstX;
+
+        ThreadPool::global().parallelFor(tileZ, tileZ + tileColumns, [&](unsigned begin, unsigned end) {
+            for (unsigned tz = begin; tz < end; tz++) {
+                TerrainFile::Tile& tile = rowTiles[tz - tileZ];
+                tile = TerrainFile::getTileLayout(header, size_t(tx) * tiles + tz);
+
+                unsigned z = tz * tileQuads - firstZ;
+                const float *tileHeights = heights.row(x) + z;
+
+                // the range of the tile, including its borders like HeightPyramid
+                tile.min = tileHeights[0];
+                tile.max = tileHeights[0];
+
+                for (unsigned i = 0; i < tileSize; i++) {
+                    const float *row = heights.row(x + i) + z;
+
+                    for (unsigned j = 0; j < tileSize; j++) {
+                        tile.min = std::min(tile.min, row[j]);
+                        tile.max = std::max(tile.max, row[j]);
+                    }
+                }
+
+                TerrainFile::encodeTile(tile, tileSize, info.encoding, tileHeights, heights.getStride(),
+                                        withNormals ? normals + x * normalStride + 3 * size_t(z) : nullptr, normalStride,
+                                        data + (tile.heightsOffset - rowBegin),
+                                        withNormals ? data + (tile.normalsOffset - rowBegin) : nullptr);
+            }
+        });
+
+        // unmapping releases the pages, so the written tiles don't stay in memory
+        if (!file.unmap(mapping)) {
+            return false;
+        }
+
+        uint64_t entriesBegin = sizeof(TerrainFile::Header) + first * sizeof(TerrainFile::Tile);
+        mapping = file.map(qint64(entriesBegin), qint64(tileColumns * sizeof(TerrainFile::Tile)));
+        if (mapping == nullptr) {
+            qWarning() << ":: Can't map terrain file" << file.fileName() << ":" << file.errorString();
+            return false;
+        }
+
+        std::memcpy(mapping, rowTiles.data(), tileColumns * sizeof(TerrainFile::Tile));
+        if (!file.unmap(mapping)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool TerrainFileWriter::commit() {
+    if (!open) {
+        return false;
+    }
+
+    // the directory was written along with the tiles
+    uchar *mapping = file.map(0, qint64(sizeof(header)));
+
+    if (mapping == nullptr) {
+        qWarning() << ":: Can't map terrain file" << file.fileName() << ":" << file.errorString();
+        return false;
+    }
+
+    std::memcpy(mapping, &header, sizeof(header));
+    file.unmap(mapping);
+    file.close();
+
+    // rename doesn't replace an existing file
+    QFile::remove(path);
+    if (!QFile::rename(file.fileName(), path)) {
+        qWarning() << ":: Can't write terrain file" << path << ":" << file.errorString();
+        file.remove();
+        return false;
+    }
+
+    open = false;
+    return true;
+}
@@ -0,0 +1,257 @@
+#ifndef TERRAINFILE_H
+#define TERRAINFILE_H
+
+#include "heightfield.h"
+#include "heightpyramid.h"
+#include "gridsampling.h"
+
+#include <QFile>
+#include <QString>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * How the heights of a terrain file are stored
+ */
+enum class HeightEncoding : uint32_t {
+    // the heights as they were generated
+    Float32 = 0,
+
+    // 16-bit steps between the lowest and highest height of each tile
+    UInt16 = 1
+};
+
+/**
+ * What a terrain file records about its terrain, besides the heights
+ */
+struct TerrainFileInfo {
+    // the grid is 2^detail + 1 vertices wide
+    unsigned detail = 0;
+    uint64_t seed = 0;
+    GridPlacement placement;
+
+    // the quads per side of a tile, a power of two of at most 2^detail
+    unsigned tileQuads = 64;
+    HeightEncoding encoding = HeightEncoding::Float32;
+};
+
+/**
+ * @brief The TerrainFile class
+ *
+ * A terrain stored on disk, memory-mapped when it is opened. The file holds
+ * a header, a directory with the offset and height range of every tile,
+ * and the tiles themselves. A tile holds the tileQuads + 1 by tileQuads + 1
+ * heights of its part of the grid, including the vertices it shares with
+ * its neighbours, optionally followed by the x and z components of their
+ * normals as signed 16-bit values.
+ *
+ * Opening a file only reads its header and directory. The heights of a tile
+ * are paged in by the operating system when the tile is first read, and
+ * unquantized tiles can be read straight from the mapping, without copying.
+ *
+ * All values are stored little-endian, with the layout of the structs below.
+ */
+class TerrainFile {
+
+    friend class TerrainFileWriter;
+
+public:
+    /**
+     * @brief open
+     *
+     * Maps a terrain file. Returns nullptr if the file can't be mapped or is
+     * not a valid terrain file.
+     */
+    static std::shared_ptr<const TerrainFile> open(const QString& path);
+
+    /**
+     * @brief write
+     *
+     * Writes a grid to a terrain file. The file is replaced atomically, so
+     * it is never left half written.
+     *
+     * @param path the file to write
+     * @param heights a grid of 2^detail + 1 by 2^detail + 1 heights
+     * @param normals the normal of every grid point, three floats each in the
+     * order of the heights, or nullptr to store no normals
+     * @param info what to record about the terrain
+     * @return whether the file was written
+     */
+    static bool write(const QString& path, const Heightfield& heights, const float *normals, const TerrainFileInfo& info);
+
+    ~TerrainFile();
+
+    TerrainFile(const TerrainFile&) = delete;
+    TerrainFile& operator=(const TerrainFile&) = delete;
+
+    inline const TerrainFileInfo& getInfo() const { return info; }
+    inline unsigned getGridSize() const { return header->gridSize; }
+    inline bool hasNormals() const { return (header->flags & FLAG_NORMALS) != 0; }
+
+    // tiles per side, and quads per side of a tile
+    inline unsigned getTiles() const { return header->tiles; }
+    inline unsigned getTileQuads() const { return header->tileQuads; }
+
+    // the lowest and highest height of a tile, without reading its heights
+    HeightRange getTileRange(unsigned tx, unsigned tz) const;
+
+    /**
+     * @brief getTileHeights
+     *
+     * The heights of a tile straight from the mapping, row-major. Returns
+     * nullptr if the heights are quantized, use readTileHeights for those.
+     */
+    const float *getTileHeights(unsigned tx, unsigned tz) const;
+
+    /**
+     * @brief readTileHeights
+     *
+     * Decodes the heights of a tile into (tileQuads + 1)^2 floats, row-major
+     */
+    void readTileHeights(unsigned tx, unsigned tz, float *heights) const;
+
+    // the x and z components of the normals of a tile, or nullptr if the file has none
+    const int16_t *getTileNormals(unsigned tx, unsigned tz) const;
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t detail;
+        uint32_t gridSize;
+        uint32_t tileQuads;
+        uint32_t tiles;
+        uint32_t encoding;
+        uint32_t flags;
+        uint32_t reserved;
+        uint64_t seed;
+        float offsetX;
+        float offsetZ;
+        float heightScale;
+        float heightOffset;
+        uint64_t fileSize;
+    };
+
+    // the tile directory follows the header, row-major like the grid
+    struct Tile {
+        uint64_t heightsOffset;
+
+        // 0 if the file has no normals
+        uint64_t normalsOffset;
+        float min;
+        float max;
+    };
+
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t FLAG_NORMALS = 1;
+
+    // the tiles start on cache line boundaries
+    static constexpr uint64_t TILE_ALIGNMENT = 64;
+
+    TerrainFile();
+
+    // the header of a file with the given grid
+    static Header createHeader(const TerrainFileInfo& info, unsigned gridSize, bool withNormals);
+
+    // the bytes of one tile in a file, including its normals and padding
+    static uint64_t getTileBytes(const Header& header);
+
+    // where tile index (row-major) of a file lies, without its range
+    static Tile getTileLayout(const Header& header, uint64_t index);
+
+    /**
+     * Encodes the heights and normals of a tile. heights and normals point
+     * to the first point of the tile, and the strides are the distances
+     * between its rows, in floats.
+     */
+    static void encodeTile(const Tile& tile, unsigned tileSize, HeightEncoding encoding,
+                           const float *heights, size_t heightStride, const float *normals, size_t normalStride,
+                           char *heightsTarget, char *normalsTarget);
+
+    inline const Tile& getTile(unsigned tx, unsigned tz) const { return directory[tx * header->tiles + tz]; }
+
+    QFile file;
+    const uchar *data;
+
+    const Header *header;
+    const Tile *directory;
+    TerrainFileInfo info;
+
+};
+
+typedef std::shared_ptr<const TerrainFile> TerrainFilePtr;
+
+/**
+ * @brief The TerrainFileWriter class
+ *
+ * Writes a terrain file part by part, for grids that don't fit in memory.
+ * The file is created at its final size up front, and every part is
+ * written through a mapping of only the tiles it covers, which is
+ * released again before the next part. The tile directory is written
+ * through the mapping as well, along with its tiles, so the memory of the
+ * writer doesn't grow with the grid. The file is written next to path
+ * and only renamed to path by commit, so it is never left half written.
+ */
+class TerrainFileWriter {
+
+public:
+    /**
+     * @param path the file to write
+     * @param info what to record about the terrain, the grid is 2^info.detail + 1 vertices wide
+     * @param withNormals whether to store normals
+     */
+    TerrainFileWriter(const QString& path, const TerrainFileInfo& info, bool withNormals);
+    ~TerrainFileWriter();
+
+    TerrainFileWriter(const TerrainFileWriter&) = delete;
+    TerrainFileWriter& operator=(const TerrainFileWriter&) = delete;
+
+    // whether the file could be created, writing to a writer that isn't open fails
+    inline bool isOpen() const { return open; }
+
+    inline unsigned getGridSize() const { return header.gridSize; }
+    inline unsigned getTiles() const { return header.tiles; }
+    inline unsigned getTileQuads() const { return header.tileQuads; }
+    inline bool hasNormals() const { return (header.flags & TerrainFile::FLAG_NORMALS) != 0; }
+
+    // the bytes of one tile in the file, including its normals
+    uint64_t getTileBytes() const;
+
+    /**
+     * @brief writeTiles
+     *
+     * Encodes and writes tiles (tileX, tileZ) up to (tileX + tileRows,
+     * tileZ + tileColumns) from a part of the grid
+     *
+     * @param heights the part of the grid, containing all points of the tiles:
+     *        row x and column z of heights is grid point (firstX + x, firstZ + z)
+     * @param firstX the first grid row of heights
+     * @param firstZ the first grid column of heights
+     * @param normals the normals of the points of heights, three floats
+     *        each, row-major without padding, or nullptr if the file has none
+     * @return whether the tiles were written
+     */
+    bool writeTiles(unsigned tileX, unsigned tileZ, unsigned tileRows, unsigned tileColumns,
+                    const Heightfield& heights, unsigned firstX, unsigned firstZ, const float *normals);
+
+    /**
+     * @brief commit
+     *
+     * Writes the header, and moves the file to its path. All tiles must
+     * have been written.
+     */
+    bool commit();
+
+private:
+    QString path;
+    QFile file;
+    bool open;
+
+    TerrainFileInfo info;
+    TerrainFile::Header header;
+
+};
+
+#endif // TERRAINFILE_H
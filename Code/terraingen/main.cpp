@@ -0,0 +1,320 @@
+#include "noisegrid.h"
+#include "streamedterrain.h"
+#include "threadpool.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+/**
+ * The parameters of every generated terrain. The defaults match the
+ * islands of the viewer, so it can open the files with --terrain-file.
+ */
+struct BatchSettings {
+    unsigned detail = 9;
+    unsigned octaves = 5;
+    unsigned octaveLevel = 4;
+    float amplitude = 1.0f;
+
+    bool spike = true;
+    float spikeMin = -2.0f;
+    float spikeMax = 1.0f;
+    unsigned spikeLevel = 3;
+
+    GridPlacement placement;
+    HeightEncoding encoding = HeightEncoding::Float32;
+    bool normals = false;
+
+    // generate straight into the file within this many bytes per terrain, 0 generates in memory
+    size_t memoryBudget = 0;
+};
+
+/**
+ * How long one terrain took, in milliseconds
+ */
+struct TerrainTiming {
+    double generate;
+    double write;
+    bool written;
+};
+
+static TerrainTiming generateTerrain(const BatchSettings& settings, uint64_t seed, const QString& path) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    OctavesStage octaves(settings.octaves, settings.amplitude, settings.octaveLevel, seed);
+    SpikeStage spike(settings.spikeMin, settings.spikeMax, settings.spikeLevel);
+
+    // terrains larger than the budget are generated tile by tile, and written as they are generated
+    if (settings.memoryBudget != 0) {
+        TerrainFileInfo info;
+        info.detail = settings.detail;
+        info.seed = seed;
+        info.placement = settings.placement;
+        info.placement.offsetX = -(((1u << settings.detail) + 1) / 2.0f);
+        info.placement.offsetZ = info.placement.offsetX;
+        info.tileQuads = getGridBlockQuads((1u << settings.detail) + 1);
+        info.encoding = settings.encoding;
+
+        bool written = settings.spike ?
+                generateStreamedTerrain(path, sumStages(spike, octaves), info, settings.normals, settings.memoryBudget) :
+                generateStreamedTerrain(path, octaves, info, settings.normals, settings.memoryBudget);
+
+        auto end = std::chrono::high_resolution_clock::now();
+        return { std::chrono::duration<double, std::milli>(end - start).count(), 0, written };
+    }
+
+    // the stages are added in a single pass over the grid
+    NoiseGrid grid(settings.detail);
+
+    if (settings.spike) {
+        grid.add(sumStages(spike, octaves));
+    } else {
+        grid.add(octaves);
+    }
+
+    GridPlacement placement = grid.getPlacement();
+    placement.heightScale = settings.placement.heightScale;
+    placement.heightOffset = settings.placement.heightOffset;
+    grid.setPlacement(placement);
+
+    auto generated = std::chrono::high_resolution_clock::now();
+    bool written = grid.writeTerrainFile(path, seed, settings.encoding, settings.normals);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    return {
+        std::chrono::duration<double, std::milli>(generated - start).count(),
+        std::chrono::duration<double, std::milli>(end - generated).count(),
+        written
+    };
+}
+
+static void printStatistics(const char *name, std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+
+    double total = 0;
+    for (double value : values) {
+        total += value;
+    }
+
+    std::printf("  %-9s mean %9.2f ms   median %9.2f ms   min %9.2f ms   max %9.2f ms\n", name,
+                total / values.size(), values[values.size() / 2], values.front(), values.back());
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("terraingen");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Generates terrain files without a display or an OpenGL context.");
+    parser.addHelpOption();
+
+    QCommandLineOption outputOption("output", "Directory to write terrain_<seed>.terrain files to.", "directory", ".");
+    parser.addOption(outputOption);
+
+    QCommandLineOption seedOption("seed", "Seed of the first terrain, the next ones count up from it.", "seed", "1");
+    parser.addOption(seedOption);
+
+    QCommandLineOption countOption("count", "Number of terrains to generate.", "count", "1");
+    parser.addOption(countOption);
+
+    QCommandLineOption detailOption("detail", "Terrains are 2^detail + 1 vertices wide.", "detail", "9");
+    parser.addOption(detailOption);
+
+    QCommandLineOption octavesOption("octaves", "Number of noise octaves (default: detail - 4).", "octaves");
+    parser.addOption(octavesOption);
+
+    QCommandLineOption octaveLevelOption("octave-level",
+            "The first octave has a lattice of 2^level quads.", "level", "4");
+    parser.addOption(octaveLevelOption);
+
+    QCommandLineOption amplitudeOption("amplitude", "Amplitude of the first octave, every next one halves it.",
+                                       "amplitude", "1");
+    parser.addOption(amplitudeOption);
+
+    QCommandLineOption spikeOption("spike", "Lowest and highest height of the spike in the middle.", "min,max", "-2,1");
+    parser.addOption(spikeOption);
+
+    QCommandLineOption spikeLevelOption("spike-level", "The spike lattice has 2^level quads.", "level", "3");
+    parser.addOption(spikeLevelOption);
+
+    QCommandLineOption noSpikeOption("no-spike", "Only generate the noise octaves.");
+    parser.addOption(noSpikeOption);
+
+    QCommandLineOption heightScaleOption("height-scale", "Vertical scale the terrains are drawn with.", "scale", "8.5");
+    parser.addOption(heightScaleOption);
+
+    QCommandLineOption heightOffsetOption("height-offset", "Vertical offset the terrains are drawn with.", "offset", "-1");
+    parser.addOption(heightOffsetOption);
+
+    QCommandLineOption quantizeOption("quantize", "Store the heights as 16-bit values.");
+    parser.addOption(quantizeOption);
+
+    QCommandLineOption normalsOption("normals", "Store the normals as well.");
+    parser.addOption(normalsOption);
+
+    QCommandLineOption jobsOption("jobs", "Number of terrains generated at once (0 = hardware threads).", "jobs", "0");
+    parser.addOption(jobsOption);
+
+    QCommandLineOption threadsOption("threads",
+            "Number of threads generating each terrain, 0 = one per hardware thread.", "threads", "0");
+    parser.addOption(threadsOption);
+
+    QCommandLineOption memoryBudgetOption("memory-budget",
+            "Generate every terrain straight into its file, using at most this many megabytes for all "
+            "terrains generated at once. Needed for terrains that don't fit in memory.", "megabytes");
+    parser.addOption(memoryBudgetOption);
+
+    QCommandLineOption verboseOption("verbose", "Print a line for every terrain.");
+    parser.addOption(verboseOption);
+
+    parser.process(a);
+
+    BatchSettings settings;
+    settings.detail = parser.value(detailOption).toUInt();
+    settings.octaves = parser.isSet(octavesOption) ? parser.value(octavesOption).toUInt() :
+            (settings.detail > 4 ? settings.detail - 4 : 1);
+    settings.octaveLevel = parser.value(octaveLevelOption).toUInt();
+    settings.amplitude = parser.value(amplitudeOption).toFloat();
+    settings.spike = !parser.isSet(noSpikeOption);
+    settings.spikeLevel = parser.value(spikeLevelOption).toUInt();
+    settings.placement.heightScale = parser.value(heightScaleOption).toFloat();
+    settings.placement.heightOffset = parser.value(heightOffsetOption).toFloat();
+    settings.encoding = parser.isSet(quantizeOption) ? HeightEncoding::UInt16 : HeightEncoding::Float32;
+    settings.normals = parser.isSet(normalsOption);
+
+    QStringList spike = parser.value(spikeOption).split(',');
+    if (spike.size() == 2) {
+        settings.spikeMin = spike[0].toFloat();
+        settings.spikeMax = spike[1].toFloat();
+    }
+
+    // grids beyond 2^15 + 1 vertices only fit in a file
+    unsigned maxDetail = parser.isSet(memoryBudgetOption) ? 20 : 15;
+    if (settings.detail < 1 || settings.detail > maxDetail) {
+        std::fprintf(stderr, "The detail must be between 1 and %u%s\n", maxDetail,
+                     parser.isSet(memoryBudgetOption) ? "" : ", or up to 20 with --memory-budget");
+        return 1;
+    }
+
+    // every lattice needs at least one quad on the grid
+    if (settings.octaveLevel + settings.octaves > settings.detail + 1 ||
+            (settings.spike && settings.spikeLevel > settings.detail)) {
+        std::fprintf(stderr, "The octaves and the spike must fit in a grid of 2^%u quads\n", settings.detail);
+        return 1;
+    }
+
+    QDir output(parser.value(outputOption));
+    if (!output.mkpath(".")) {
+        std::fprintf(stderr, "Can't create the output directory %s\n", qPrintable(output.path()));
+        return 1;
+    }
+
+    bool threadsValid = false;
+    unsigned threads = parser.value(threadsOption).toUInt(&threadsValid);
+    if (!threadsValid) {
+        std::fprintf(stderr, "The thread count must be a number, 0 for one per hardware thread\n");
+        return 1;
+    }
+
+    ThreadPool::setGlobalThreadCount(threads);
+
+    uint64_t firstSeed = parser.value(seedOption).toULongLong();
+    unsigned count = parser.value(countOption).toUInt();
+    unsigned jobs = parser.value(jobsOption).toUInt();
+    if (jobs == 0) {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    jobs = std::max(1u, std::min(jobs, count));
+
+    // the jobs share the budget. A budget of 0 would mean generating in memory,
+    // which the larger details allowed with a budget don't fit in.
+    if (parser.isSet(memoryBudgetOption)) {
+        bool budgetValid = false;
+        size_t budget = size_t(parser.value(memoryBudgetOption).toUInt(&budgetValid)) * 1024 * 1024 / jobs;
+        if (!budgetValid || budget == 0) {
+            std::fprintf(stderr, "The memory budget must be a number of MB of at least the number of jobs (%u)\n", jobs);
+            return 1;
+        }
+
+        settings.memoryBudget = budget;
+    }
+
+    bool verbose = parser.isSet(verboseOption);
+
+    std::printf("Generating %u terrains of %u x %u vertices, %u at a time, with %u threads each\n", count,
+                (1u << settings.detail) + 1, (1u << settings.detail) + 1, jobs, ThreadPool::global().getThreadCount());
+
+    // every job takes the next terrain until all are done. The jobs share
+    // the global thread pool, so small terrains run side by side while
+    // large terrains still use every thread.
+    std::vector<TerrainTiming> timings(count);
+    std::atomic<unsigned> next(0);
+    std::atomic<unsigned> failed(0);
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    auto work = [&]() {
+        for (unsigned i = next++; i < count; i = next++) {
+            uint64_t seed = firstSeed + i;
+            QString path = output.filePath(QString("terrain_%1.terrain").arg(seed));
+            timings[i] = generateTerrain(settings, seed, path);
+
+            if (!timings[i].written) {
+                failed++;
+            }
+
+            if (verbose) {
+                std::printf("%s: generated in %.2f ms, written in %.2f ms\n", qPrintable(path),
+                            timings[i].generate, timings[i].write);
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < jobs; i++) {
+        workers.emplace_back(work);
+    }
+
+    work();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    if (count == 0) {
+        return 0;
+    }
+
+    std::vector<double> generate, write;
+    for (const TerrainTiming& timing : timings) {
+        generate.push_back(timing.generate);
+        write.push_back(timing.write);
+    }
+
+    // the file size is the same for every terrain
+    double vertices = double((1u << settings.detail) + 1) * ((1u << settings.detail) + 1);
+    double bytes = QFileInfo(output.filePath(QString("terrain_%1.terrain").arg(firstSeed))).size();
+
+    std::printf("Generated %u terrains in %.3f s:\n", count, seconds);
+    std::printf("  %.2f terrains/s, %.1f million vertices/s, %.1f MB/s written\n", count / seconds,
+                count * vertices / seconds / 1e6, count * bytes / seconds / 1e6);
+    printStatistics("generate", generate);
+    printStatistics("write", write);
+
+    if (failed > 0) {
+        std::fprintf(stderr, "%u terrains could not be written\n", failed.load());
+        return 1;
+    }
+
+    return 0;
+}
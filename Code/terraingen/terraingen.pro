@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# Headless terrain generator: generates terrain files
+# without a display or an OpenGL context
+#
+#-------------------------------------------------
+
+QT       += core gui
+QT       -= widgets
+
+TARGET = terraingen
+TEMPLATE = app
+CONFIG += c++14 console
+CONFIG -= app_bundle
+
+include(../generation.pri)
+
+SOURCES += main.cpp
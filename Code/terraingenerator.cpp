@@ -0,0 +1,114 @@
+#include "terraingenerator.h"
+
+#include <QDebug>
+
+#include <chrono>
+
+TerrainGenerator::TerrainGenerator() :
+        stopping(false), hasPendingJob(false), pendingParameters(), latestJob(0) {
+
+    worker = std::thread(&TerrainGenerator::workerLoop, this);
+}
+
+TerrainGenerator::~TerrainGenerator() {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+
+        // cancel the running job
+        latestJob++;
+    }
+
+    jobAvailable.notify_all();
+    worker.join();
+}
+
+void TerrainGenerator::request(const TerrainParameters& parameters) {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        pendingParameters = parameters;
+        hasPendingJob = true;
+        latestJob++;
+    }
+
+    jobAvailable.notify_all();
+}
+
+std::unique_ptr<GeneratedTerrain> TerrainGenerator::takeResult() {
+    std::lock_guard<std::mutex> guard(mutex);
+
+    std::unique_ptr<GeneratedTerrain> result;
+
+    // only the newest result is useful, older ones are dropped
+    while (!results.empty()) {
+        if (results.front().first == latestJob.load()) {
+            result = std::move(results.front().second);
+        }
+
+        results.pop_front();
+    }
+
+    return result;
+}
+
+void TerrainGenerator::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        jobAvailable.wait(lock, [this]() { return stopping || hasPendingJob; });
+
+        if (stopping) {
+            return;
+        }
+
+        TerrainParameters parameters = pendingParameters;
+        uint64_t job = latestJob.load();
+        hasPendingJob = false;
+
+        lock.unlock();
+        std::unique_ptr<GeneratedTerrain> terrain = generate(parameters, job);
+        lock.lock();
+
+        if (terrain && !isCancelled(job)) {
+            results.emplace_back(job, std::move(terrain));
+        }
+    }
+}
+
+std::unique_ptr<GeneratedTerrain> TerrainGenerator::generate(const TerrainParameters& parameters, uint64_t job) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // a stored terrain only has to be mapped, its tiles are read while uploading
+    if (!parameters.loadPath.isEmpty()) {
+        TerrainFilePtr file = TerrainFile::open(parameters.loadPath);
+
+        if (file != nullptr) {
+            std::unique_ptr<GeneratedTerrain> terrain(new GeneratedTerrain());
+            terrain->file = std::move(file);
+
+            auto end = std::chrono::high_resolution_clock::now();
+            qDebug() << ":: Opened terrain file" << parameters.loadPath << "with seed" << terrain->file->getInfo().seed
+                     << "in" << std::chrono::duration<double, std::milli>(end - start).count() << "ms";
+
+            return terrain;
+        }
+    }
+
+    std::unique_ptr<GeneratedTerrain> terrain(new GeneratedTerrain());
+    if (!context.generate(parameters, *terrain, [this, job]() { return isCancelled(job); })) {
+        return nullptr;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    qDebug() << ":: Generated terrain with seed" << parameters.seed << "and N =" << parameters.detail << "in"
+             << std::chrono::duration<double, std::milli>(end - start).count() << "ms";
+
+    if (!parameters.savePath.isEmpty() &&
+            terrain->grid->writeTerrainFile(parameters.savePath, parameters.seed, parameters.saveEncoding, false)) {
+        auto saved = std::chrono::high_resolution_clock::now();
+        qDebug() << ":: Saved terrain to" << parameters.savePath << "in"
+                 << std::chrono::duration<double, std::milli>(saved - end).count() << "ms";
+    }
+
+    return terrain;
+}
@@ -0,0 +1,74 @@
+#ifndef TERRAINGENERATOR_H
+#define TERRAINGENERATOR_H
+
+#include "generationcontext.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief The TerrainGenerator class
+ *
+ * Generates terrains on a background thread. The finished terrains
+ * are queued until the GL thread takes them with takeResult() to upload.
+ * The memory of terrains the GL thread has dropped is reused for the
+ * next ones, see GenerationContext.
+ *
+ * Only the most recent request matters: a new request cancels the job
+ * that is running, and results of superseded jobs are dropped.
+ */
+class TerrainGenerator {
+
+public:
+    TerrainGenerator();
+    ~TerrainGenerator();
+
+    TerrainGenerator(const TerrainGenerator&) = delete;
+    TerrainGenerator& operator=(const TerrainGenerator&) = delete;
+
+    /**
+     * @brief request
+     *
+     * Starts generating a terrain, superseding all earlier requests
+     */
+    void request(const TerrainParameters& parameters);
+
+    /**
+     * @brief takeResult
+     *
+     * Returns the newest finished terrain, or nullptr if there is none
+     */
+    std::unique_ptr<GeneratedTerrain> takeResult();
+
+private:
+    void workerLoop();
+    std::unique_ptr<GeneratedTerrain> generate(const TerrainParameters& parameters, uint64_t job);
+
+    inline bool isCancelled(uint64_t job) const { return job != latestJob.load(); }
+
+    std::thread worker;
+
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    bool stopping;
+
+    // the most recent request, if the worker has not picked it up yet
+    bool hasPendingJob;
+    TerrainParameters pendingParameters;
+
+    // incremented by every request, so a running job can tell it is outdated
+    std::atomic<uint64_t> latestJob;
+
+    std::deque< std::pair<uint64_t, std::unique_ptr<GeneratedTerrain>> > results;
+
+    // only used by the worker thread
+    GenerationContext context;
+
+};
+
+#endif // TERRAINGENERATOR_H
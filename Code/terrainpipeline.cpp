@@ -0,0 +1,231 @@
+#include "terrainpipeline.h"
+#include "upsample.h"
+#include "noisehash.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <new>
+#include <type_traits>
+
+namespace {
+
+int64_t floorDivide(int64_t a, int64_t b) {
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+/**
+ * @brief addLatticeSample
+ *
+ * Adds a lattice of 2^n quads at grid position (x, z), with the weights
+ * and in the order LatticeCursor uses, so grid points match its rows bit
+ * for bit. The position may lie outside of the grid, lattice points
+ * outside of it are asked from value(i, j) like any other.
+ */
+template<typename Value>
+void addLatticeSample(const PipelineGrid& grid, unsigned n, float x, float z, const Value& value,
+                      PipelineSample& sample) {
+    unsigned quadSize = (grid.size - 1) >> n;
+    float size = static_cast<float>(quadSize);
+
+    // the grid points are integers, dividing those keeps the weights exact
+    int64_t i = floorDivide(static_cast<int64_t>(std::floor(x)), quadSize);
+    int64_t j = floorDivide(static_cast<int64_t>(std::floor(z)), quadSize);
+
+    float tx = (x - static_cast<float>(i * quadSize)) / size;
+    float tz = (z - static_cast<float>(j * quadSize)) / size;
+    float wx = tx * tx * (3 - 2 * tx);
+    float wz = tz * tz * (3 - 2 * tz);
+
+    float h00 = value(i, j);
+    float h01 = value(i, j + 1);
+    float h10 = value(i + 1, j);
+    float h11 = value(i + 1, j + 1);
+
+    // first along z, then along x, like the expanded lattice rows
+    float row0 = h01 * wz + h00 * (1 - wz);
+    float row1 = h11 * wz + h10 * (1 - wz);
+    sample.value += row1 * wx + row0 * (1 - wx);
+
+    float slopeX = 6 * tx * (1 - tx) / size;
+    float slopeZ = 6 * tz * (1 - tz) / size;
+
+    sample.dx += (row1 - row0) * slopeX;
+    sample.dz += ((h11 - h10) * wx + (h01 - h00) * (1 - wx)) * slopeZ;
+}
+
+} // namespace
+
+LatticeCursor::LatticeCursor(const PipelineGrid& grid, const PipelineWindow& window, unsigned n) :
+        size(grid.size), quadSize((grid.size - 1) >> n),
+        firstColumn(window.firstZ / quadSize),
+        columnCount((window.firstZ + window.columns - 1 + quadSize - 1) / quadSize - firstColumn + 1),
+        windowOffset(window.firstZ - firstColumn * quadSize), windowColumns(window.columns),
+        expandedSize((columnCount - 1) * quadSize + 1),
+        latticeX(floorDivide(grid.originX, quadSize)), latticeZ(floorDivide(grid.originZ, quadSize)),
+        level(getSimdLevel()), held{ -1, -1 } {
+
+    Arena& arena = Arena::scratch();
+    weights = arena.allocateArray<float>(quadSize);
+    inverseWeights = arena.allocateArray<float>(quadSize);
+    lattice = arena.allocateArray<float>(columnCount);
+    expanded = arena.allocateArray<float>(2 * size_t(expandedSize));
+
+    for (unsigned k = 0; k < quadSize; k++) {
+        weights[k] = smoothstepWeight(k, quadSize);
+        inverseWeights[k] = 1 - weights[k];
+    }
+}
+
+size_t LatticeCursor::getBytes(const PipelineGrid& grid, unsigned columns, unsigned n) {
+    size_t quadSize = (grid.size - 1) >> n;
+
+    // the lattice columns around a window of columns points that starts anywhere
+    size_t columnCount = (columns - 1 + quadSize - 1) / quadSize + 2;
+    size_t expandedSize = (columnCount - 1) * quadSize + 1;
+
+    // the weights, their inverses, a lattice row and two expanded rows, as allocated above
+    return (2 * quadSize + columnCount + 2 * expandedSize) * sizeof(float);
+}
+
+template<typename Fill>
+void LatticeCursor::addRow(unsigned x, float *row, const Fill& fill) {
+    unsigned i = x / quadSize;
+    unsigned k = x - i * quadSize;
+
+    auto hold = [&](unsigned slot, unsigned latticeRow) {
+        if (held[slot] != latticeRow) {
+            fill(static_cast<int64_t>(latticeRow), firstColumn, columnCount, lattice);
+            expandLatticeRow(&expanded[slot * expandedSize], lattice, columnCount - 1, quadSize,
+                             weights, inverseWeights, level);
+            held[slot] = latticeRow;
+        }
+    };
+
+    // walking down the rows, the slot of the next lattice row becomes the first
+    unsigned first = held[1] == i ? 1 : 0;
+    unsigned second = 1 - first;
+    hold(first, i);
+
+    const float *a = &expanded[first * expandedSize + windowOffset];
+    if (k == 0) {
+        addGridRow(row, a, windowColumns, level);
+    } else {
+        hold(second, i + 1);
+        const float *b = &expanded[second * expandedSize + windowOffset];
+        addLerpedRows(row, a, b, weights[k], inverseWeights[k], windowColumns, level);
+    }
+}
+
+SpikeStage::SpikeStage(float min, float max, unsigned n) : min(min), max(max), n(n) {
+}
+
+LatticeCursor SpikeStage::createCursor(const PipelineGrid& grid, const PipelineWindow& window) const {
+    return LatticeCursor(grid, window, n);
+}
+
+void SpikeStage::addRow(Cursor& cursor, unsigned x, float *row) const {
+    int64_t quadSize = cursor.getQuadSize();
+    int64_t middle = cursor.getSize() / 2;
+
+    cursor.addRow(x, row, [&](int64_t i, unsigned j, unsigned count, float *values) {
+        for (unsigned c = 0; c < count; c++) {
+            values[c] = (i * quadSize == middle && (j + c) * quadSize == middle) ? max : min;
+        }
+    });
+}
+
+void SpikeStage::addSample(const PipelineGrid& grid, float x, float z, PipelineSample& sample) const {
+    int64_t quadSize = (grid.size - 1) >> n;
+    int64_t middle = grid.size / 2;
+
+    addLatticeSample(grid, n, x, z, [&](int64_t i, int64_t j) {
+        return (i * quadSize == middle && j * quadSize == middle) ? max : min;
+    }, sample);
+}
+
+size_t SpikeStage::getCursorBytes(const PipelineGrid& grid, unsigned columns) const {
+    return LatticeCursor::getBytes(grid, columns, n);
+}
+
+OctaveStage::OctaveStage(float amplitude, unsigned n, uint64_t seed) :
+        amplitude(amplitude), n(n), key(latticeKey(seed, n)) {
+}
+
+LatticeCursor OctaveStage::createCursor(const PipelineGrid& grid, const PipelineWindow& window) const {
+    return LatticeCursor(grid, window, n);
+}
+
+void OctaveStage::addRow(Cursor& cursor, unsigned x, float *row) const {
+    int64_t latticeX = cursor.getLatticeX();
+    int64_t latticeZ = cursor.getLatticeZ();
+
+    cursor.addRow(x, row, [&](int64_t i, unsigned j, unsigned count, float *values) {
+        for (unsigned c = 0; c < count; c++) {
+            values[c] = latticePointValue(key, static_cast<int32_t>(latticeX + i),
+                                          static_cast<int32_t>(latticeZ + j + c)) * amplitude;
+        }
+    });
+}
+
+void OctaveStage::addSample(const PipelineGrid& grid, float x, float z, PipelineSample& sample) const {
+    int64_t quadSize = (grid.size - 1) >> n;
+    int64_t latticeX = floorDivide(grid.originX, quadSize);
+    int64_t latticeZ = floorDivide(grid.originZ, quadSize);
+
+    addLatticeSample(grid, n, x, z, [&](int64_t i, int64_t j) {
+        return latticePointValue(key, static_cast<int32_t>(latticeX + i), static_cast<int32_t>(latticeZ + j)) * amplitude;
+    }, sample);
+}
+
+size_t OctaveStage::getCursorBytes(const PipelineGrid& grid, unsigned columns) const {
+    return LatticeCursor::getBytes(grid, columns, n);
+}
+
+// std::min takes it by reference, so it needs a definition before C++17
+constexpr unsigned OctavesStage::MAX_OCTAVES;
+
+OctavesStage::OctavesStage(unsigned octaves, float amplitude, unsigned n, uint64_t seed) :
+        octaveCount(std::min(octaves, MAX_OCTAVES)) {
+    assert(octaves <= MAX_OCTAVES);
+
+    // finer octaves than the largest grids are dropped, also without asserts
+    for (unsigned i = 0; i < octaveCount; i++) {
+        this->octaves[i] = OctaveStage(amplitude, n + i, seed);
+        amplitude /= 2.0f;
+    }
+}
+
+// the cursors are never destroyed, the scope of the arena just ends
+static_assert(std::is_trivially_destructible<LatticeCursor>::value, "LatticeCursor must not own memory");
+
+OctavesStage::Cursor OctavesStage::createCursor(const PipelineGrid& grid, const PipelineWindow& window) const {
+    Cursor cursors = Arena::scratch().allocateArray<LatticeCursor>(octaveCount);
+    for (unsigned i = 0; i < octaveCount; i++) {
+        new (&cursors[i]) LatticeCursor(octaves[i].createCursor(grid, window));
+    }
+
+    return cursors;
+}
+
+void OctavesStage::addRow(Cursor& cursor, unsigned x, float *row) const {
+    for (unsigned i = 0; i < octaveCount; i++) {
+        octaves[i].addRow(cursor[i], x, row);
+    }
+}
+
+void OctavesStage::addSample(const PipelineGrid& grid, float x, float z, PipelineSample& sample) const {
+    for (unsigned i = 0; i < octaveCount; i++) {
+        octaves[i].addSample(grid, x, z, sample);
+    }
+}
+
+size_t OctavesStage::getCursorBytes(const PipelineGrid& grid, unsigned columns) const {
+    // the array of cursors, which may need padding to be aligned
+    size_t bytes = octaveCount * sizeof(LatticeCursor) + alignof(LatticeCursor);
+    for (unsigned i = 0; i < octaveCount; i++) {
+        bytes += octaves[i].getCursorBytes(grid, columns);
+    }
+
+    return bytes;
+}
@@ -0,0 +1,394 @@
+#ifndef TERRAINPIPELINE_H
+#define TERRAINPIPELINE_H
+
+#include "arena.h"
+#include "heightfield.h"
+#include "simd.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+/*
+ * Terrain generation stages that are composed at compile time and added to
+ * a grid in a single pass. Every stage adds its value to one grid row at a
+ * time, so all stages are applied to a row while it is in the cache, and
+ * no stage needs a grid sized temporary of its own.
+ *
+ * A stage is any type with:
+ *
+ *  - Cursor, the state one thread needs to walk the grid rows in order
+ *  - Cursor createCursor(const PipelineGrid& grid, const PipelineWindow& window) const
+ *  - void addRow(Cursor& cursor, unsigned x, float *row) const, which
+ *    adds the stage to the window columns of grid row x:
+ *    row[z] += value(x, window.firstZ + z)
+ *  - void addSample(const PipelineGrid& grid, float x, float z, PipelineSample& sample) const,
+ *    which adds the stage and its derivatives at a point between the grid
+ *    points. Grid points give the values of addRow bit for bit.
+ *  - size_t getCursorBytes(const PipelineGrid& grid, unsigned columns) const,
+ *    the most scratch memory createCursor takes for a window of that many
+ *    columns, wherever it starts
+ *
+ * Cursors take the memory they need from the scratch arena of their thread
+ * (see Arena::scratch), which addPipeline rewinds after every band, so a
+ * pass makes no heap allocations once the arenas have grown.
+ *
+ * Stages are combined with sumStages, scaleStage, offsetStage and clampStage.
+ */
+
+/**
+ * The grid a pipeline is added to: size by size points, starting at
+ * (originX, originZ) of the unbounded grid
+ */
+struct PipelineGrid {
+    unsigned size;
+    int64_t originX;
+    int64_t originZ;
+};
+
+/**
+ * The part of the grid that is generated: columns firstZ up to
+ * firstZ + columns of the rows firstX up to firstX + rows. Parts of a
+ * grid get the values of the whole grid bit for bit.
+ */
+struct PipelineWindow {
+    unsigned firstX;
+    unsigned firstZ;
+    unsigned rows;
+    unsigned columns;
+};
+
+/**
+ * A value of a stage at a point, and its derivatives along grid x and z
+ */
+struct PipelineSample {
+    float value;
+    float dx;
+    float dz;
+};
+
+/**
+ * @brief The LatticeCursor class
+ *
+ * Walks the grid rows of a lattice that is interpolated with smoothstep
+ * weights, like addUpsampledLattice. It keeps the two lattice rows around
+ * the current grid row, expanded along z, so each lattice row is computed
+ * once per band of grid rows instead of once per grid.
+ *
+ * The rows are in the scratch arena of the thread that creates the cursor,
+ * they are valid until the ArenaScope around it ends.
+ */
+class LatticeCursor {
+
+public:
+    /**
+     * @param grid the grid the lattice is added to
+     * @param window the part of the grid that is generated
+     * @param n the lattice has 2^n quads across the grid
+     */
+    LatticeCursor(const PipelineGrid& grid, const PipelineWindow& window, unsigned n);
+
+    /**
+     * Adds the window columns of grid row x. fill(i, j, count, values) is
+     * called to compute count points of lattice row i of the grid, from
+     * column j, when they aren't held yet.
+     */
+    template<typename Fill>
+    void addRow(unsigned x, float *row, const Fill& fill);
+
+    // the most scratch memory a cursor takes for a window of that many columns
+    static size_t getBytes(const PipelineGrid& grid, unsigned columns, unsigned n);
+
+    inline unsigned getSize() const { return size; }
+    inline unsigned getQuadSize() const { return quadSize; }
+
+    // where the lattice of the grid starts in the unbounded lattice
+    inline int64_t getLatticeX() const { return latticeX; }
+    inline int64_t getLatticeZ() const { return latticeZ; }
+
+private:
+    unsigned size;
+    unsigned quadSize;
+
+    // the lattice columns around the window, and where the window starts in their expanded rows
+    unsigned firstColumn;
+    unsigned columnCount;
+    unsigned windowOffset;
+    unsigned windowColumns;
+    unsigned expandedSize;
+
+    int64_t latticeX;
+    int64_t latticeZ;
+    SimdLevel level;
+
+    float *weights;
+    float *inverseWeights;
+    float *lattice;
+
+    // two expanded lattice rows, and the lattice row each slot holds (-1 if none)
+    float *expanded;
+    int64_t held[2];
+
+};
+
+/**
+ * @brief The SpikeStage class
+ *
+ * A lattice of 2^n quads which is max in the middle of the grid and min
+ * everywhere else, the island shape of NoiseGrid::addSpike
+ */
+class SpikeStage {
+
+public:
+    typedef LatticeCursor Cursor;
+
+    SpikeStage(float min, float max, unsigned n);
+
+    Cursor createCursor(const PipelineGrid& grid, const PipelineWindow& window) const;
+    void addRow(Cursor& cursor, unsigned x, float *row) const;
+    void addSample(const PipelineGrid& grid, float x, float z, PipelineSample& sample) const;
+    size_t getCursorBytes(const PipelineGrid& grid, unsigned columns) const;
+
+private:
+    float min;
+    float max;
+    unsigned n;
+
+};
+
+/**
+ * @brief The OctaveStage class
+ *
+ * One octave of value noise, a lattice of 2^n quads across the grid with
+ * values hashed from the seed, scaled by amplitude
+ */
+class OctaveStage {
+
+public:
+    typedef LatticeCursor Cursor;
+
+    // an octave without amplitude
+    OctaveStage() : amplitude(0), n(0), key(0) {}
+    OctaveStage(float amplitude, unsigned n, uint64_t seed);
+
+    Cursor createCursor(const PipelineGrid& grid, const PipelineWindow& window) const;
+    void addRow(Cursor& cursor, unsigned x, float *row) const;
+    void addSample(const PipelineGrid& grid, float x, float z, PipelineSample& sample) const;
+    size_t getCursorBytes(const PipelineGrid& grid, unsigned columns) const;
+
+private:
+    float amplitude;
+    unsigned n;
+    uint64_t key;
+
+};
+
+/**
+ * @brief The OctavesStage class
+ *
+ * A number of octaves that is only known at run time. Octave i has a
+ * lattice of 2^(n + i) quads and an amplitude of amplitude / 2^i. The
+ * octaves are stored in the stage itself, so copying it allocates nothing.
+ */
+class OctavesStage {
+
+public:
+    // the cursor of every octave, in the scratch arena like their rows
+    typedef LatticeCursor *Cursor;
+
+    // more octaves than this would need a lattice finer than the largest grids
+    static constexpr unsigned MAX_OCTAVES = 32;
+
+    OctavesStage(unsigned octaves, float amplitude, unsigned n, uint64_t seed);
+
+    Cursor createCursor(const PipelineGrid& grid, const PipelineWindow& window) const;
+    void addRow(Cursor& cursor, unsigned x, float *row) const;
+    void addSample(const PipelineGrid& grid, float x, float z, PipelineSample& sample) const;
+    size_t getCursorBytes(const PipelineGrid& grid, unsigned columns) const;
+
+private:
+    std::array<OctaveStage, MAX_OCTAVES> octaves;
+    unsigned octaveCount;
+
+};
+
+/**
+ * @brief The SumStage class
+ *
+ * Adds first, then second
+ */
+template<typename First, typename Second>
+class SumStage {
+
+public:
+    struct Cursor {
+        typename First::Cursor first;
+        typename Second::Cursor second;
+    };
+
+    SumStage(const First& first, const Second& second) : first(first), second(second) {}
+
+    Cursor createCursor(const PipelineGrid& grid, const PipelineWindow& window) const {
+        return { first.createCursor(grid, window), second.createCursor(grid, window) };
+    }
+
+    void addRow(Cursor& cursor, unsigned x, float *row) const {
+        first.addRow(cursor.first, x, row);
+        second.addRow(cursor.second, x, row);
+    }
+
+    void addSample(const PipelineGrid& grid, float x, float z, PipelineSample& sample) const {
+        first.addSample(grid, x, z, sample);
+        second.addSample(grid, x, z, sample);
+    }
+
+    size_t getCursorBytes(const PipelineGrid& grid, unsigned columns) const {
+        return first.getCursorBytes(grid, columns) + second.getCursorBytes(grid, columns);
+    }
+
+private:
+    First first;
+    Second second;
+
+};
+
+/**
+ * @brief The MapStage class
+ *
+ * Applies a function to the value of a stage. The function needs
+ * float operator()(float) and float derivative(float) for the samples.
+ */
+template<typename Stage, typename Function>
+class MapStage {
+
+public:
+    struct Cursor {
+        typename Stage::Cursor stage;
+
+        // the row of the stage itself, before the function is applied
+        float *values;
+        unsigned count;
+    };
+
+    MapStage(const Stage& stage, const Function& function) : stage(stage), function(function) {}
+
+    Cursor createCursor(const PipelineGrid& grid, const PipelineWindow& window) const {
+        return { stage.createCursor(grid, window), Arena::scratch().allocateArray<float>(window.columns), window.columns };
+    }
+
+    void addRow(Cursor& cursor, unsigned x, float *row) const {
+        float *values = cursor.values;
+        unsigned count = cursor.count;
+
+        std::fill(values, values + count, 0.0f);
+        stage.addRow(cursor.stage, x, values);
+
+        for (unsigned z = 0; z < count; z++) {
+            row[z] += function(values[z]);
+        }
+    }
+
+    void addSample(const PipelineGrid& grid, float x, float z, PipelineSample& sample) const {
+        PipelineSample value = { 0, 0, 0 };
+        stage.addSample(grid, x, z, value);
+
+        float slope = function.derivative(value.value);
+        sample.value += function(value.value);
+        sample.dx += value.dx * slope;
+        sample.dz += value.dz * slope;
+    }
+
+    size_t getCursorBytes(const PipelineGrid& grid, unsigned columns) const {
+        return stage.getCursorBytes(grid, columns) + columns * sizeof(float);
+    }
+
+private:
+    Stage stage;
+    Function function;
+
+};
+
+struct ScaleFunction {
+    float factor;
+
+    inline float operator()(float value) const { return value * factor; }
+    inline float derivative(float) const { return factor; }
+};
+
+struct OffsetFunction {
+    float offset;
+
+    inline float operator()(float value) const { return value + offset; }
+    inline float derivative(float) const { return 1.0f; }
+};
+
+struct ClampFunction {
+    float min;
+    float max;
+
+    inline float operator()(float value) const { return std::min(std::max(value, min), max); }
+    inline float derivative(float value) const { return (value > min && value < max) ? 1.0f : 0.0f; }
+};
+
+template<typename First, typename Second>
+SumStage<First, Second> sumStages(const First& first, const Second& second) {
+    return SumStage<First, Second>(first, second);
+}
+
+/**
+ * @brief sumStages
+ *
+ * Adds any number of stages, in order
+ */
+template<typename First, typename Second, typename... Rest>
+auto sumStages(const First& first, const Second& second, const Rest&... rest) {
+    return sumStages(first, sumStages(second, rest...));
+}
+
+template<typename Stage>
+MapStage<Stage, ScaleFunction> scaleStage(const Stage& stage, float factor) {
+    return MapStage<Stage, ScaleFunction>(stage, { factor });
+}
+
+template<typename Stage>
+MapStage<Stage, OffsetFunction> offsetStage(const Stage& stage, float offset) {
+    return MapStage<Stage, OffsetFunction>(stage, { offset });
+}
+
+template<typename Stage>
+MapStage<Stage, ClampFunction> clampStage(const Stage& stage, float min, float max) {
+    return MapStage<Stage, ClampFunction>(stage, { min, max });
+}
+
+/**
+ * @brief addPipeline
+ *
+ * Adds a stage to every point of a grid, or of a window of it, in one
+ * pass, in bands of rows on the global ThreadPool. The result only
+ * depends on the order of the stages, not on the bands, the number of
+ * threads or the window.
+ *
+ * @param heights the heights to add to, row x and column z of heights is
+ *        point (firstX + x, firstZ + z) of the grid
+ * @param grid the grid the stage is evaluated for
+ * @param stage the stage to add
+ * @param firstX the first grid row of heights
+ * @param firstZ the first grid column of heights
+ */
+template<typename Stage>
+void addPipeline(Heightfield& heights, const PipelineGrid& grid, const Stage& stage,
+                 unsigned firstX = 0, unsigned firstZ = 0) {
+    PipelineWindow window = { firstX, firstZ, heights.getRows(), heights.getColumns() };
+
+    ThreadPool::global().parallelFor(0, heights.getRows(), [&](unsigned begin, unsigned end) {
+        ArenaScope scope(Arena::scratch());
+        typename Stage::Cursor cursor = stage.createCursor(grid, window);
+
+        for (unsigned x = begin; x < end; x++) {
+            stage.addRow(cursor, firstX + x, heights.row(x));
+        }
+    }, 16);
+}
+
+#endif // TERRAINPIPELINE_H
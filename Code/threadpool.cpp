@@ -0,0 +1,127 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+std::unique_ptr<ThreadPool> ThreadPool::globalPool;
+
+ThreadPool::ThreadPool(unsigned threadCount) : threadCount(threadCount), stopping(false), nextTask(0) {
+    if (this->threadCount == 0) {
+        this->threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // the thread calling parallelFor also works, so it is not part of the workers
+    for (unsigned i = 1; i < this->threadCount; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+    }
+
+    taskAvailable.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::runBands(unsigned begin, unsigned end, const BandFunction& function, unsigned minBandSize) {
+    if (end <= begin) {
+        return;
+    }
+
+    unsigned count = end - begin;
+    unsigned bands = std::min(threadCount, (count + std::max(minBandSize, 1u) - 1) / std::max(minBandSize, 1u));
+
+    if (bands <= 1) {
+        function.call(function.body, begin, end);
+        return;
+    }
+
+    auto bandStart = [begin, count, bands](unsigned band) -> unsigned {
+        return begin + static_cast<unsigned>(static_cast<unsigned long long>(count) * band / bands);
+    };
+
+    // the caller does the first band, the others are queued
+    unsigned remaining = bands - 1;
+    std::condition_variable bandsDone;
+
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+
+        for (unsigned band = 1; band < bands; band++) {
+            tasks.push_back({ &function, bandStart(band), bandStart(band + 1), &remaining, &bandsDone });
+        }
+    }
+
+    taskAvailable.notify_all();
+
+    function.call(function.body, begin, bandStart(1));
+
+    // help out with queued work until all of our bands are done
+    std::unique_lock<std::mutex> lock(mutex);
+    while (remaining > 0) {
+        if (!runPendingTask(lock)) {
+            bandsDone.wait(lock);
+        }
+    }
+}
+
+void ThreadPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        taskAvailable.wait(lock, [this]() { return stopping || nextTask < tasks.size(); });
+
+        if (stopping && nextTask == tasks.size()) {
+            return;
+        }
+
+        runPendingTask(lock);
+    }
+}
+
+bool ThreadPool::runPendingTask(std::unique_lock<std::mutex>& lock) {
+    if (nextTask == tasks.size()) {
+        return false;
+    }
+
+    Task task = tasks[nextTask++];
+    if (nextTask == tasks.size()) {
+        tasks.clear();
+        nextTask = 0;
+    }
+
+    lock.unlock();
+    task.function->call(task.function->body, task.begin, task.end);
+    lock.lock();
+
+    if (--*task.remaining == 0) {
+        task.done->notify_all();
+    }
+
+    return true;
+}
+
+static std::mutex& globalPoolMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+ThreadPool& ThreadPool::global() {
+    std::lock_guard<std::mutex> guard(globalPoolMutex());
+
+    if (!globalPool) {
+        globalPool.reset(new ThreadPool());
+    }
+
+    return *globalPool;
+}
+
+void ThreadPool::setGlobalThreadCount(unsigned threadCount) {
+    std::lock_guard<std::mutex> guard(globalPoolMutex());
+    globalPool.reset(new ThreadPool(threadCount));
+}
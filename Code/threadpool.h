@@ -0,0 +1,100 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief The ThreadPool class
+ *
+ * A fixed set of worker threads that process bands of an index range.
+ * The thread calling parallelFor() works on bands too, so a pool with
+ * a thread count of 1 has no workers and runs everything inline.
+ */
+class ThreadPool {
+
+public:
+    /**
+     * @param threadCount the number of threads working on a parallelFor,
+     *        including the caller. 0 uses one thread per hardware thread.
+     */
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    inline unsigned getThreadCount() const { return threadCount; }
+
+    /**
+     * @brief parallelFor
+     *
+     * Splits [begin, end) into contiguous bands of at least minBandSize
+     * indices and calls body(bandBegin, bandEnd) for each band, in parallel.
+     * Returns when all bands are done. Safe to call from any thread. The
+     * body is called by reference, so queueing the bands allocates nothing.
+     */
+    template<typename Body>
+    void parallelFor(unsigned begin, unsigned end, const Body& body, unsigned minBandSize = 1) {
+        BandFunction function = { &body, [](const void *body, unsigned begin, unsigned end) {
+            (*static_cast<const Body *>(body))(begin, end);
+        } };
+
+        runBands(begin, end, function, minBandSize);
+    }
+
+    /**
+     * @brief global
+     *
+     * The pool shared by the terrain generation code
+     */
+    static ThreadPool& global();
+
+    /**
+     * @brief setGlobalThreadCount
+     *
+     * Replaces the global pool with one of the given size (0 = hardware
+     * threads). Must not be called while the global pool is in use.
+     */
+    static void setGlobalThreadCount(unsigned threadCount);
+
+private:
+    // a band body, called through a function pointer instead of a std::function
+    struct BandFunction {
+        const void *body;
+        void (*call)(const void *body, unsigned begin, unsigned end);
+    };
+
+    // a queued band, and the count of bands of its parallelFor that are not done yet
+    struct Task {
+        const BandFunction *function;
+        unsigned begin;
+        unsigned end;
+        unsigned *remaining;
+        std::condition_variable *done;
+    };
+
+    void runBands(unsigned begin, unsigned end, const BandFunction& function, unsigned minBandSize);
+    void workerLoop();
+    bool runPendingTask(std::unique_lock<std::mutex>& lock);
+
+    unsigned threadCount;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    bool stopping;
+
+    // tasks from nextTask on are pending. The queue is emptied once all are
+    // taken, so it keeps its memory instead of growing or shrinking.
+    std::vector<Task> tasks;
+    size_t nextTask;
+
+    static std::unique_ptr<ThreadPool> globalPool;
+
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,412 @@
+#include "triangleorder.h"
+
+#include <QDebug>
+#include <QVector3D>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+TriangleOrder currentOrder;
+
+// the LRU cache the scores of optimizeVertexCache are tuned for
+const unsigned CACHE_SIZE = 32;
+
+// the number of remaining triangles beyond which the valence boost stays the same
+const unsigned MAX_VALENCE = 32;
+
+// the FIFO cache optimizeOverdraw measures the clusters with
+const unsigned OVERDRAW_CACHE_SIZE = 16;
+
+const size_t NO_TRIANGLE = std::numeric_limits<size_t>::max();
+
+/**
+ * The scores of Forsyth's algorithm, per cache position (-1 for vertices
+ * outside the cache) and per number of triangles that still use the vertex
+ */
+class VertexScores {
+
+public:
+    VertexScores() {
+        const float cacheDecayPower = 1.5f;
+        const float lastTriangleScore = 0.75f;
+        const float valenceBoostScale = 2.0f;
+        const float valenceBoostPower = 0.5f;
+
+        for (unsigned position = 0; position < CACHE_SIZE; position++) {
+            // the vertices of the last triangle get a fixed score, so it isn't simply repeated
+            cacheScores[position + 1] = position < 3 ? lastTriangleScore :
+                    std::pow(1.0f - float(position - 3) / float(CACHE_SIZE - 3), cacheDecayPower);
+        }
+        cacheScores[0] = 0.0f;
+
+        // vertices with few triangles left are finished first, so they can leave the cache
+        valenceScores[0] = 0.0f;
+        for (unsigned valence = 1; valence <= MAX_VALENCE; valence++) {
+            valenceScores[valence] = valenceBoostScale * std::pow(float(valence), -valenceBoostPower);
+        }
+    }
+
+    inline float get(int cachePosition, unsigned remaining) const {
+        // vertices without triangles don't matter anymore
+        if (remaining == 0) {
+            return -1.0f;
+        }
+
+        return cacheScores[cachePosition + 1] + valenceScores[std::min(remaining, MAX_VALENCE)];
+    }
+
+private:
+    float cacheScores[CACHE_SIZE + 1];
+    float valenceScores[MAX_VALENCE + 1];
+
+};
+
+/**
+ * A FIFO cache simulation: a vertex is a hit while fewer than cacheSize
+ * other vertices entered the cache after it
+ */
+class FifoCache {
+
+public:
+    FifoCache(size_t vertexCount, unsigned cacheSize) :
+            timestamps(vertexCount, 0), cacheSize(cacheSize), time(cacheSize + 1) {
+    }
+
+    // forgets all vertices
+    inline void flush() {
+        time += cacheSize + 1;
+    }
+
+    // the number of vertices of the triangle that had to be transformed
+    inline unsigned add(const GLuint *triangle) {
+        unsigned misses = 0;
+        for (unsigned k = 0; k < 3; k++) {
+            if (time - timestamps[triangle[k]] > cacheSize) {
+                timestamps[triangle[k]] = time++;
+                misses++;
+            }
+        }
+        return misses;
+    }
+
+private:
+    std::vector<unsigned> timestamps;
+    unsigned cacheSize;
+    unsigned time;
+
+};
+
+/**
+ * @brief splitClusters
+ *
+ * The starts of the clusters of optimizeOverdraw, followed by the number of
+ * triangles. Every triangle that misses the cache with all its vertices
+ * starts a new cluster, and those clusters are split again wherever the
+ * misses per triangle since the start of the cluster fall within the
+ * threshold of those of the whole cluster.
+ */
+std::vector<size_t> splitClusters(const std::vector<GLuint>& indices, size_t vertexCount, float threshold) {
+    size_t triangleCount = indices.size() / 3;
+
+    std::vector<size_t> hardStarts;
+    FifoCache cache(vertexCount, OVERDRAW_CACHE_SIZE);
+    for (size_t t = 0; t < triangleCount; t++) {
+        if (cache.add(&indices[t * 3]) == 3) {
+            hardStarts.push_back(t);
+        }
+    }
+    hardStarts.push_back(triangleCount);
+
+    std::vector<size_t> starts;
+    for (size_t c = 0; c + 1 < hardStarts.size(); c++) {
+        size_t begin = hardStarts[c];
+        size_t end = hardStarts[c + 1];
+
+        cache.flush();
+        unsigned clusterMisses = 0;
+        for (size_t t = begin; t < end; t++) {
+            clusterMisses += cache.add(&indices[t * 3]);
+        }
+        float target = threshold * float(clusterMisses) / float(end - begin);
+
+        cache.flush();
+        starts.push_back(begin);
+
+        unsigned misses = 0;
+        size_t triangles = 0;
+        for (size_t t = begin; t < end; t++) {
+            misses += cache.add(&indices[t * 3]);
+            triangles++;
+
+            // the cluster so far is good enough on its own, start the next one after it
+            if (t + 1 < end && float(misses) <= target * float(triangles)) {
+                starts.push_back(t + 1);
+                cache.flush();
+                misses = 0;
+                triangles = 0;
+            }
+        }
+    }
+
+    starts.push_back(triangleCount);
+    return starts;
+}
+
+} // namespace
+
+const TriangleOrder& getTriangleOrder() {
+    return currentOrder;
+}
+
+void setTriangleOrder(const TriangleOrder& order) {
+    currentOrder = order;
+}
+
+VertexCacheStats analyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, unsigned cacheSize) {
+    VertexCacheStats stats;
+    FifoCache cache(vertexCount, cacheSize);
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        stats.transformed += cache.add(&indices[i]);
+    }
+
+    if (indices.size() >= 3) {
+        stats.acmr = float(stats.transformed) / float(indices.size() / 3);
+    }
+    if (vertexCount > 0) {
+        stats.atvr = float(stats.transformed) / float(vertexCount);
+    }
+
+    return stats;
+}
+
+void optimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount) {
+    static const VertexScores scores;
+
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // the triangles of every vertex, of which the first remaining[v] are not emitted yet
+    std::vector<unsigned> remaining(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+        remaining[indices[i]]++;
+    }
+
+    std::vector<size_t> firstTriangle(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+    }
+
+    std::vector<unsigned> vertexTriangles(triangleCount * 3);
+    {
+        std::vector<size_t> next(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            vertexTriangles[next[indices[i]]++] = static_cast<unsigned>(i / 3);
+        }
+    }
+
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        vertexScores[v] = scores.get(-1, remaining[v]);
+    }
+
+    std::vector<float> triangleScores(triangleCount);
+    size_t best = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] +
+                            vertexScores[indices[t * 3 + 2]];
+        if (triangleScores[t] > triangleScores[best]) {
+            best = t;
+        }
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<GLuint> ordered;
+    ordered.reserve(triangleCount * 3);
+
+    // the cache holds up to 3 more vertices while a triangle is added, those are evicted
+    GLuint cache[CACHE_SIZE + 3];
+    unsigned cacheCount = 0;
+    size_t nextInput = 0;
+
+    while (true) {
+        const GLuint *triangle = &indices[best * 3];
+        ordered.insert(ordered.end(), triangle, triangle + 3);
+        emitted[best] = true;
+
+        if (ordered.size() == triangleCount * 3) {
+            break;
+        }
+
+        // the triangle is done for its vertices
+        for (unsigned k = 0; k < 3; k++) {
+            GLuint v = triangle[k];
+            unsigned *begin = &vertexTriangles[firstTriangle[v]];
+            unsigned *end = begin + remaining[v];
+            *std::find(begin, end, static_cast<unsigned>(best)) = *(end - 1);
+            remaining[v]--;
+        }
+
+        // its vertices move to the front of the cache
+        GLuint newCache[CACHE_SIZE + 3];
+        unsigned newCount = 0;
+        for (unsigned k = 0; k < 3; k++) {
+            if (std::find(newCache, newCache + newCount, triangle[k]) == newCache + newCount) {
+                newCache[newCount++] = triangle[k];
+            }
+        }
+        for (unsigned i = 0; i < cacheCount; i++) {
+            if (std::find(triangle, triangle + 3, cache[i]) == triangle + 3) {
+                newCache[newCount++] = cache[i];
+            }
+        }
+
+        // rescore the vertices that moved, and the triangles that use them
+        for (unsigned i = 0; i < newCount; i++) {
+            GLuint v = newCache[i];
+            cachePositions[v] = i < CACHE_SIZE ? int(i) : -1;
+
+            float score = scores.get(cachePositions[v], remaining[v]);
+            float delta = score - vertexScores[v];
+            vertexScores[v] = score;
+
+            for (size_t j = firstTriangle[v]; j < firstTriangle[v] + remaining[v]; j++) {
+                triangleScores[vertexTriangles[j]] += delta;
+            }
+        }
+
+        cacheCount = std::min(newCount, CACHE_SIZE);
+        std::copy(newCache, newCache + cacheCount, cache);
+
+        // the next triangle is the best one that uses a cached vertex
+        best = NO_TRIANGLE;
+        float bestScore = -std::numeric_limits<float>::infinity();
+        for (unsigned i = 0; i < cacheCount; i++) {
+            GLuint v = cache[i];
+            for (size_t j = firstTriangle[v]; j < firstTriangle[v] + remaining[v]; j++) {
+                unsigned t = vertexTriangles[j];
+                if (triangleScores[t] > bestScore) {
+                    bestScore = triangleScores[t];
+                    best = t;
+                }
+            }
+        }
+
+        // dead end: continue with the first triangle of the input that is left
+        if (best == NO_TRIANGLE) {
+            while (emitted[nextInput]) {
+                nextInput++;
+            }
+            best = nextInput;
+        }
+    }
+
+    indices.swap(ordered);
+}
+
+void optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<vertex>& vertices, float threshold) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    std::vector<size_t> starts = splitClusters(indices, vertices.size(), threshold);
+    size_t clusterCount = starts.size() - 1;
+    if (clusterCount < 2) {
+        return;
+    }
+
+    // the area weighted centroids and normals of the clusters, and of the mesh
+    std::vector<QVector3D> centroids(clusterCount);
+    std::vector<QVector3D> normals(clusterCount);
+    QVector3D meshCentroid;
+    float meshArea = 0.0f;
+
+    for (size_t c = 0; c < clusterCount; c++) {
+        QVector3D centroid;
+        QVector3D normal;
+        float area = 0.0f;
+
+        for (size_t t = starts[c]; t < starts[c + 1]; t++) {
+            QVector3D p0 = vertices[indices[t * 3]].getPosition();
+            QVector3D p1 = vertices[indices[t * 3 + 1]].getPosition();
+            QVector3D p2 = vertices[indices[t * 3 + 2]].getPosition();
+
+            QVector3D cross = QVector3D::crossProduct(p1 - p0, p2 - p0);
+            float triangleArea = cross.length();
+
+            centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+
+        meshCentroid += centroid;
+        meshArea += area;
+
+        centroids[c] = area > 0.0f ? centroid / area : centroid;
+        normals[c] = normal.normalized();
+    }
+
+    if (meshArea > 0.0f) {
+        meshCentroid /= meshArea;
+    }
+
+    std::vector<float> keys(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        keys[c] = QVector3D::dotProduct(centroids[c] - meshCentroid, normals[c]);
+    }
+
+    std::vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return keys[a] > keys[b];
+    });
+
+    std::vector<GLuint> ordered;
+    ordered.reserve(triangleCount * 3);
+    for (size_t c : order) {
+        ordered.insert(ordered.end(), indices.begin() + starts[c] * 3, indices.begin() + starts[c + 1] * 3);
+    }
+
+    indices.swap(ordered);
+}
+
+std::vector<GLuint> createGridTriangles(unsigned size) {
+    std::vector<GLuint> indices;
+    indices.reserve(6 * size_t(size - 1) * (size - 1));
+
+    for (unsigned x = 0; x + 1 < size; x++) {
+        for (unsigned z = 0; z + 1 < size; z++) {
+            GLuint a = x * size + z;
+            indices.insert(indices.end(), { a, a + 1, a + size, a + 1, a + size + 1, a + size });
+        }
+    }
+
+    return indices;
+}
+
+void orderTriangles(std::vector<GLuint>& indices, const std::vector<vertex>& vertices, const TriangleOrder& order) {
+    // the optimizations index per-vertex tables with the indices
+    for (GLuint index : indices) {
+        if (index >= vertices.size()) {
+            qWarning() << ":: Index" << index << "is out of range of" << vertices.size() << "vertices, the triangles are not reordered";
+            return;
+        }
+    }
+
+    if (order.vertexCache) {
+        optimizeVertexCache(indices, vertices.size());
+    }
+
+    if (order.overdrawThreshold > 0.0f) {
+        optimizeOverdraw(indices, vertices, order.overdrawThreshold);
+    }
+}
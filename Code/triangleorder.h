@@ -0,0 +1,95 @@
+#ifndef TRIANGLEORDER_H
+#define TRIANGLEORDER_H
+
+#include "vertex.h"
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * How triangle lists are reordered before they are uploaded
+ */
+struct TriangleOrder {
+    // order the triangles for the post-transform vertex cache
+    bool vertexCache = true;
+
+    // then cluster them to reduce overdraw, letting the cache miss at most
+    // this factor more often. 0 disables the clustering.
+    float overdrawThreshold = 1.05f;
+};
+
+/**
+ * @brief getTriangleOrder
+ *
+ * How ModelData reorders the triangle lists it uploads
+ */
+const TriangleOrder& getTriangleOrder();
+void setTriangleOrder(const TriangleOrder& order);
+
+/**
+ * How often a triangle list misses the post-transform vertex cache
+ */
+struct VertexCacheStats {
+    // vertex shader invocations
+    size_t transformed = 0;
+
+    // per triangle (ACMR): 3 at worst, around 0.5 for large regular grids
+    float acmr = 0.0f;
+
+    // per vertex (ATVR): 1 is the best possible
+    float atvr = 0.0f;
+};
+
+/**
+ * @brief analyzeVertexCache
+ *
+ * Simulates a FIFO post-transform cache of cacheSize vertices, which is
+ * how most GPUs behave, over a triangle list
+ */
+VertexCacheStats analyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, unsigned cacheSize = 16);
+
+/**
+ * @brief optimizeVertexCache
+ *
+ * Reorders the triangles of a triangle list so that they reuse the
+ * vertices of the triangles just before them, with the linear-speed
+ * algorithm of Tom Forsyth: it scores vertices by their position in a
+ * simulated LRU cache and by how many triangles still use them, and
+ * greedily emits the best scoring triangle among those of the cached
+ * vertices. The triangles and their winding stay the same.
+ */
+void optimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount);
+
+/**
+ * @brief optimizeOverdraw
+ *
+ * Reorders an index buffer that is already optimized for the vertex cache
+ * so that triangles that are likely to occlude others are drawn first,
+ * in the style of Tipsify (Sander et al.): the triangles are split into
+ * clusters wherever the cache would be flushed anyway, or where splitting
+ * keeps the cache misses of the cluster within threshold times what they
+ * were. The clusters are then drawn outermost first, by how far their
+ * centroid lies in front of that of the mesh along their average normal.
+ * This does not depend on the view, so it is done once.
+ */
+void optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<vertex>& vertices, float threshold);
+
+/**
+ * @brief createGridTriangles
+ *
+ * The triangle list of a size by size grid that is stored row-major, two
+ * triangles per quad in the order the quads are stored. This is how grids
+ * look as OBJ files, before they are reordered.
+ */
+std::vector<GLuint> createGridTriangles(unsigned size);
+
+/**
+ * @brief orderTriangles
+ *
+ * Applies the optimizations of the order to a triangle list. Lists with
+ * indices of missing vertices are left as they are.
+ */
+void orderTriangles(std::vector<GLuint>& indices, const std::vector<vertex>& vertices,
+                    const TriangleOrder& order = getTriangleOrder());
+
+#endif // TRIANGLEORDER_H
@@ -0,0 +1,230 @@
+#include "upsample.h"
+#include "threadpool.h"
+
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define UPSAMPLE_X86
+#include <immintrin.h>
+#endif
+
+// GCC and clang need AVX2 functions to be marked, MSVC always allows the intrinsics
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace {
+
+struct UpsampleKernels {
+    // out[j * quadSize + k] = lerp(lattice[j], lattice[j + 1], weights[k])
+    void (*expandRow)(float *out, const float *lattice, unsigned quadCount, unsigned quadSize,
+                      const float *weights, const float *inverseWeights);
+
+    // out[z] += lerp(a[z], b[z], weight)
+    void (*lerpRows)(float *out, const float *a, const float *b, float weight, float inverseWeight, unsigned count);
+
+    // out[z] += a[z]
+    void (*addRow)(float *out, const float *a, unsigned count);
+};
+
+// --- scalar kernels
+
+void expandRowScalar(float *out, const float *lattice, unsigned quadCount, unsigned quadSize,
+                     const float *weights, const float *inverseWeights) {
+    for (unsigned j = 0; j < quadCount; j++) {
+        float left = lattice[j];
+        float right = lattice[j + 1];
+
+        for (unsigned k = 0; k < quadSize; k++) {
+            out[j * quadSize + k] = right * weights[k] + left * inverseWeights[k];
+        }
+    }
+
+    out[quadCount * quadSize] = lattice[quadCount];
+}
+
+void lerpRowsScalar(float *out, const float *a, const float *b, float weight, float inverseWeight, unsigned count) {
+    for (unsigned z = 0; z < count; z++) {
+        out[z] += b[z] * weight + a[z] * inverseWeight;
+    }
+}
+
+void addRowScalar(float *out, const float *a, unsigned count) {
+    for (unsigned z = 0; z < count; z++) {
+        out[z] += a[z];
+    }
+}
+
+const UpsampleKernels scalarKernels = { expandRowScalar, lerpRowsScalar, addRowScalar };
+
+#ifdef UPSAMPLE_X86
+
+// --- SSE2 kernels
+
+void expandRowSSE2(float *out, const float *lattice, unsigned quadCount, unsigned quadSize,
+                   const float *weights, const float *inverseWeights) {
+    // quads narrower than a register are cheaper to do one by one
+    if (quadSize % 4 != 0) {
+        expandRowScalar(out, lattice, quadCount, quadSize, weights, inverseWeights);
+        return;
+    }
+
+    for (unsigned j = 0; j < quadCount; j++) {
+        __m128 left = _mm_set1_ps(lattice[j]);
+        __m128 right = _mm_set1_ps(lattice[j + 1]);
+
+        for (unsigned k = 0; k < quadSize; k += 4) {
+            __m128 w = _mm_loadu_ps(weights + k);
+            __m128 iw = _mm_loadu_ps(inverseWeights + k);
+            _mm_storeu_ps(out + j * quadSize + k, _mm_add_ps(_mm_mul_ps(right, w), _mm_mul_ps(left, iw)));
+        }
+    }
+
+    out[quadCount * quadSize] = lattice[quadCount];
+}
+
+void lerpRowsSSE2(float *out, const float *a, const float *b, float weight, float inverseWeight, unsigned count) {
+    __m128 w = _mm_set1_ps(weight);
+    __m128 iw = _mm_set1_ps(inverseWeight);
+
+    unsigned z = 0;
+    for (; z + 4 <= count; z += 4) {
+        __m128 value = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(b + z), w), _mm_mul_ps(_mm_loadu_ps(a + z), iw));
+        _mm_storeu_ps(out + z, _mm_add_ps(_mm_loadu_ps(out + z), value));
+    }
+
+    lerpRowsScalar(out + z, a + z, b + z, weight, inverseWeight, count - z);
+}
+
+void addRowSSE2(float *out, const float *a, unsigned count) {
+    unsigned z = 0;
+    for (; z + 4 <= count; z += 4) {
+        _mm_storeu_ps(out + z, _mm_add_ps(_mm_loadu_ps(out + z), _mm_loadu_ps(a + z)));
+    }
+
+    addRowScalar(out + z, a + z, count - z);
+}
+
+const UpsampleKernels sse2Kernels = { expandRowSSE2, lerpRowsSSE2, addRowSSE2 };
+
+// --- AVX2 kernels
+
+TARGET_AVX2 void expandRowAVX2(float *out, const float *lattice, unsigned quadCount, unsigned quadSize,
+                               const float *weights, const float *inverseWeights) {
+    if (quadSize % 8 != 0) {
+        expandRowSSE2(out, lattice, quadCount, quadSize, weights, inverseWeights);
+        return;
+    }
+
+    for (unsigned j = 0; j < quadCount; j++) {
+        __m256 left = _mm256_set1_ps(lattice[j]);
+        __m256 right = _mm256_set1_ps(lattice[j + 1]);
+
+        for (unsigned k = 0; k < quadSize; k += 8) {
+            __m256 w = _mm256_loadu_ps(weights + k);
+            __m256 iw = _mm256_loadu_ps(inverseWeights + k);
+            _mm256_storeu_ps(out + j * quadSize + k, _mm256_add_ps(_mm256_mul_ps(right, w), _mm256_mul_ps(left, iw)));
+        }
+    }
+
+    out[quadCount * quadSize] = lattice[quadCount];
+}
+
+TARGET_AVX2 void lerpRowsAVX2(float *out, const float *a, const float *b, float weight, float inverseWeight, unsigned count) {
+    __m256 w = _mm256_set1_ps(weight);
+    __m256 iw = _mm256_set1_ps(inverseWeight);
+
+    unsigned z = 0;
+    for (; z + 8 <= count; z += 8) {
+        __m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(b + z), w), _mm256_mul_ps(_mm256_loadu_ps(a + z), iw));
+        _mm256_storeu_ps(out + z, _mm256_add_ps(_mm256_loadu_ps(out + z), value));
+    }
+
+    lerpRowsScalar(out + z, a + z, b + z, weight, inverseWeight, count - z);
+}
+
+TARGET_AVX2 void addRowAVX2(float *out, const float *a, unsigned count) {
+    unsigned z = 0;
+    for (; z + 8 <= count; z += 8) {
+        _mm256_storeu_ps(out + z, _mm256_add_ps(_mm256_loadu_ps(out + z), _mm256_loadu_ps(a + z)));
+    }
+
+    addRowScalar(out + z, a + z, count - z);
+}
+
+const UpsampleKernels avx2Kernels = { expandRowAVX2, lerpRowsAVX2, addRowAVX2 };
+
+#endif // UPSAMPLE_X86
+
+const UpsampleKernels& getKernels(SimdLevel level) {
+#ifdef UPSAMPLE_X86
+    switch (level) {
+    case SimdLevel::AVX2: return avx2Kernels;
+    case SimdLevel::SSE2: return sse2Kernels;
+    default:              break;
+    }
+#else
+    (void) level;
+#endif
+
+    return scalarKernels;
+}
+
+} // namespace
+
+void addUpsampledLattice(Heightfield& grid, const Heightfield& lattice, unsigned quadSize, SimdLevel level) {
+    const UpsampleKernels& kernels = getKernels(level);
+
+    unsigned size = grid.getColumns();
+    unsigned latticeSize = lattice.getColumns();
+    unsigned quadCount = latticeSize - 1;
+
+    // smoothstep weights for every offset within a quad
+    std::vector<float> weights(quadSize);
+    std::vector<float> inverseWeights(quadSize);
+
+    for (unsigned k = 0; k < quadSize; k++) {
+        weights[k] = smoothstepWeight(k, quadSize);
+        inverseWeights[k] = 1 - weights[k];
+    }
+
+    ThreadPool& pool = ThreadPool::global();
+
+    // first pass: expand every lattice row along z
+    Heightfield rows(lattice.getRows(), size);
+    pool.parallelFor(0, lattice.getRows(), [&](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++) {
+            kernels.expandRow(rows.row(i), lattice.row(i), quadCount, quadSize, weights.data(), inverseWeights.data());
+        }
+    }, 8);
+
+    // second pass: blend the expanded rows along x, in bands of grid rows
+    pool.parallelFor(0, grid.getRows(), [&](unsigned begin, unsigned end) {
+        for (unsigned x = begin; x < end; x++) {
+            unsigned i = x / quadSize;
+            unsigned k = x - i * quadSize;
+
+            if (k == 0) {
+                kernels.addRow(grid.row(x), rows.row(i), size);
+            } else {
+                kernels.lerpRows(grid.row(x), rows.row(i), rows.row(i + 1), weights[k], inverseWeights[k], size);
+            }
+        }
+    }, 16);
+}
+
+void expandLatticeRow(float *out, const float *lattice, unsigned quadCount, unsigned quadSize,
+                      const float *weights, const float *inverseWeights, SimdLevel level) {
+    getKernels(level).expandRow(out, lattice, quadCount, quadSize, weights, inverseWeights);
+}
+
+void addLerpedRows(float *out, const float *a, const float *b, float weight, float inverseWeight, unsigned count,
+                   SimdLevel level) {
+    getKernels(level).lerpRows(out, a, b, weight, inverseWeight, count);
+}
+
+void addGridRow(float *out, const float *a, unsigned count, SimdLevel level) {
+    getKernels(level).addRow(out, a, count);
+}
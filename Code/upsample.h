@@ -0,0 +1,68 @@
+#ifndef UPSAMPLE_H
+#define UPSAMPLE_H
+
+#include "heightfield.h"
+#include "simd.h"
+
+/**
+ * @brief smoothstepWeight
+ *
+ * The interpolation weight of grid point k within a quad. Every evaluation
+ * of the noise uses this, so grids and point samples agree bit for bit.
+ */
+inline float smoothstepWeight(unsigned k, unsigned quadSize) {
+    float t = k / float(quadSize);
+    return t * t * (3 - 2 * t);
+}
+
+/**
+ * @brief addUpsampledLattice
+ *
+ * Adds a coarse lattice, interpolated with smoothstep weights, to a grid.
+ * Lattice point (i, j) lies on grid point (i * quadSize, j * quadSize), so
+ * the lattice must be (grid size - 1) / quadSize + 1 points wide.
+ *
+ * The interpolation is separable: every lattice row is first expanded
+ * along z, after which each grid row is a lerp between two expanded rows.
+ * Both passes use a smoothstep weight table computed once per call.
+ *
+ * All SIMD levels produce bit-identical results. Compared to interpolating
+ * along x first (the original NoiseGrid formulation), interior values may
+ * differ by rounding only: at most 4 * FLT_EPSILON * the largest absolute
+ * lattice value. Values on lattice rows and columns are identical.
+ *
+ * @param grid the grid to add to
+ * @param lattice the coarse lattice values
+ * @param quadSize the distance between lattice points, in grid points
+ * @param level the instruction set to use
+ */
+void addUpsampledLattice(Heightfield& grid, const Heightfield& lattice, unsigned quadSize,
+                         SimdLevel level = getSimdLevel());
+
+/**
+ * @brief expandLatticeRow
+ *
+ * The first pass of addUpsampledLattice for a single lattice row:
+ * out[j * quadSize + k] = lerp(lattice[j], lattice[j + 1], weights[k]),
+ * and the last lattice value at out[quadCount * quadSize]
+ */
+void expandLatticeRow(float *out, const float *lattice, unsigned quadCount, unsigned quadSize,
+                      const float *weights, const float *inverseWeights, SimdLevel level = getSimdLevel());
+
+/**
+ * @brief addLerpedRows
+ *
+ * The second pass of addUpsampledLattice for a single grid row:
+ * out[z] += b[z] * weight + a[z] * inverseWeight
+ */
+void addLerpedRows(float *out, const float *a, const float *b, float weight, float inverseWeight, unsigned count,
+                   SimdLevel level = getSimdLevel());
+
+/**
+ * @brief addGridRow
+ *
+ * out[z] += a[z], for grid rows on a lattice row
+ */
+void addGridRow(float *out, const float *a, unsigned count, SimdLevel level = getSimdLevel());
+
+#endif // UPSAMPLE_H
@@ -6,7 +6,11 @@
 void MainView::keyPressEvent(QKeyEvent *ev)
 {
     switch(ev->key()) {
-    case 'A': qDebug() << "A pressed"; break;
+    // move the camera over the terrain
+    case 'W': case Qt::Key_Up:    moveCameraTarget( 1,  0); break;
+    case 'S': case Qt::Key_Down:  moveCameraTarget(-1,  0); break;
+    case 'A': case Qt::Key_Left:  moveCameraTarget( 0, -1); break;
+    case 'D': case Qt::Key_Right: moveCameraTarget( 0,  1); break;
     default:
         // ev->key() is an integer. For alpha numeric characters keys it equivalent with the char value ('A' == 65, '1' == 49)
         // Alternatively, you could use Qt Key enums, see http://doc.qt.io/qt-5/qt.html#Key-enum
@@ -37,6 +41,13 @@ void MainView::mouseDoubleClickEvent(QMouseEvent *ev)
 {
     qDebug() << "Mouse double clicked:" << ev->button();
 
+    // orbit around the point of the terrain that was clicked
+    QVector3D position;
+    if (ev->button() == Qt::LeftButton && pickTerrain(ev->localPos(), position)) {
+        cameraTarget = QVector3D(position.x(), 0, position.z());
+        updateViewMatrix();
+    }
+
     update();
 }
 
@@ -53,6 +64,11 @@ void MainView::mousePressEvent(QMouseEvent *ev)
 {
     qDebug() << "Mouse button pressed:" << ev->button();
 
+    QVector3D position;
+    if (pickTerrain(ev->localPos(), position)) {
+        qDebug() << "Picked terrain at" << position;
+    }
+
     update();
     // Do not remove the line below, clicking must focus on this widget!
     this->setFocus();
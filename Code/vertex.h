@@ -1,7 +1,7 @@
 #ifndef VERTEX_H
 #define VERTEX_H
 
-#include <QOpenGLFunctions_3_3_Core>
+#include <qopengl.h>
 #include <QVector2D>
 #include <QVector3D>
 
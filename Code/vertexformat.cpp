@@ -0,0 +1,254 @@
+#include "vertexformat.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+
+namespace {
+
+VertexTolerance currentTolerance;
+
+// --- half floats
+
+GLushort floatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    // infinity and NaN
+    if (exponent == 0xff) {
+        return static_cast<GLushort>(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+    }
+
+    int halfExponent = static_cast<int>(exponent) - 127 + 15;
+    if (halfExponent >= 31) {
+        return static_cast<GLushort>(sign | 0x7c00);
+    }
+
+    // too small for a normal half, round to a subnormal one
+    if (halfExponent <= 0) {
+        if (halfExponent < -10) {
+            return static_cast<GLushort>(sign);
+        }
+
+        mantissa |= 0x800000;
+        unsigned shift = static_cast<unsigned>(14 - halfExponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+
+        if (rest > halfway || (rest == halfway && (half & 1))) {
+            half++;
+        }
+
+        return static_cast<GLushort>(sign | half);
+    }
+
+    // round to nearest even, a carry correctly rounds up into the exponent
+    uint32_t half = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+        half++;
+    }
+
+    return static_cast<GLushort>(sign | half);
+}
+
+float halfToFloat(GLushort half) {
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+
+    if (exponent == 0) {
+        float value = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign != 0 ? -value : value;
+    }
+
+    uint32_t bits;
+    if (exponent == 31) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// --- octahedral directions
+
+// the same mapping as octDecode in the shaders
+QVector2D octEncode(const QVector3D& direction) {
+    float length = std::fabs(direction.x()) + std::fabs(direction.y()) + std::fabs(direction.z());
+    float x = direction.x() / length;
+    float y = direction.y() / length;
+
+    if (direction.z() < 0) {
+        float foldedX = (1 - std::fabs(y)) * (x >= 0 ? 1.0f : -1.0f);
+        float foldedY = (1 - std::fabs(x)) * (y >= 0 ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    return QVector2D(x, y);
+}
+
+QVector3D octDecode(float x, float y) {
+    QVector3D direction(x, y, 1 - std::fabs(x) - std::fabs(y));
+
+    if (direction.z() < 0) {
+        direction.setX((1 - std::fabs(y)) * (x >= 0 ? 1.0f : -1.0f));
+        direction.setY((1 - std::fabs(x)) * (y >= 0 ? 1.0f : -1.0f));
+    }
+
+    return direction.normalized();
+}
+
+// signed normalized integers, as OpenGL converts them
+template<typename Integer>
+Integer toSnorm(float value) {
+    float maximum = static_cast<float>(std::numeric_limits<Integer>::max());
+    return static_cast<Integer>(std::lround(std::max(-1.0f, std::min(1.0f, value)) * maximum));
+}
+
+template<typename Integer>
+float fromSnorm(Integer value) {
+    return std::max(-1.0f, value / static_cast<float>(std::numeric_limits<Integer>::max()));
+}
+
+// the largest component error of a direction after encoding, or infinity
+// if the direction can't be encoded
+template<typename Integer>
+float encodeDirection(const QVector3D& direction, Integer *encoded) {
+    float length = direction.length();
+    if (!(length > 1e-6f)) {
+        return std::numeric_limits<float>::infinity();
+    }
+
+    QVector3D unit = direction / length;
+    QVector2D oct = octEncode(unit);
+    encoded[0] = toSnorm<Integer>(oct.x());
+    encoded[1] = toSnorm<Integer>(oct.y());
+
+    QVector3D decoded = octDecode(fromSnorm(encoded[0]), fromSnorm(encoded[1]));
+    QVector3D error = decoded - unit;
+
+    return std::max(std::fabs(error.x()), std::max(std::fabs(error.y()), std::fabs(error.z())));
+}
+
+} // namespace
+
+const std::vector<VertexAttribute>& VertexLayout<vertex>::getAttributes() {
+    static const std::vector<VertexAttribute> attributes = {
+        { 0, 3, GL_FLOAT, GL_FALSE, offsetof(vertex, x) },
+        { 1, 3, GL_FLOAT, GL_FALSE, offsetof(vertex, nx) },
+        { 2, 3, GL_FLOAT, GL_FALSE, offsetof(vertex, tx) },
+        { 3, 2, GL_FLOAT, GL_FALSE, offsetof(vertex, u) }
+    };
+
+    return attributes;
+}
+
+const std::vector<VertexAttribute>& VertexLayout<CompactVertex>::getAttributes() {
+    static const std::vector<VertexAttribute> attributes = {
+        { 0, 3, GL_HALF_FLOAT,     GL_FALSE, offsetof(CompactVertex, position) },
+        { 1, 2, GL_SHORT,          GL_TRUE,  offsetof(CompactVertex, normal) },
+        { 2, 2, GL_BYTE,           GL_TRUE,  offsetof(CompactVertex, tangent) },
+        { 3, 2, GL_UNSIGNED_SHORT, GL_TRUE,  offsetof(CompactVertex, uv) }
+    };
+
+    return attributes;
+}
+
+const VertexTolerance& getVertexTolerance() {
+    return currentTolerance;
+}
+
+void setVertexTolerance(const VertexTolerance& tolerance) {
+    currentTolerance = tolerance;
+}
+
+bool compactVertices(const std::vector<vertex>& vertices, const VertexTolerance& tolerance, CompactVertices& result) {
+    if (!(tolerance.position > 0) || vertices.empty()) {
+        return false;
+    }
+
+    unsigned count = static_cast<unsigned>(vertices.size());
+    ThreadPool& pool = ThreadPool::global();
+
+    // the uv bounds of the mesh
+    std::mutex mutex;
+    float uvMin[2] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+    float uvMax[2] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+
+    pool.parallelFor(0, count, [&](unsigned begin, unsigned end) {
+        float bandMin[2] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+        float bandMax[2] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+
+        for (unsigned i = begin; i < end; i++) {
+            bandMin[0] = std::min(bandMin[0], vertices[i].u);
+            bandMin[1] = std::min(bandMin[1], vertices[i].v);
+            bandMax[0] = std::max(bandMax[0], vertices[i].u);
+            bandMax[1] = std::max(bandMax[1], vertices[i].v);
+        }
+
+        std::lock_guard<std::mutex> guard(mutex);
+        for (unsigned k = 0; k < 2; k++) {
+            uvMin[k] = std::min(uvMin[k], bandMin[k]);
+            uvMax[k] = std::max(uvMax[k], bandMax[k]);
+        }
+    }, 4096);
+
+    float uvScale[2];
+    for (unsigned k = 0; k < 2; k++) {
+        uvScale[k] = uvMax[k] > uvMin[k] ? uvMax[k] - uvMin[k] : 1.0f;
+    }
+
+    result.uvScale = QVector2D(uvScale[0], uvScale[1]);
+    result.uvBias = QVector2D(uvMin[0], uvMin[1]);
+    result.vertices.resize(vertices.size());
+
+    // encode, and give up as soon as a band finds a vertex that is off by too much
+    std::atomic<bool> withinTolerance(true);
+
+    pool.parallelFor(0, count, [&](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end && withinTolerance.load(std::memory_order_relaxed); i++) {
+            const vertex& in = vertices[i];
+            CompactVertex& out = result.vertices[i];
+
+            bool valid = true;
+
+            const float position[3] = { in.x, in.y, in.z };
+            for (unsigned k = 0; k < 3; k++) {
+                out.position[k] = floatToHalf(position[k]);
+                valid = valid && std::fabs(halfToFloat(out.position[k]) - position[k]) <= tolerance.position;
+            }
+
+            const float uv[2] = { in.u, in.v };
+            for (unsigned k = 0; k < 2; k++) {
+                float normalized = (uv[k] - uvMin[k]) / uvScale[k];
+                out.uv[k] = static_cast<GLushort>(std::lround(std::max(0.0f, std::min(1.0f, normalized)) * 65535.0f));
+                valid = valid && std::fabs(out.uv[k] / 65535.0f * uvScale[k] + uvMin[k] - uv[k]) <= tolerance.uv;
+            }
+
+            valid = valid && encodeDirection(QVector3D(in.nx, in.ny, in.nz), out.normal) <= tolerance.normal;
+            valid = valid && encodeDirection(QVector3D(in.tx, in.ty, in.tz), out.tangent) <= tolerance.tangent;
+
+            if (!valid) {
+                withinTolerance = false;
+            }
+        }
+    }, 4096);
+
+    return withinTolerance;
+}
@@ -0,0 +1,116 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include "vertex.h"
+
+#include <QVector2D>
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * One attribute of a vertex type: where it lies in the vertex, and how
+ * OpenGL has to read it
+ */
+struct VertexAttribute {
+    GLuint location;
+    GLint components;
+    GLenum type;
+    GLboolean normalized;
+    size_t offset;
+};
+
+/**
+ * @brief The VertexLayout struct
+ *
+ * Describes the attributes of a vertex type, which drive the
+ * glVertexAttribPointer calls when a buffer of them is uploaded.
+ * Every vertex type that can be uploaded specializes this.
+ */
+template<typename Vertex>
+struct VertexLayout;
+
+/**
+ * @brief The CompactVertex struct
+ *
+ * A 16 byte vertex:
+ *  - the normal, octahedral encoded in 2 x 16 bits
+ *  - the uv, 2 x 16 bit normalized within the uv bounds of the mesh
+ *  - the position, as half floats
+ *  - the tangent, octahedral encoded in 2 x 8 bits
+ *
+ * The shaders decode the directions, and map the uv back with the
+ * uvScale and uvBias of the mesh.
+ */
+struct CompactVertex {
+    GLshort normal[2];
+    GLushort uv[2];
+    GLushort position[3];
+    GLbyte tangent[2];
+};
+
+static_assert(sizeof(vertex) == 44, "vertex must be tightly packed");
+static_assert(sizeof(CompactVertex) == 16, "CompactVertex must be tightly packed");
+
+template<>
+struct VertexLayout<vertex> {
+    static const std::vector<VertexAttribute>& getAttributes();
+};
+
+template<>
+struct VertexLayout<CompactVertex> {
+    static const std::vector<VertexAttribute>& getAttributes();
+};
+
+/**
+ * The vertex formats, from largest to smallest. The values are what the
+ * shaders receive in the vertexFormat uniform.
+ */
+enum class VertexFormat {
+    Full = 0,
+    Compact = 1
+};
+
+/**
+ * The largest errors a compressed vertex format may introduce. Positions
+ * are in model space, directions per component of the unit vectors.
+ */
+struct VertexTolerance {
+    float position = 1.0f / 512.0f;
+    float normal = 1.0f / 1024.0f;
+    float tangent = 1.0f / 32.0f;
+    float uv = 1.0f / 1024.0f;
+};
+
+/**
+ * @brief getVertexTolerance
+ *
+ * The tolerance meshes are compressed with when they are uploaded.
+ * A position tolerance of 0 disables compression.
+ */
+const VertexTolerance& getVertexTolerance();
+void setVertexTolerance(const VertexTolerance& tolerance);
+
+/**
+ * The vertices of a mesh in the compact format
+ */
+struct CompactVertices {
+    std::vector<CompactVertex> vertices;
+
+    // uv = stored uv * uvScale + uvBias
+    QVector2D uvScale;
+    QVector2D uvBias;
+};
+
+/**
+ * @brief compactVertices
+ *
+ * Converts vertices to the compact format, and checks every vertex
+ * against the tolerance.
+ *
+ * @return false if any vertex would be off by more than the tolerance,
+ *         in which case the full format has to be used
+ */
+bool compactVertices(const std::vector<vertex>& vertices, const VertexTolerance& tolerance, CompactVertices& result);
+
+#endif // VERTEXFORMAT_H